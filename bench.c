@@ -0,0 +1,414 @@
+/**
+ * @file bench.c
+ * @brief Замер скорости всех этапов синтеза на синтетических входных данных с выводом в JSON.
+ *
+ * Для каждого размера (по умолчанию 10, 1000 и 100000 слогов) генерируется русский
+ * текст из слов, все слоги которых есть в голосовом банке, и по отдельности
+ * замеряются этапы: транскрипция (poslogam), разбиение на слоги (trnskrp) и разбор
+ * текстовой партитуры. Затем для каждого набора эффектов — без эффектов, как их
+ * записывает trnskrp, по одному эффекту и все эффекты сразу — замеряются обработка
+ * слогов и сборка результата. Обработка и сборка выполняются только для размеров
+ * не больше --render-limit (по умолчанию 1000): 100000 слогов — это десятки часов
+ * звука и гигабайты памяти.
+ *
+ * Каждый этап повторяется, пока не наберётся BENCH_MIN_SECONDS, и в отчёт идёт
+ * время одного прогона. Результаты пишутся в JSON (--out=, по умолчанию bench.json):
+ * слогов в секунду, коэффициент реального времени для обработки и пиковый объём
+ * резидентной памяти процесса к концу каждого размера. Кэш обработанных слогов
+ * не используется, обработка идёт в одном потоке.
+ *
+ * Пример: bench --voicebank=voicebank --sizes=10,1000 --out=bench.json --label=v1.2
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+#include "tts.h"
+#include "dsp_simd.h"
+#include "workers.h"
+
+#define BENCH_MIN_SECONDS 0.2  ///< Минимальное суммарное время повторов одного этапа
+#define BENCH_MAX_SIZES 16     ///< Наибольшее количество размеров в --sizes=
+#define WORDS_PER_LINE 8       ///< Слов в строке синтетического текста
+
+/** @brief Слова, все слоги которых есть в голосовом банке; ни одно не начинается с гласной,
+ *  поэтому слоги соседних слов не сливаются. */
+static const char* words[] = {
+    "мама", "папа", "дорога", "молоко", "собака", "хорошо", "работа", "голова",
+    "вода", "сегодня", "вечером", "завтра", "хочу", "домой", "дела", "привет",
+    "спасибо", "конечно", "человек", "время", "город"
+};
+
+/** @brief Эффекты, включаемые набором. */
+enum {
+    MIX_PITCH = 1,
+    MIX_VIBRATO = 2,
+    MIX_FADE = 4,
+    MIX_ECHO = 8,
+    MIX_CHORUS = 16,
+    MIX_EQUALIZER = 32,
+    MIX_FLANGER = 64,
+    MIX_ALL = 127
+};
+
+/** @brief Наборы эффектов, для которых замеряется обработка. */
+static const struct {
+    const char* name;
+    int effects;
+} mixes[] = {
+    { "neutral", 0 },
+    { "pitch", MIX_PITCH },
+    { "vibrato", MIX_VIBRATO },
+    { "fade", MIX_FADE },
+    { "echo", MIX_ECHO },
+    { "chorus", MIX_CHORUS },
+    { "equalizer", MIX_EQUALIZER },
+    { "flanger", MIX_FLANGER },
+    { "full", MIX_ALL },
+};
+
+/** @brief Параметры слога для набора эффектов: значения по умолчанию trnskrp плюс включённые эффекты. */
+static void mix_params(int effects, EffectParams* p) {
+    tts_default_params(p);
+    if (effects & MIX_PITCH) p->semitones = 3;
+    if (effects & MIX_VIBRATO) {
+        p->freq_vibro = 6;
+        p->depth_vibro = 0.5f;
+    }
+    if (effects & MIX_FADE) {
+        p->start_fade_in = 0.0f;
+        p->duration_fade_in = 0.1f;
+        p->start_fade_out = 0.3f;
+        p->duration_fade_out = 0.2f;
+    }
+    if (effects & MIX_ECHO) {
+        p->Echo1 = 0.8f;
+        p->Echo2 = 0.9f;
+        p->Echo3 = 40.0f;
+        p->Echo4 = 0.3f;
+    }
+    if (effects & MIX_CHORUS) p->chorus = 0.5f;
+    if (effects & MIX_EQUALIZER) {
+        p->Equalizert = 1.0f;
+        p->Equalizerg = 6.0f;
+    }
+    if (effects & MIX_FLANGER) p->Flanger = 2.0f;
+}
+
+/** @brief Пиковый объём резидентной памяти процесса, КБ. */
+static long peak_rss_kb(void) {
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) return 0;
+    return (long)(counters.PeakWorkingSetSize / 1024);
+#else
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) return 0;
+    return usage.ru_maxrss; //!< В Linux — килобайты
+#endif
+}
+
+/** @brief Количество гласных в слове UTF-8: оценка числа слогов снизу. */
+static int count_vowels(const char* word) {
+    static const char* vowels[] = { "а", "е", "ё", "и", "о", "у", "ы", "э", "ю", "я" };
+    int count = 0;
+    for (const char* p = word; *p; p++) {
+        for (size_t v = 0; v < sizeof(vowels) / sizeof(vowels[0]); v++) {
+            if (strncmp(p, vowels[v], strlen(vowels[v])) == 0) count++;
+        }
+    }
+    return count;
+}
+
+/**
+ * @brief Генерирует текст не меньше чем на syllables слогов: слова по кругу с шагом,
+ *  взаимно простым с размером словаря, по WORDS_PER_LINE слов в строке.
+ */
+static char* generate_text(int syllables, size_t* len) {
+    size_t allocated = 4096, size = 0;
+    char* text = malloc(allocated);
+    int vowels = 0, index = 0;
+    for (int n = 0; text && vowels < syllables; n++) {
+        const char* word = words[index];
+        index = (index + 5) % (int)(sizeof(words) / sizeof(words[0]));
+        vowels += count_vowels(word);
+
+        size_t need = size + strlen(word) + 2;
+        if (need > allocated) {
+            while (need > allocated) allocated *= 2;
+            char* grown = realloc(text, allocated);
+            if (!grown) {
+                free(text);
+                return NULL;
+            }
+            text = grown;
+        }
+        memcpy(text + size, word, strlen(word));
+        size += strlen(word);
+        text[size++] = (n + 1) % WORDS_PER_LINE == 0 ? '\n' : ' ';
+    }
+    if (text) text[size] = '\0';
+    *len = size;
+    return text;
+}
+
+/** @brief Выводит замер этапа: время прогона и слогов в секунду. */
+static void json_stage(FILE* out, const char* name, double seconds, int syllables) {
+    fprintf(out, "\"%s\": {\"seconds\": %.9f, \"syllables_per_sec\": %.1f}", name, seconds,
+        seconds > 0 ? syllables / seconds : 0.0);
+}
+
+/** @brief Транскрипция и разбиение на слоги; партитура последнего прогона остаётся в score. */
+static int bench_frontend(FILE* out, const TtsInventory* inventory, const char* text, size_t len, Score* score) {
+    size_t translit_len = 0;
+    char* translit = NULL;
+    int runs = 0;
+    double start = workers_time(), elapsed;
+    do {
+        free(translit);
+        translit = tts_transliterate(text, len, &translit_len);
+        if (!translit) return -1;
+        runs++;
+        elapsed = workers_time() - start;
+    } while (elapsed < BENCH_MIN_SECONDS);
+    double translit_seconds = elapsed / runs;
+
+    runs = 0;
+    tts_score_init(score);
+    start = workers_time();
+    do {
+        tts_score_free(score);
+        if (tts_syllabify(inventory, translit, translit_len, score) != 0) {
+            free(translit);
+            return -1;
+        }
+        runs++;
+        elapsed = workers_time() - start;
+    } while (elapsed < BENCH_MIN_SECONDS);
+    free(translit);
+
+    fprintf(out, "      \"text_bytes\": %lu,\n      \"text_syllables\": %d,\n      ",
+        (unsigned long)len, score->count);
+    json_stage(out, "transliterate", translit_seconds, score->count);
+    fprintf(out, ",\n      ");
+    json_stage(out, "syllabify", elapsed / runs, score->count);
+    fprintf(out, ",\n");
+    return 0;
+}
+
+/** @brief Разбор текстовой партитуры из памяти; seconds — время прогона. */
+static int bench_parse(FILE* out, const Score* score, double* seconds) {
+    FILE* tmp = tmpfile();
+    if (!tmp) return -1;
+    tts_score_write_text(tmp, score);
+    long size = ftell(tmp);
+    char* text = malloc(size + 1);
+    rewind(tmp);
+    if (!text || fread(text, 1, size, tmp) != (size_t)size) {
+        free(text);
+        fclose(tmp);
+        return -1;
+    }
+    fclose(tmp);
+
+    int runs = 0;
+    double start = workers_time(), elapsed;
+    do {
+        Score parsed;
+        int rc = tts_score_parse_text(text, size, "bench", &parsed);
+        tts_score_free(&parsed);
+        if (rc != 0) {
+            free(text);
+            return -1;
+        }
+        runs++;
+        elapsed = workers_time() - start;
+    } while (elapsed < BENCH_MIN_SECONDS);
+    free(text);
+
+    *seconds = elapsed / runs;
+    json_stage(out, "parse", *seconds, score->count);
+    return 0;
+}
+
+/**
+ * @brief Обработка каждого слога в отдельный буфер и сборка буферов в один.
+ * @param[out] render_seconds Время обработки за прогон.
+ * @param[out] audio_seconds Длительность собранного звука.
+ */
+static int bench_render(FILE* out, TtsEngine* engine, const Score* score, double* render_seconds,
+    double* audio_seconds) {
+    AudioBuffer* parts = calloc(score->count, sizeof(AudioBuffer));
+    if (!parts) return -1;
+
+    int runs = 0;
+    double render = 0, assemble = 0, seconds = 0;
+    double start = workers_time();
+    do {
+        double t0 = workers_time();
+        for (int i = 0; i < score->count; i++) {
+            tts_render_range(engine, score, i, 1, &parts[i]);
+        }
+        double t1 = workers_time();
+        AudioBuffer assembled;
+        int rc = audio_concat(parts, score->count, &assembled);
+        double t2 = workers_time();
+
+        seconds = assembled.sample_rate > 0 ? (double)assembled.frames / assembled.sample_rate : 0;
+        audio_free(&assembled);
+        for (int i = 0; i < score->count; i++) {
+            audio_free(&parts[i]);
+        }
+        if (rc != 0) {
+            free(parts);
+            return -1;
+        }
+        render += t1 - t0;
+        assemble += t2 - t1;
+        runs++;
+    } while (workers_time() - start < BENCH_MIN_SECONDS);
+    free(parts);
+
+    render /= runs;
+    assemble /= runs;
+    fprintf(out, ",\n          \"audio_seconds\": %.3f,\n          ", seconds);
+    json_stage(out, "render", render, score->count);
+    fprintf(out, ",\n          \"real_time_factor\": %.6f,\n          ", seconds > 0 ? render / seconds : 0.0);
+    json_stage(out, "assemble", assemble, score->count);
+    *render_seconds = render;
+    *audio_seconds = seconds;
+    return 0;
+}
+
+/** @brief Первые count слогов партитуры с параметрами набора эффектов. */
+static int build_mix(const Score* source, int count, int effects, Score* score) {
+    EffectParams p;
+    mix_params(effects, &p);
+    tts_score_init(score);
+    if (tts_score_reserve(score, count) != 0) return -1;
+    for (int i = 0; i < count && i < source->count; i++) {
+        if (tts_score_append(score, source->names[i], &p) != 0) return -1;
+    }
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    TtsOptions options;
+    tts_default_options(&options);
+    options.voicebank_dir = "voicebank";
+    options.threads = 1;
+    options.cache_enabled = 0;
+    options.verbose = 0;
+    const char* out_path = "bench.json";
+    const char* label = "";
+    int sizes[BENCH_MAX_SIZES] = { 10, 1000, 100000 };
+    int size_count = 3;
+    int render_limit = 1000;
+
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--voicebank=", 12) == 0) {
+            options.voicebank_dir = argv[i] + 12;
+        } else if (strncmp(argv[i], "--out=", 6) == 0) {
+            out_path = argv[i] + 6;
+        } else if (strncmp(argv[i], "--label=", 8) == 0) {
+            label = argv[i] + 8;
+        } else if (strncmp(argv[i], "--render-limit=", 15) == 0) {
+            render_limit = atoi(argv[i] + 15);
+        } else if (strncmp(argv[i], "--sizes=", 8) == 0) {
+            size_count = 0;
+            for (char* p = argv[i] + 8; *p && size_count < BENCH_MAX_SIZES; ) {
+                int n = (int)strtol(p, &p, 10);
+                if (n > 0) sizes[size_count++] = n;
+                if (*p == ',') p++;
+                else break;
+            }
+        } else {
+            printf("Unknown option: %s\n", argv[i]);
+            return 1;
+        }
+    }
+
+    double started = workers_time();
+    TtsEngine* engine = tts_engine_create(&options);
+    if (!engine) {
+        printf("Cannot read voicebank directory %s\n", options.voicebank_dir);
+        return 1;
+    }
+    double startup = workers_time() - started;
+
+    FILE* out = fopen(out_path, "w");
+    if (!out) {
+        printf("Cannot write %s\n", out_path);
+        tts_engine_destroy(engine);
+        return 1;
+    }
+    fprintf(out, "{\n  \"label\": \"%s\",\n  \"simd\": \"%s\",\n  \"voicebank_units\": %lu,\n"
+        "  \"engine_startup_seconds\": %.6f,\n  \"render_limit\": %d,\n  \"sizes\": [\n",
+        label, dsp_simd_name(dsp_simd_level()), (unsigned long)tts_engine_unit_count(engine),
+        startup, render_limit);
+
+    int rc = 0;
+    for (int s = 0; rc == 0 && s < size_count; s++) {
+        int size = sizes[s];
+        printf("%d syllables:\n", size);
+        fprintf(out, "    {\n      \"syllables\": %d,\n", size);
+
+        size_t len = 0;
+        char* text = generate_text(size, &len);
+        Score syllables;
+        if (!text || bench_frontend(out, tts_engine_inventory(engine), text, len, &syllables) != 0) {
+            printf("Cannot generate %d syllables\n", size);
+            free(text);
+            rc = -1;
+            break;
+        }
+        free(text);
+        if (tts_check_score(engine, &syllables) > 0) {
+            printf("Synthetic text has syllables missing from the voicebank\n");
+            rc = -1;
+        }
+
+        fprintf(out, "      \"mixes\": [\n");
+        for (size_t m = 0; rc == 0 && m < sizeof(mixes) / sizeof(mixes[0]); m++) {
+            Score score;
+            if (build_mix(&syllables, size, mixes[m].effects, &score) != 0) {
+                tts_score_free(&score);
+                rc = -1;
+                break;
+            }
+            fprintf(out, "%s        {\n          \"mix\": \"%s\",\n          ", m > 0 ? ",\n" : "", mixes[m].name);
+            double parse = 0, render = 0, audio = 0;
+            rc = bench_parse(out, &score, &parse);
+            if (rc == 0 && size <= render_limit) {
+                rc = bench_render(out, engine, &score, &render, &audio);
+            }
+            fprintf(out, "\n        }");
+            tts_score_free(&score);
+
+            if (rc != 0) {
+                printf("  %-10s failed\n", mixes[m].name);
+            } else if (size <= render_limit) {
+                printf("  %-10s parse %12.0f syl/s, render %9.0f syl/s, real-time factor %.5f\n",
+                    mixes[m].name, size / parse, size / render, audio > 0 ? render / audio : 0.0);
+            } else {
+                printf("  %-10s parse %12.0f syl/s\n", mixes[m].name, size / parse);
+            }
+        }
+        tts_score_free(&syllables);
+        fprintf(out, "\n      ],\n      \"peak_rss_kb\": %ld\n    }%s\n", peak_rss_kb(), s + 1 < size_count ? "," : "");
+    }
+    fprintf(out, "  ]\n}\n");
+    if (fclose(out) != 0) rc = -1;
+
+    tts_engine_destroy(engine);
+    if (rc == 0) printf("Results written to %s\n", out_path);
+    return rc == 0 ? 0 : 1;
+}
@@ -0,0 +1,20 @@
+#!/bin/sh
+# Build and run the benchmark suite on Linux.
+# Usage: ./bench.sh [output.json] [extra bench options, e.g. --sizes=10,1000 --render-limit=100]
+# Results go to bench-<commit>.json unless an output file is given.
+set -e
+cd "$(dirname "$0")"
+
+LABEL=$(git describe --always --dirty 2>/dev/null || echo unknown)
+OUT=${1:-bench-$LABEL.json}
+[ $# -gt 0 ] && shift
+
+CC=${CC:-gcc}
+mkdir -p _bench_build
+# Only bench.c and the library are needed here; the front programs are built by test.bat
+$CC -O2 -Wall -o _bench_build/bench bench.c \
+    tts.c tts_score.c tts_score_bin.c tts_translit.c tts_syllabify.c tts_frontend.c tts_render.c tts_manifest.c \
+    dsp.c dsp_simd.c voicebank.c pitchmarks.c workers.c render_cache.c mapfile.c trace.c watch.c outfile.c \
+    -lm -lpthread
+
+_bench_build/bench --voicebank=voicebank --out="$OUT" --label="$LABEL" "$@"
@@ -0,0 +1,861 @@
+/**
+ * @file dsp.c
+ * @brief Встроенный движок обработки звука, повторяющий цепочку фильтров FFmpeg.
+ *
+ * Каждый эффект реализован по описанию соответствующего фильтра FFmpeg
+ * с теми же значениями по умолчанию, что подставляет create_ffmpeg_command().
+ * Эффекты после сдвига тона выполняются одним проходом, собранным под набор включённых
+ * этапов (см. chain_run()). Единственное отступление — TD-PSOLA для слогов с метками основного тона.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+
+#include "dsp.h"
+#include "dsp_simd.h"
+#include "trace.h"
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+#define OLA_WINDOW 1024        ///< Размер окна наложения для atempo, отсчётов
+#define OLA_HOP (OLA_WINDOW/2) ///< Шаг синтеза для atempo, отсчётов
+#define PSOLA_UNVOICED_HOP 441 ///< Шаг окон в неозвученных участках, отсчётов (10 мс)
+#define PITCH_FACTOR_MAX 8.0   ///< Наибольший сдвиг тона абсолютной нотой: ±3 октавы
+
+/** @brief Читает 16- и 32-битные целые в порядке little-endian. */
+static uint16_t read_u16(const unsigned char* p) { return (uint16_t)(p[0] | (p[1] << 8)); }
+static uint32_t read_u32(const unsigned char* p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+static void write_u16(unsigned char* p, uint16_t v) { p[0] = v & 0xff; p[1] = v >> 8; }
+static void write_u32(unsigned char* p, uint32_t v) {
+    p[0] = v & 0xff; p[1] = (v >> 8) & 0xff; p[2] = (v >> 16) & 0xff; p[3] = v >> 24;
+}
+
+int wav_read(const char* path, AudioBuffer* out) {
+    memset(out, 0, sizeof(*out));
+
+    FILE* f = fopen(path, "rb");
+    if (!f) {
+        return -1;
+    }
+
+    unsigned char hdr[12];
+    if (fread(hdr, 1, 12, f) != 12 || memcmp(hdr, "RIFF", 4) != 0 || memcmp(hdr + 8, "WAVE", 4) != 0) {
+        fclose(f);
+        return -1;
+    }
+
+    int channels = 0, bits = 0, format = 0;
+    long sample_rate = 0;
+
+    //! Перебираем чанки, пока не встретим "data"; "LIST" и прочие пропускаем
+    unsigned char chunk[8];
+    while (fread(chunk, 1, 8, f) == 8) {
+        uint32_t size = read_u32(chunk + 4);
+
+        if (memcmp(chunk, "fmt ", 4) == 0) {
+            unsigned char fmt[16];
+            if (size < 16 || fread(fmt, 1, 16, f) != 16) break;
+            format = read_u16(fmt);
+            channels = read_u16(fmt + 2);
+            sample_rate = (long)read_u32(fmt + 4);
+            bits = read_u16(fmt + 14);
+            fseek(f, (long)(size - 16 + (size & 1)), SEEK_CUR);
+            continue;
+        }
+
+        if (memcmp(chunk, "data", 4) == 0) {
+            if (format != 1 || bits != 16 || channels <= 0) break;
+
+            size_t frames = size / (2 * (size_t)channels);
+            int16_t* raw = malloc(frames * channels * sizeof(int16_t) + 1);
+            out->samples = malloc(frames * channels * sizeof(float) + 1);
+            if (!raw || !out->samples) {
+                free(raw);
+                break;
+            }
+
+            frames = fread(raw, 2 * (size_t)channels, frames, f);
+            dsp_pcm16_decode((const unsigned char*)raw, out->samples, frames * channels);
+            free(raw);
+
+            out->frames = frames;
+            out->channels = channels;
+            out->sample_rate = (int)sample_rate;
+            fclose(f);
+            return 0;
+        }
+
+        fseek(f, (long)(size + (size & 1)), SEEK_CUR);
+    }
+
+    free(out->samples);
+    memset(out, 0, sizeof(*out));
+    fclose(f);
+    return -1;
+}
+
+void wav_header(unsigned char* hdr, int channels, int sample_rate, uint32_t data_size) {
+    memcpy(hdr, "RIFF", 4);
+    write_u32(hdr + 4, data_size > WAV_UNKNOWN_SIZE - 36 ? WAV_UNKNOWN_SIZE : 36 + data_size);
+    memcpy(hdr + 8, "WAVEfmt ", 8);
+    write_u32(hdr + 16, 16);
+    write_u16(hdr + 20, 1);
+    write_u16(hdr + 22, (uint16_t)channels);
+    write_u32(hdr + 24, (uint32_t)sample_rate);
+    write_u32(hdr + 28, (uint32_t)(sample_rate * channels * 2));
+    write_u16(hdr + 32, (uint16_t)(channels * 2));
+    write_u16(hdr + 34, 16);
+    memcpy(hdr + 36, "data", 4);
+    write_u32(hdr + 40, data_size);
+}
+
+/** @brief Пишет заголовок и отсчёты буфера в открытый файл; 1 при успехе. */
+static int wav_put(FILE* f, const AudioBuffer* in) {
+    unsigned char hdr[WAV_HEADER_SIZE];
+    wav_header(hdr, in->channels, in->sample_rate, (uint32_t)(in->frames * in->channels * 2));
+
+    int ok = fwrite(hdr, 1, sizeof(hdr), f) == sizeof(hdr);
+
+    //! Перевод в int16 с насыщением, блоками, чтобы не выделять второй полный буфер
+    unsigned char block[4096];
+    size_t total = in->frames * in->channels;
+    for (size_t i = 0; ok && i < total; ) {
+        size_t n = total - i < sizeof(block) / 2 ? total - i : sizeof(block) / 2;
+        dsp_pcm16_encode(in->samples + i, block, n);
+        i += n;
+        ok = fwrite(block, 2, n, f) == n;
+    }
+    return ok;
+}
+
+int wav_write(const char* path, const AudioBuffer* in) {
+    FILE* f = fopen(path, "wb");
+    if (!f) {
+        return -1;
+    }
+
+    int ok = wav_put(f, in);
+    if (fclose(f) != 0) ok = 0;
+    return ok ? 0 : -1;
+}
+
+int wav_write_atomic(const char* path, const AudioBuffer* in) {
+    OutputFile out;
+    if (output_open(&out, path, WAV_HEADER_SIZE + (uint64_t)in->frames * in->channels * 2) != 0) {
+        return -1;
+    }
+    if (!wav_put(out.file, in)) {
+        output_abort(&out);
+        return -1;
+    }
+    return output_commit(&out);
+}
+
+static void write_u64(unsigned char* p, uint64_t v) {
+    write_u32(p, (uint32_t)v);
+    write_u32(p + 4, (uint32_t)(v >> 32));
+}
+
+int wav_writer_open(WavWriter* w, const char* path, uint64_t expected_bytes) {
+    memset(w, 0, sizeof(*w));
+    w->sample_rate = DSP_SAMPLE_RATE;
+    if (output_open(&w->out, path, expected_bytes > 0 ? WAV_RF64_HEADER_SIZE + expected_bytes : 0) != 0) {
+        return -1;
+    }
+
+    //! Заголовок пишется при закрытии, пока — место под него
+    unsigned char hdr[WAV_RF64_HEADER_SIZE];
+    memset(hdr, 0, sizeof(hdr));
+    if (fwrite(hdr, 1, sizeof(hdr), w->out.file) != sizeof(hdr)) w->failed = 1;
+    return 0;
+}
+
+int wav_writer_write(WavWriter* w, const AudioBuffer* buf) {
+    if (w->failed) return -1;
+    if (buf->frames == 0) return 0;
+    if (w->channels == 0) {
+        w->channels = buf->channels;
+        w->sample_rate = buf->sample_rate;
+    }
+
+    int ch = w->channels;
+    unsigned char block[4096];
+    size_t per_block = sizeof(block) / 2 / ch;
+    float* frame = ch != buf->channels ? malloc(per_block * ch * sizeof(float)) : NULL;
+    if (ch != buf->channels && !frame) {
+        w->failed = 1;
+        return -1;
+    }
+
+    for (size_t n = 0; !w->failed && n < buf->frames; ) {
+        size_t count = buf->frames - n < per_block ? buf->frames - n : per_block;
+        if (!frame) {
+            dsp_pcm16_encode(buf->samples + n * ch, block, count * ch);
+        } else {
+            for (size_t k = 0; k < count; k++) {
+                for (int c = 0; c < ch; c++) {
+                    frame[k * ch + c] = buf->samples[(n + k) * buf->channels + c % buf->channels];
+                }
+            }
+            dsp_pcm16_encode(frame, block, count * ch);
+        }
+        if (fwrite(block, 2 * ch, count, w->out.file) != count) w->failed = 1;
+        n += count;
+    }
+    free(frame);
+    if (w->failed) return -1;
+    w->frames += buf->frames;
+    return 0;
+}
+
+int wav_writer_close(WavWriter* w) {
+    if (!w->out.file) return -1;
+    int ch = w->channels > 0 ? w->channels : 2;
+    uint64_t data_size = w->frames * ch * 2;
+    uint64_t riff_size = data_size + WAV_RF64_HEADER_SIZE - 8;
+    int rf64 = riff_size > 0xFFFFFFFFu;
+
+    unsigned char hdr[WAV_RF64_HEADER_SIZE];
+    memset(hdr, 0, sizeof(hdr));
+    memcpy(hdr, rf64 ? "RF64" : "RIFF", 4);
+    write_u32(hdr + 4, rf64 ? 0xFFFFFFFFu : (uint32_t)riff_size);
+    memcpy(hdr + 8, "WAVE", 4);
+
+    //! ds64 (или пустой JUNK того же размера): размеры RIFF и данных, число кадров, пустая таблица
+    memcpy(hdr + 12, rf64 ? "ds64" : "JUNK", 4);
+    write_u32(hdr + 16, 28);
+    if (rf64) {
+        write_u64(hdr + 20, riff_size);
+        write_u64(hdr + 28, data_size);
+        write_u64(hdr + 36, w->frames);
+    }
+
+    memcpy(hdr + 48, "fmt ", 4);
+    write_u32(hdr + 52, 16);
+    write_u16(hdr + 56, 1);
+    write_u16(hdr + 58, (uint16_t)ch);
+    write_u32(hdr + 60, (uint32_t)w->sample_rate);
+    write_u32(hdr + 64, (uint32_t)(w->sample_rate * ch * 2));
+    write_u16(hdr + 68, (uint16_t)(ch * 2));
+    write_u16(hdr + 70, 16);
+    memcpy(hdr + 72, "data", 4);
+    write_u32(hdr + 76, rf64 ? 0xFFFFFFFFu : (uint32_t)data_size);
+
+    if (w->failed || fseek(w->out.file, 0, SEEK_SET) != 0 || fwrite(hdr, 1, sizeof(hdr), w->out.file) != sizeof(hdr)) {
+        output_abort(&w->out);
+        return -1;
+    }
+    return output_commit(&w->out);
+}
+
+void wav_writer_abort(WavWriter* w) {
+    output_abort(&w->out);
+}
+
+void audio_free(AudioBuffer* buf) {
+    free(buf->samples);
+    memset(buf, 0, sizeof(*buf));
+}
+
+int audio_concat(const AudioBuffer* parts, int count, AudioBuffer* out) {
+    memset(out, 0, sizeof(*out));
+    out->channels = 2;
+    out->sample_rate = DSP_SAMPLE_RATE;
+
+    size_t total = 0;
+    int format_set = 0;
+    for (int i = 0; i < count; i++) {
+        if (parts[i].frames == 0) continue;
+        if (!format_set) {
+            out->channels = parts[i].channels;
+            out->sample_rate = parts[i].sample_rate;
+            format_set = 1;
+        }
+        total += parts[i].frames;
+    }
+
+    out->samples = malloc(total * out->channels * sizeof(float) + 1);
+    if (!out->samples) return -1;
+
+    int ch = out->channels;
+    for (int i = 0; i < count; i++) {
+        const AudioBuffer* p = &parts[i];
+        float* dst = out->samples + out->frames * ch;
+        if (p->channels == ch) {
+            memcpy(dst, p->samples, p->frames * ch * sizeof(float));
+        } else {
+            for (size_t n = 0; n < p->frames; n++) {
+                for (int c = 0; c < ch; c++) {
+                    dst[n * ch + c] = p->samples[n * p->channels + c % p->channels];
+                }
+            }
+        }
+        out->frames += p->frames;
+    }
+    return 0;
+}
+
+/**
+ * @brief Линейная интерполяция отсчёта канала в дробной позиции.
+ *  За пределами буфера возвращает тишину, как пустая линия задержки FFmpeg.
+ */
+static float sample_at(const float* s, size_t frames, int channels, int c, double pos) {
+    if (pos < 0) return 0.0f;
+    size_t i = (size_t)pos;
+    if (i >= frames) return 0.0f;
+    float frac = (float)(pos - (double)i);
+    float a = s[i * channels + c];
+    float b = (i + 1 < frames) ? s[(i + 1) * channels + c] : 0.0f;
+    return a + (b - a) * frac;
+}
+
+/** @brief Копия отсчётов буфера — источник для эффектов с линией задержки. */
+static float* copy_samples(const AudioBuffer* buf) {
+    size_t n = buf->frames * buf->channels;
+    float* copy = malloc(n * sizeof(float) + 1);
+    if (copy) memcpy(copy, buf->samples, n * sizeof(float));
+    return copy;
+}
+
+/**
+ * @brief asetrate=44100*factor,atempo=1/factor: смена тона без смены длительности.
+ *  Сначала звук передискретизируется с шагом factor (выше тон, короче звук),
+ *  затем растягивается обратно до исходной длины наложением окон Ханна.
+ */
+static int dsp_pitch_shift(AudioBuffer* buf, double factor) {
+    int ch = buf->channels;
+    size_t rs_frames = (size_t)(buf->frames / factor);
+
+    float* rs = malloc(rs_frames * ch * sizeof(float) + 1);
+    float* out = calloc(buf->frames * ch + 1, sizeof(float));
+    float* norm = calloc(buf->frames + 1, sizeof(float));
+    if (!rs || !out || !norm) {
+        free(rs); free(out); free(norm);
+        return -1;
+    }
+
+    //! asetrate: читаем исходник быстрее в factor раз
+    for (size_t i = 0; i < rs_frames; i++) {
+        for (int c = 0; c < ch; c++) {
+            rs[i * ch + c] = sample_at(buf->samples, buf->frames, ch, c, i * factor);
+        }
+    }
+
+    //! atempo: окна берутся с шагом OLA_HOP/factor, кладутся с шагом OLA_HOP
+    float window[OLA_WINDOW];
+    for (int j = 0; j < OLA_WINDOW; j++) {
+        window[j] = (float)(0.5 - 0.5 * cos(2.0 * M_PI * j / OLA_WINDOW));
+    }
+    for (size_t k = 0; k * OLA_HOP < buf->frames; k++) {
+        size_t out_pos = k * OLA_HOP;
+        size_t in_pos = (size_t)(k * OLA_HOP / factor);
+        for (int j = 0; j < OLA_WINDOW && out_pos + j < buf->frames; j++) {
+            size_t src = in_pos + j;
+            for (int c = 0; c < ch; c++) {
+                float s = src < rs_frames ? rs[src * ch + c] : 0.0f;
+                out[(out_pos + j) * ch + c] += window[j] * s;
+            }
+            norm[out_pos + j] += window[j];
+        }
+    }
+    for (size_t i = 0; i < buf->frames; i++) {
+        if (norm[i] > 1e-3f) {
+            for (int c = 0; c < ch; c++) out[i * ch + c] /= norm[i];
+        }
+    }
+
+    free(rs);
+    free(norm);
+    free(buf->samples);
+    buf->samples = out;
+    return 0;
+}
+
+/**
+ * @brief TD-PSOLA: смена тона без смены длительности и формант.
+ *  Вокруг каждой метки анализа вырезается окно Ханна в два периода; окна кладутся
+ *  в метки синтеза, идущие с шагом period / factor, — каждая берёт ближайшую метку
+ *  анализа, так что периоды повторяются или пропускаются и длина сохраняется.
+ *  Неозвученные участки переносятся окнами с исходным шагом, без сдвига.
+ */
+static int dsp_psola_shift(AudioBuffer* buf, const PitchMarks* marks, double factor) {
+    int ch = buf->channels;
+    size_t frames = buf->frames;
+    float* out = calloc(frames * ch + 1, sizeof(float));
+    float* norm = calloc(frames + 1, sizeof(float));
+    if (!out || !norm) {
+        free(out); free(norm);
+        return -1;
+    }
+
+    size_t k = 0;
+    double t = marks->marks[0].pos;
+    while (t < (double)frames) {
+        //! Ближайшая к метке синтеза метка анализа
+        while (k + 1 < marks->count && marks->marks[k + 1].pos <= t) k++;
+        size_t m = k;
+        if (k + 1 < marks->count && marks->marks[k + 1].pos - t < t - marks->marks[k].pos) m = k + 1;
+
+        const PitchMark* a = &marks->marks[m];
+        long half = a->period > 0 ? (long)a->period : PSOLA_UNVOICED_HOP;
+        long dst = (long)t;
+        for (long j = -half + 1; j < half; j++) {
+            long s = (long)a->pos + j, d = dst + j;
+            if (s < 0 || d < 0 || (size_t)s >= frames || (size_t)d >= frames) continue;
+            float w = (float)(0.5 + 0.5 * cos(M_PI * j / half));
+            for (int c = 0; c < ch; c++) {
+                out[d * ch + c] += w * buf->samples[s * ch + c];
+            }
+            norm[d] += w;
+        }
+        t += a->period > 0 ? a->period / factor : PSOLA_UNVOICED_HOP;
+    }
+
+    //! Наложение окон даёт сумму около factor; провалы при понижении тона не усиливаем
+    for (size_t i = 0; i < frames; i++) {
+        if (norm[i] > 1.0f) {
+            for (int c = 0; c < ch; c++) out[i * ch + c] /= norm[i];
+        }
+    }
+
+    free(norm);
+    free(buf->samples);
+    buf->samples = out;
+    return 0;
+}
+
+double dsp_pitch_factor(int semitones, const PitchMarks* marks) {
+    if (semitones < DSP_PITCH_NOTE) return pow(2.0, semitones / 12.0);
+    if (!marks || marks->f0 <= 0) return 1.0;
+
+    //! Частота ноты по MIDI-номеру, ля первой октавы (69) — 440 Гц
+    double target = 440.0 * pow(2.0, (semitones - DSP_PITCH_NOTE - 69) / 12.0);
+    double factor = target / marks->f0;
+    if (factor > PITCH_FACTOR_MAX) factor = PITCH_FACTOR_MAX;
+    if (factor < 1.0 / PITCH_FACTOR_MAX) factor = 1.0 / PITCH_FACTOR_MAX;
+    return factor;
+}
+
+/* ---------- Слитная цепочка эффектов ----------
+ *
+ * Все эффекты после сдвига тона поканальны и причинны: отсчёт n зависит только от
+ * отсчётов не позже n. Поэтому цепочка выполняется за один проход по кадрам блоками,
+ * которые проходят все включённые этапы, не покидая кэша; эффекты с задержкой хранят
+ * историю своего входа в кольцевом буфере, эквалайзер — своё состояние между блоками.
+ * afade и equalizer считаются векторными ядрами dsp_simd.h, остальные этапы в блоке
+ * идут поотсчётно. Тело прохода — встраиваемая функция с маской этапов
+ * в качестве константы; для каждой из DSP_STAGE_FUSED + 1 масок собирается отдельный
+ * экземпляр, из которого компилятор выбрасывает выключенные этапы и их проверки.
+ * Арифметика каждого этапа та же, что у одиночного фильтра, поэтому результат совпадает
+ * с поэтапной обработкой отсчёт в отсчёт. */
+
+#if defined(__GNUC__) || defined(__clang__)
+#define CHAIN_INLINE static inline __attribute__((always_inline))
+#else
+#define CHAIN_INLINE static inline
+#endif
+
+#define CHAIN_BLOCK 256 ///< Кадров в блоке прохода: модуляция блока считается один раз на все каналы
+
+/** @brief Линия задержки: последние кадры входа этапа в кольцевом буфере. */
+typedef struct {
+    float* buf;   ///< Кадры по индексу (n & mask), чередующиеся каналы
+    size_t mask;  ///< Размер кольца в кадрах минус один (размер — степень двойки)
+} DelayLine;
+
+/** @brief Параметры и состояние этапов одного прохода. */
+typedef struct {
+    const float* src;   ///< Вход цепочки (после сдвига тона)
+    float* dst;         ///< Выход цепочки
+    size_t frames;      ///< Обрабатываемых кадров (с учётом ограничения длительности)
+    int channels;
+    int sample_rate;
+
+    int vib_freq;             ///< vibrato: частота, Гц
+    float vib_depth;          ///< vibrato: глубина
+    double vib_max_delay;     ///< vibrato: наибольшая задержка, кадров
+    DelayLine vibrato;
+
+    float fade_in_start, fade_in_duration;   ///< afade=t=in
+    float fade_out_start, fade_out_duration; ///< afade=t=out
+    size_t fade_in_from, fade_in_to;         ///< afade=t=in: кадры, где коэффициент не 0 и не 1
+    size_t fade_out_from, fade_out_to;       ///< afade=t=out: то же
+
+    float echo_in_gain, echo_out_gain, echo_decay; ///< aecho
+    size_t echo_delay;                             ///< aecho: задержка, кадров
+    DelayLine echo;
+
+    float chorus_in_gain;     ///< chorus: входное усиление
+    DelayLine chorus;
+
+    double eq[5];             ///< equalizer: b0, b1, b2, a1, a2
+    double* eq_state;         ///< equalizer: x1, x2, y1, y2 каждого канала между блоками
+
+    double flanger_delay;     ///< flanger: базовая задержка, кадров
+    DelayLine flanger;
+} ChainState;
+
+/** @brief Выделяет кольцо на max_delay кадров задержки (не длиннее самого звука). */
+static int delay_line_init(DelayLine* d, double max_delay, size_t frames, int channels) {
+    double need = ceil(max_delay) + 2;
+    if (need > (double)frames + 2) need = (double)frames + 2;
+    size_t size = 1;
+    while ((double)size < need) size <<= 1;
+    d->mask = size - 1;
+    d->buf = malloc(size * channels * sizeof(float));
+    return d->buf ? 0 : -1;
+}
+
+/** @brief Кладёт вход этапа для кадра n в линию задержки. */
+CHAIN_INLINE void delay_put(DelayLine* d, int channels, int c, size_t n, float x) {
+    d->buf[(n & d->mask) * channels + c] = x;
+}
+
+/**
+ * @brief sample_at() по линии задержки: вход этапа в дробной позиции pos <= n.
+ *  Кадра n + 1 ещё нет, но он нужен только при pos == n, где его вес равен нулю.
+ */
+CHAIN_INLINE float delay_at(const DelayLine* d, int channels, int c, size_t n, double pos) {
+    if (pos < 0) return 0.0f;
+    size_t i = (size_t)pos;
+    float frac = (float)(pos - (double)i);
+    float a = d->buf[(i & d->mask) * channels + c];
+    float b = i + 1 <= n ? d->buf[((i + 1) & d->mask) * channels + c] : 0.0f;
+    return a + (b - a) * frac;
+}
+
+/** @brief Коэффициент afade для кадра n, как в dsp_gain_ramp(). */
+CHAIN_INLINE float fade_gain(size_t n, int sample_rate, int fade_in, float start, float duration) {
+    double t = (double)n / sample_rate;
+    double g = (t - start) / duration;
+    if (g < 0) g = 0;
+    if (g > 1) g = 1;
+    if (!fade_in) g = 1.0 - g;
+    return (float)g;
+}
+
+/**
+ * @brief Границы участка [from; to), где коэффициент afade меняется.
+ *  Коэффициент монотонен по n, поэтому до from он равен значению в кадре 0,
+ *  а начиная с to — значению в последнем кадре; границы ищутся двоичным поиском по той же формуле.
+ */
+static void fade_range(size_t frames, int sample_rate, int fade_in, float start, float duration,
+    size_t* from, size_t* to) {
+    float first = fade_in ? 0.0f : 1.0f, last = fade_in ? 1.0f : 0.0f;
+    size_t lo = 0, hi = frames;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (fade_gain(mid, sample_rate, fade_in, start, duration) != first) hi = mid; else lo = mid + 1;
+    }
+    *from = lo;
+    hi = frames;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (fade_gain(mid, sample_rate, fade_in, start, duration) == last) hi = mid; else lo = mid + 1;
+    }
+    *to = lo;
+}
+
+/** @brief Модуляция блока кадров, общая для всех каналов. */
+typedef struct {
+    double vib_delay[CHAIN_BLOCK];
+    double chorus_mod[CHAIN_BLOCK];
+} ChainBlock;
+
+/**
+ * @brief Проводит отсчёт x канала c кадра n (j-го в блоке) через поотсчётные этапы маски mask.
+ *  vibrato=f:d — чтение из линии задержки 5 мс, модулированной синусом.
+ *  aecho=in_gain:out_gain:delay_ms:decay — одно отражение без обратной связи.
+ *  chorus=in_gain:0.7:60:0.4:0.25:2 — один голос с задержкой 60 мс,
+ *  промодулированной синусом 0.25 Гц на глубину 2 мс.
+ *  flanger=delay=ms — глубина 2 мс, ширина 71%, скорость 0.5 Гц, синусоида,
+ *  сдвиг фазы 25% между каналами, без обратной связи.
+ *  afade и equalizer сюда не входят: они применяются к блоку целиком векторными ядрами (dsp_simd.h).
+ */
+CHAIN_INLINE float chain_sample(ChainState* s, const unsigned mask, const ChainBlock* m,
+    int c, size_t n, size_t j, float x) {
+    const int ch = s->channels, rate = s->sample_rate;
+    const float chorus_out_gain = 0.7f, chorus_decay = 0.4f;
+    const double chorus_delay = 0.060 * rate;
+    const double flanger_width = 0.71, flanger_speed = 0.5, flanger_channel_phase = 0.25;
+    const double flanger_depth = 0.002 * rate;
+    const float flanger_in_gain = (float)(1.0 / (1.0 + flanger_width));
+    const float flanger_delay_gain = (float)(flanger_width / (1.0 + flanger_width));
+
+    if (mask & DSP_STAGE_VIBRATO) {
+        delay_put(&s->vibrato, ch, c, n, x);
+        x = delay_at(&s->vibrato, ch, c, n, (double)n - m->vib_delay[j]);
+    }
+    if (mask & DSP_STAGE_ECHO) {
+        delay_put(&s->echo, ch, c, n, x);
+        float echo = n >= s->echo_delay ? s->echo.buf[((n - s->echo_delay) & s->echo.mask) * ch + c] : 0.0f;
+        x = (x * s->echo_in_gain + echo * s->echo_decay) * s->echo_out_gain;
+    }
+    if (mask & DSP_STAGE_CHORUS) {
+        delay_put(&s->chorus, ch, c, n, x);
+        float wet = delay_at(&s->chorus, ch, c, n, (double)n - chorus_delay - m->chorus_mod[j]);
+        x = (x * s->chorus_in_gain + wet * chorus_decay) * chorus_out_gain;
+    }
+    if (mask & DSP_STAGE_FLANGER) {
+        delay_put(&s->flanger, ch, c, n, x);
+        double phase = 2.0 * M_PI * (flanger_speed * n / rate + c * flanger_channel_phase);
+        double delay = s->flanger_delay + flanger_depth * (1.0 - cos(phase)) / 2.0;
+        float wet = delay_at(&s->flanger, ch, c, n, (double)n - delay);
+        x = x * flanger_in_gain + wet * flanger_delay_gain;
+    }
+    return x;
+}
+
+/**
+ * @brief Проводит блок кадров [from; from + count) через поотсчётные этапы stages, из in в out
+ *  (out может совпадать с in). Каналы независимы, поэтому идут парами в одном цикле.
+ */
+CHAIN_INLINE void chain_pass(ChainState* s, const unsigned stages, const ChainBlock* m,
+    size_t from, size_t count, const float* in, float* out) {
+    const int ch = s->channels;
+    int c = 0;
+    for (; c + 1 < ch; c += 2) {
+        for (size_t j = 0; j < count; j++) {
+            size_t n = from + j;
+            float a = chain_sample(s, stages, m, c, n, j, in[j * ch + c]);
+            float b = chain_sample(s, stages, m, c + 1, n, j, in[j * ch + c + 1]);
+            out[j * ch + c] = a;
+            out[j * ch + c + 1] = b;
+        }
+    }
+    for (; c < ch; c++) {
+        for (size_t j = 0; j < count; j++) {
+            out[j * ch + c] = chain_sample(s, stages, m, c, from + j, j, in[j * ch + c]);
+        }
+    }
+}
+
+/**
+ * @brief Один проход цепочки с маской этапов mask (константа в каждом экземпляре).
+ *  Кадры идут блоками по CHAIN_BLOCK, блок остаётся в кэше L1 на всех этапах: сначала
+ *  модуляция блока, затем этапы по порядку — vibrato, afade (dsp_gain_ramp()), aecho и chorus,
+ *  equalizer (dsp_biquad() с состоянием между блоками), flanger.
+ */
+CHAIN_INLINE void chain_run(ChainState* s, const unsigned mask) {
+    const int ch = s->channels, rate = s->sample_rate;
+    const double chorus_depth = 0.002 * rate, chorus_speed = 0.25;
+    const unsigned middle = mask & (DSP_STAGE_ECHO | DSP_STAGE_CHORUS);
+
+    if (mask == 0) {
+        if (s->dst != s->src) memcpy(s->dst, s->src, s->frames * ch * sizeof(float));
+        return;
+    }
+
+    ChainBlock m;
+    for (size_t from = 0; from < s->frames; from += CHAIN_BLOCK) {
+        size_t count = s->frames - from < CHAIN_BLOCK ? s->frames - from : CHAIN_BLOCK;
+        const float* in = s->src + from * ch;
+        float* out = s->dst + from * ch;
+        for (size_t j = 0; j < count; j++) {
+            size_t n = from + j;
+            if (mask & DSP_STAGE_VIBRATO) {
+                double phase = 2.0 * M_PI * s->vib_freq * n / rate;
+                m.vib_delay[j] = s->vib_depth * s->vib_max_delay * (1.0 - cos(phase)) / 2.0;
+            }
+            if (mask & DSP_STAGE_CHORUS) {
+                m.chorus_mod[j] = chorus_depth * (1.0 + sin(2.0 * M_PI * chorus_speed * n / rate)) / 2.0;
+            }
+        }
+
+        if (mask & DSP_STAGE_VIBRATO) {
+            chain_pass(s, DSP_STAGE_VIBRATO, &m, from, count, in, out);
+        } else if (out != in) {
+            memcpy(out, in, count * ch * sizeof(float));
+        }
+        //! Вне участков [from; to) коэффициент равен 1 (блок не меняется) или 0 (формула даёт тот же 0)
+        if ((mask & DSP_STAGE_FADE) && from < s->fade_in_to) {
+            dsp_gain_ramp(out, from, count, ch, rate, 1, s->fade_in_start, s->fade_in_duration);
+        }
+        if ((mask & DSP_STAGE_FADE) && from + count > s->fade_out_from) {
+            dsp_gain_ramp(out, from, count, ch, rate, 0, s->fade_out_start, s->fade_out_duration);
+        }
+        if (middle) chain_pass(s, middle, &m, from, count, out, out);
+        if (mask & DSP_STAGE_EQUALIZER) dsp_biquad(out, count, ch, s->eq, s->eq_state);
+        if (mask & DSP_STAGE_FLANGER) chain_pass(s, DSP_STAGE_FLANGER, &m, from, count, out, out);
+    }
+}
+
+/** @brief Экземпляр прохода для одной маски этапов. */
+typedef void (*ChainKernel)(ChainState* s);
+
+//! Экземпляры chain_<биты маски>: CHAIN_Bk порождает 2^k экземпляров, младший бит — последний
+#define CHAIN_KERNEL(bits, mask) static void chain_##bits(ChainState* s) { chain_run(s, (mask)); }
+#define CHAIN_B1(bits, mask) CHAIN_KERNEL(bits##0, (mask) * 2) CHAIN_KERNEL(bits##1, (mask) * 2 + 1)
+#define CHAIN_B2(bits, mask) CHAIN_B1(bits##0, (mask) * 2) CHAIN_B1(bits##1, (mask) * 2 + 1)
+#define CHAIN_B3(bits, mask) CHAIN_B2(bits##0, (mask) * 2) CHAIN_B2(bits##1, (mask) * 2 + 1)
+#define CHAIN_B4(bits, mask) CHAIN_B3(bits##0, (mask) * 2) CHAIN_B3(bits##1, (mask) * 2 + 1)
+#define CHAIN_B5(bits, mask) CHAIN_B4(bits##0, (mask) * 2) CHAIN_B4(bits##1, (mask) * 2 + 1)
+#define CHAIN_B6(bits, mask) CHAIN_B5(bits##0, (mask) * 2) CHAIN_B5(bits##1, (mask) * 2 + 1)
+CHAIN_B6(, 0)
+
+//! Таблица экземпляров в порядке масок
+#define CHAIN_T1(bits) chain_##bits##0, chain_##bits##1
+#define CHAIN_T2(bits) CHAIN_T1(bits##0), CHAIN_T1(bits##1)
+#define CHAIN_T3(bits) CHAIN_T2(bits##0), CHAIN_T2(bits##1)
+#define CHAIN_T4(bits) CHAIN_T3(bits##0), CHAIN_T3(bits##1)
+#define CHAIN_T5(bits) CHAIN_T4(bits##0), CHAIN_T4(bits##1)
+#define CHAIN_T6(bits) CHAIN_T5(bits##0), CHAIN_T5(bits##1)
+static const ChainKernel chain_kernels[DSP_STAGE_FUSED + 1] = { CHAIN_T6() };
+
+/** @brief Названия слитых этапов в порядке битов маски (события трассировки). */
+static const char* stage_names[] = {
+    "vibrato", "fade", "echo", "chorus", "equalizer", "flanger"
+};
+
+unsigned dsp_chain_mask(const EffectParams* p, const PitchMarks* marks) {
+    unsigned mask = 0;
+    if (p->semitones != 0 && dsp_pitch_factor(p->semitones, marks) != 1.0) mask |= DSP_STAGE_PITCH;
+    if (p->freq_vibro > 0 && p->depth_vibro > 0) mask |= DSP_STAGE_VIBRATO;
+    if ((p->start_fade_in >= 0 && p->duration_fade_in > 0) ||
+        (p->start_fade_out >= 0 && p->duration_fade_out > 0)) {
+        mask |= DSP_STAGE_FADE;
+    }
+    if (p->Echo1 > 0 && p->Echo2 > 0 && p->Echo3 > 0 && p->Echo4 > 0) mask |= DSP_STAGE_ECHO;
+    if (p->chorus > 0) mask |= DSP_STAGE_CHORUS;
+    if (p->Equalizerf != 0 && p->Equalizert != 0 && p->Equalizerw != 0 && p->Equalizerg != 0) {
+        mask |= DSP_STAGE_EQUALIZER;
+    }
+    if (p->Flanger > 0) mask |= DSP_STAGE_FLANGER;
+    return mask;
+}
+
+/** @brief Заполняет параметры этапов и выделяет их линии задержки. */
+static int chain_setup(ChainState* s, const EffectParams* p, unsigned mask, size_t frames) {
+    const int ch = s->channels, rate = s->sample_rate;
+    int rc = 0;
+
+    if (mask & DSP_STAGE_VIBRATO) {
+        s->vib_freq = p->freq_vibro;
+        s->vib_depth = p->depth_vibro;
+        s->vib_max_delay = lrint(rate * 0.005) - 1;
+        rc |= delay_line_init(&s->vibrato, s->vib_depth * s->vib_max_delay, frames, ch);
+    }
+    s->fade_in_start = p->start_fade_in;
+    s->fade_in_duration = p->duration_fade_in;
+    s->fade_out_start = p->start_fade_out;
+    s->fade_out_duration = p->duration_fade_out;
+    //! Выключенное направление: коэффициент 1 на всех кадрах, умножение на него ничего не меняет
+    if (p->start_fade_in >= 0 && p->duration_fade_in > 0) {
+        fade_range(frames, rate, 1, s->fade_in_start, s->fade_in_duration, &s->fade_in_from, &s->fade_in_to);
+    }
+    if (p->start_fade_out >= 0 && p->duration_fade_out > 0) {
+        fade_range(frames, rate, 0, s->fade_out_start, s->fade_out_duration, &s->fade_out_from, &s->fade_out_to);
+    } else {
+        s->fade_out_from = s->fade_out_to = frames;
+    }
+    if (mask & DSP_STAGE_ECHO) {
+        s->echo_in_gain = p->Echo1;
+        s->echo_out_gain = p->Echo2;
+        s->echo_delay = (size_t)(p->Echo3 * rate / 1000.0f);
+        s->echo_decay = p->Echo4;
+        rc |= delay_line_init(&s->echo, (double)s->echo_delay, frames, ch);
+    }
+    if (mask & DSP_STAGE_CHORUS) {
+        s->chorus_in_gain = p->chorus;
+        rc |= delay_line_init(&s->chorus, 0.062 * rate, frames, ch);
+    }
+    if (mask & DSP_STAGE_EQUALIZER) {
+        //! Коэффициенты по RBJ Audio EQ Cookbook, ширина полосы задана добротностью Q
+        double A = pow(10.0, p->Equalizerg / 40.0);
+        double w0 = 2.0 * M_PI * p->Equalizerf / rate;
+        double alpha = sin(w0) / (2.0 * p->Equalizerw);
+        double a0 = 1.0 + alpha / A;
+        s->eq[0] = (1.0 + alpha * A) / a0;  //!< b0
+        s->eq[1] = (-2.0 * cos(w0)) / a0;   //!< b1
+        s->eq[2] = (1.0 - alpha * A) / a0;  //!< b2
+        s->eq[3] = (-2.0 * cos(w0)) / a0;   //!< a1
+        s->eq[4] = (1.0 - alpha / A) / a0;  //!< a2
+        s->eq_state = calloc(4 * (size_t)ch, sizeof(double));
+        if (!s->eq_state) rc = -1;
+    }
+    if (mask & DSP_STAGE_FLANGER) {
+        s->flanger_delay = p->Flanger / 1000.0 * rate;
+        rc |= delay_line_init(&s->flanger, s->flanger_delay + 0.002 * rate, frames, ch);
+    }
+    return rc;
+}
+
+static void chain_free(ChainState* s) {
+    free(s->vibrato.buf);
+    free(s->echo.buf);
+    free(s->chorus.buf);
+    free(s->eq_state);
+    free(s->flanger.buf);
+}
+
+int dsp_apply_chain(const AudioBuffer* in, const EffectParams* p, const PitchMarks* marks, AudioBuffer* out) {
+    unsigned mask = dsp_chain_mask(p, marks);
+    AudioBuffer shifted = *in;
+    double t;
+
+    //! Сдвиг тона (PSOLA по меткам или asetrate + atempo) меняет положение отсчётов, поэтому идёт отдельным проходом
+    if (mask & DSP_STAGE_PITCH) {
+        double factor = dsp_pitch_factor(p->semitones, marks);
+        shifted.samples = copy_samples(in);
+        if (!shifted.samples) return -1;
+        t = TRACE_BEGIN();
+        int rc;
+        if (marks && marks->count > 0 && marks->f0 > 0) {
+            rc = dsp_psola_shift(&shifted, marks, factor);
+            TRACE_END(t, "effect", "psola", NULL, (long long)(shifted.frames * shifted.channels), 0);
+        } else {
+            rc = dsp_pitch_shift(&shifted, factor);
+            TRACE_END(t, "effect", "pitch", NULL, (long long)(shifted.frames * shifted.channels), 0);
+        }
+        if (rc != 0) {
+            audio_free(&shifted);
+            return -1;
+        }
+    }
+
+    //! Аналог "-t duration": эффекты причинны, поэтому кадры за пределом длительности не считаются вовсе
+    *out = shifted;
+    double limit = p->duration > 0 ? (double)p->duration * in->sample_rate : 0.0;
+    if ((double)out->frames > limit) {
+        out->frames = (size_t)limit;
+    }
+    out->samples = malloc(out->frames * out->channels * sizeof(float) + 1);
+
+    ChainState s;
+    memset(&s, 0, sizeof(s));
+    s.src = shifted.samples;
+    s.dst = out->samples;
+    s.frames = out->frames;
+    s.channels = out->channels;
+    s.sample_rate = out->sample_rate;
+    int rc = out->samples ? chain_setup(&s, p, mask, out->frames) : -1;
+
+    if (rc == 0 && trace_enabled && (mask & DSP_STAGE_FUSED)) {
+        //! При трассировке этапы идут отдельными проходами, чтобы у каждого было своё время;
+        //! состояние этапов не зависит от разбиения на проходы, поэтому звук тот же
+        for (int k = 0; k < (int)(sizeof(stage_names) / sizeof(stage_names[0])); k++) {
+            if (!(mask & (1u << k))) continue;
+            t = TRACE_BEGIN();
+            chain_kernels[1u << k](&s);
+            TRACE_END(t, "effect", stage_names[k], NULL, (long long)(out->frames * out->channels), 0);
+            s.src = s.dst;
+        }
+    } else if (rc == 0) {
+        chain_kernels[mask & DSP_STAGE_FUSED](&s);
+    }
+
+    chain_free(&s);
+    if (shifted.samples != in->samples) audio_free(&shifted);
+    if (rc != 0) {
+        audio_free(out);
+        return -1;
+    }
+    return 0;
+}
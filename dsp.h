@@ -0,0 +1,200 @@
+/**
+ * @file dsp.h
+ * @brief Встроенный движок обработки звука, повторяющий цепочку фильтров FFmpeg.
+ *
+ * Движок загружает 16-битные WAV 44.1 кГц из голосового банка в память и применяет
+ * к ним ту же последовательность эффектов, что и create_ffmpeg_command():
+ * asetrate/atempo (сдвиг тона), vibrato, afade, aecho, chorus, equalizer и flanger.
+ * Для слогов с метками основного тона (см. pitchmarks.h) тон сдвигается TD-PSOLA.
+ */
+
+#ifndef DSP_H
+#define DSP_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "outfile.h"
+
+#define DSP_SAMPLE_RATE 44100 ///< Частота дискретизации голосового банка и результата
+#define WAV_HEADER_SIZE 44    ///< Размер заголовка 16-битного PCM WAV
+#define WAV_UNKNOWN_SIZE 0xFFFFFFFFu ///< Размер данных в заголовке потока заранее неизвестной длины
+
+/** @brief Аудиобуфер с чередующимися (interleaved) отсчётами в формате float [-1; 1]. */
+typedef struct {
+    float* samples;   ///< Отсчёты, frames * channels значений
+    size_t frames;    ///< Количество кадров (отсчётов на канал)
+    int channels;     ///< Количество каналов
+    int sample_rate;  ///< Частота дискретизации, Гц
+} AudioBuffer;
+
+#define DSP_PITCH_NOTE 1000 ///< Тон не меньше этого значения — абсолютная нота с MIDI-номером (тон - DSP_PITCH_NOTE)
+
+/** @brief Метка основного тона: пик периода в озвученной части или опорная точка в неозвученной. */
+typedef struct {
+    uint32_t pos;     ///< Положение метки, кадр
+    uint32_t period;  ///< Длина периода в кадрах; 0 — неозвученный участок
+} PitchMark;
+
+/** @brief Метки основного тона единицы голосового банка. */
+typedef struct {
+    PitchMark* marks; ///< Метки по возрастанию положения
+    size_t count;     ///< Количество меток, 0 — анализ не выполнялся
+    float f0;         ///< Медианная частота основного тона озвученных участков, Гц (0 — не найдена)
+    uint64_t hash;    ///< Хеш меток: входит в ключ кэша обработанных слогов
+} PitchMarks;
+
+/** @brief Параметры обработки одного слога — те же 18 значений, что и в output.txt. */
+typedef struct {
+    int semitones;            ///< Сдвиг тона в полутонах или абсолютная нота (DSP_PITCH_NOTE + MIDI-номер)
+    float duration;           ///< Ограничение длительности результата (-t), сек
+    int freq_vibro;           ///< Частота вибрато, Гц
+    float depth_vibro;        ///< Глубина вибрато
+    float start_fade_in;      ///< Начало нарастания громкости, сек
+    float duration_fade_in;   ///< Длительность нарастания, сек
+    float start_fade_out;     ///< Начало затухания громкости, сек
+    float duration_fade_out;  ///< Длительность затухания, сек
+
+    float Echo1;              ///< aecho: входное усиление
+    float Echo2;              ///< aecho: выходное усиление
+    float Echo3;              ///< aecho: задержка, мс
+    float Echo4;              ///< aecho: затухание отражения
+    float chorus;             ///< chorus: входное усиление
+    float Equalizerf;         ///< Центральная частота эквалайзера, Гц
+    float Equalizert;         ///< Тип эквалайзера (0 — выключен)
+    float Equalizerw;         ///< Ширина полосы эквалайзера (добротность Q)
+    float Equalizerg;         ///< Усиление эквалайзера, дБ
+
+    float Flanger;            ///< Базовая задержка фленджера, мс
+} EffectParams;
+
+/** @brief Этапы цепочки эффектов — биты маски dsp_chain_mask(). */
+enum {
+    DSP_STAGE_VIBRATO = 1,
+    DSP_STAGE_FADE = 2,     ///< Нарастание и (или) затухание громкости
+    DSP_STAGE_ECHO = 4,
+    DSP_STAGE_CHORUS = 8,
+    DSP_STAGE_EQUALIZER = 16,
+    DSP_STAGE_FLANGER = 32,
+    DSP_STAGE_FUSED = 63,   ///< Этапы, выполняемые одним слитым проходом
+    DSP_STAGE_PITCH = 64    ///< Сдвиг тона: отдельный проход перед остальными
+};
+
+/**
+ * @brief Читает 16-битный PCM WAV в буфер float.
+ * @param[in] path Путь к файлу.
+ * @param[out] out Заполняемый буфер (освобождается audio_free()).
+ * @return 0 при успехе, -1 при ошибке чтения или неподдерживаемом формате.
+ */
+int wav_read(const char* path, AudioBuffer* out);
+
+/**
+ * @brief Записывает буфер в 16-битный PCM WAV с насыщением отсчётов.
+ * @param[in] path Путь к файлу.
+ * @param[in] in Записываемый буфер.
+ * @return 0 при успехе, -1 при ошибке записи.
+ */
+int wav_write(const char* path, const AudioBuffer* in);
+
+/**
+ * @brief Как wav_write(), но для файла результата: запись одним проходом во временный
+ *  файл с заранее выделенным местом и атомарная замена path (outfile.h).
+ * @return 0 при успехе, -1 при ошибке записи (прежний файл path не тронут).
+ */
+int wav_write_atomic(const char* path, const AudioBuffer* in);
+
+/**
+ * @brief Формирует заголовок 16-битного PCM WAV.
+ * @param[out] hdr Буфер на WAV_HEADER_SIZE байт.
+ * @param[in] data_size Размер данных в байтах или WAV_UNKNOWN_SIZE для потокового вывода.
+ */
+void wav_header(unsigned char* hdr, int channels, int sample_rate, uint32_t data_size);
+
+#define WAV_RF64_HEADER_SIZE 80 ///< Заголовок WavWriter: RIFF/RF64, место под ds64, fmt и data
+
+/** @brief Запись WAV по частям: длина заранее неизвестна, заголовок дописывается при закрытии. */
+typedef struct {
+    OutputFile out;        ///< Файл результата, пишется атомарно (outfile.h)
+    int channels;          ///< Каналы файла, 0 — выбираются по первому непустому буферу
+    int sample_rate;       ///< Частота дискретизации файла
+    uint64_t frames;       ///< Записано кадров
+    int failed;            ///< Была ошибка записи
+} WavWriter;
+
+/**
+ * @brief Создаёт файл для записи WAV по частям.
+ *  Сразу после "WAVE" резервируется чанк JUNK размером с ds64, поэтому файл, выросший
+ *  больше 4 ГБ, при закрытии превращается в RF64 (EBU Tech 3306) без переписывания данных.
+ *  Запись идёт во временный файл, который встаёт на место path только при закрытии.
+ * @param[in] expected_bytes Ожидаемый объём отсчётов для выделения места, 0 — неизвестен.
+ * @return 0 при успехе, -1 если файл не создаётся.
+ */
+int wav_writer_open(WavWriter* w, const char* path, uint64_t expected_bytes);
+
+/**
+ * @brief Дописывает буфер в 16-битном PCM с насыщением.
+ *  Число каналов и частота берутся из первого непустого буфера; буферы с другим
+ *  числом каналов раскладываются по каналам файла по кругу, как в audio_concat().
+ * @return 0 при успехе, -1 при ошибке записи.
+ */
+int wav_writer_write(WavWriter* w, const AudioBuffer* buf);
+
+/**
+ * @brief Записывает размеры в заголовок, закрывает файл и переименовывает его в path.
+ *  Пока размер помещается в 32 бита, файл остаётся обычным RIFF WAV (JUNK читатели
+ *  пропускают), иначе заголовок становится RF64 с 64-битными размерами в ds64.
+ * @return 0 при успехе, -1 если запись не удалась (прежний файл path не тронут).
+ */
+int wav_writer_close(WavWriter* w);
+
+/** @brief Бросает запись: временный файл удаляется, прежний файл path не тронут. */
+void wav_writer_abort(WavWriter* w);
+
+/** @brief Освобождает память буфера и обнуляет его поля. */
+void audio_free(AudioBuffer* buf);
+
+/**
+ * @brief Склеивает буферы в один в заданном порядке.
+ *  Число каналов и частота берутся из первого непустого буфера; буферы с другим
+ *  числом каналов раскладываются по каналам результата по кругу.
+ * @param[in] parts Склеиваемые буферы (пустые пропускаются).
+ * @param[in] count Количество буферов.
+ * @param[out] out Результат (освобождается audio_free()).
+ * @return 0 при успехе, -1 при нехватке памяти.
+ */
+int audio_concat(const AudioBuffer* parts, int count, AudioBuffer* out);
+
+/**
+ * @brief Во сколько раз повышается тон слога.
+ *  Сдвиг в полутонах не зависит от слога; абсолютная нота пересчитывается от частоты
+ *  основного тона слога, а без неё (нет меток или слог неозвучен) тон не меняется.
+ *  Результат ограничен ±36 полутонами, как и относительный сдвиг.
+ * @param[in] semitones Поле тона из параметров слога.
+ * @param[in] marks Метки основного тона слога или NULL.
+ */
+double dsp_pitch_factor(int semitones, const PitchMarks* marks);
+
+/**
+ * @brief Маска включённых этапов цепочки: те же условия, что при построении команды FFmpeg.
+ * @param[in] p Параметры обработки.
+ * @param[in] marks Метки основного тона слога или NULL (нужны, чтобы понять, меняется ли тон ноты).
+ * @return Сочетание битов DSP_STAGE_*.
+ */
+unsigned dsp_chain_mask(const EffectParams* p, const PitchMarks* marks);
+
+/**
+ * @brief Применяет к буферу полную цепочку эффектов в порядке create_ffmpeg_command().
+ *  Условия включения каждого эффекта совпадают с условиями построения команды FFmpeg.
+ *  Если у слога есть метки и озвученные участки, тон сдвигается TD-PSOLA за один проход
+ *  вместо asetrate + atempo; без меток результат совпадает с цепочкой FFmpeg.
+ *  Остальные этапы выполняются одним проходом по кадрам, собранным под маску
+ *  dsp_chain_mask(), без проверок выключенных этапов внутри цикла.
+ * @param[in] in Исходный звук слога.
+ * @param[in] p Параметры обработки.
+ * @param[in] marks Метки основного тона слога или NULL.
+ * @param[out] out Результат (освобождается audio_free()).
+ * @return 0 при успехе, -1 при нехватке памяти.
+ */
+int dsp_apply_chain(const AudioBuffer* in, const EffectParams* p, const PitchMarks* marks, AudioBuffer* out);
+
+#endif /* DSP_H */
@@ -0,0 +1,297 @@
+/**
+ * @file dsp_simd.c
+ * @brief Скалярные и векторные (SSE2/AVX2) версии ядер движка и выбор версии во время выполнения.
+ *
+ * Векторные версии компилируются с атрибутом target, поэтому файл собирается без особых
+ * ключей компилятора, а инструкции AVX2 выполняются только на процессорах, которые их
+ * поддерживают. Биквадратный фильтр рекурсивен по времени, поэтому векторизуется по
+ * каналам: оба канала стерео считаются в одном регистре из двух double; более широкие
+ * регистры AVX2 ему ничего не дают, и на этом уровне используется версия SSE2.
+ */
+
+#include <stdint.h>
+#include <math.h>
+
+#include "dsp_simd.h"
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define DSP_SIMD_X86 1
+#include <immintrin.h>
+#define TARGET_SSE2 __attribute__((target("sse2")))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+static int g_level = -1; //!< Уровень, заданный dsp_simd_set_level(); -1 — лучший доступный
+
+DspSimdLevel dsp_simd_detect(void) {
+#ifdef DSP_SIMD_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) return DSP_SIMD_AVX2;
+    if (__builtin_cpu_supports("sse2")) return DSP_SIMD_SSE2;
+#endif
+    return DSP_SIMD_SCALAR;
+}
+
+void dsp_simd_set_level(DspSimdLevel level) {
+    DspSimdLevel best = dsp_simd_detect();
+    g_level = level < best ? level : best;
+}
+
+DspSimdLevel dsp_simd_level(void) {
+    return g_level >= 0 ? (DspSimdLevel)g_level : dsp_simd_detect();
+}
+
+const char* dsp_simd_name(DspSimdLevel level) {
+    switch (level) {
+        case DSP_SIMD_SSE2: return "sse2";
+        case DSP_SIMD_AVX2: return "avx2";
+        default: return "scalar";
+    }
+}
+
+/* ---------- Скалярные версии ---------- */
+
+static void decode_scalar(const unsigned char* in, float* out, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        out[i] = (int16_t)(uint16_t)(in[2 * i] | (in[2 * i + 1] << 8)) / 32768.0f;
+    }
+}
+
+static void encode_scalar(const float* in, unsigned char* out, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        float s = in[i] * 32768.0f;
+        if (s > 32767.0f) s = 32767.0f;
+        if (s < -32768.0f) s = -32768.0f;
+        uint16_t v = (uint16_t)(int16_t)lrintf(s);
+        out[2 * i] = v & 0xff;
+        out[2 * i + 1] = v >> 8;
+    }
+}
+
+static void ramp_scalar(float* samples, size_t first, size_t from, size_t frames, int channels, int sample_rate,
+    int fade_in, float start, float duration) {
+    for (size_t n = from; n < frames; n++) {
+        double t = (double)(first + n) / sample_rate;
+        double g = (t - start) / duration;
+        if (g < 0) g = 0;
+        if (g > 1) g = 1;
+        if (!fade_in) g = 1.0 - g;
+        for (int c = 0; c < channels; c++) {
+            samples[n * channels + c] *= (float)g;
+        }
+    }
+}
+
+static void biquad_scalar(float* samples, size_t frames, int channels, const double coef[5], double* state) {
+    const double b0 = coef[0], b1 = coef[1], b2 = coef[2], a1 = coef[3], a2 = coef[4];
+    for (int c = 0; c < channels; c++) {
+        double x1 = 0, x2 = 0, y1 = 0, y2 = 0;
+        if (state) {
+            x1 = state[c * 4]; x2 = state[c * 4 + 1]; y1 = state[c * 4 + 2]; y2 = state[c * 4 + 3];
+        }
+        for (size_t n = 0; n < frames; n++) {
+            float* s = &samples[n * channels + c];
+            double x = *s;
+            double y = b0 * x + b1 * x1 + b2 * x2 - a1 * y1 - a2 * y2;
+            x2 = x1; x1 = x;
+            y2 = y1; y1 = y;
+            *s = (float)y;
+        }
+        if (state) {
+            state[c * 4] = x1; state[c * 4 + 1] = x2; state[c * 4 + 2] = y1; state[c * 4 + 3] = y2;
+        }
+    }
+}
+
+#ifdef DSP_SIMD_X86
+
+/* ---------- SSE2 ---------- */
+
+TARGET_SSE2 static void decode_sse2(const unsigned char* in, float* out, size_t count) {
+    const __m128 scale = _mm_set1_ps(1.0f / 32768.0f); //!< Степень двойки: умножение равно делению
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(in + 2 * i));
+        __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16);
+        __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16);
+        _mm_storeu_ps(out + i, _mm_mul_ps(_mm_cvtepi32_ps(lo), scale));
+        _mm_storeu_ps(out + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(hi), scale));
+    }
+    decode_scalar(in + 2 * i, out + i, count - i);
+}
+
+TARGET_SSE2 static void encode_sse2(const float* in, unsigned char* out, size_t count) {
+    const __m128 scale = _mm_set1_ps(32768.0f);
+    const __m128 hi = _mm_set1_ps(32767.0f), lo = _mm_set1_ps(-32768.0f);
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m128 a = _mm_mul_ps(_mm_loadu_ps(in + i), scale);
+        __m128 b = _mm_mul_ps(_mm_loadu_ps(in + i + 4), scale);
+        a = _mm_max_ps(lo, _mm_min_ps(hi, a));
+        b = _mm_max_ps(lo, _mm_min_ps(hi, b));
+        //! cvtps округляет к ближайшему чётному, как lrintf() в режиме по умолчанию
+        __m128i packed = _mm_packs_epi32(_mm_cvtps_epi32(a), _mm_cvtps_epi32(b));
+        _mm_storeu_si128((__m128i*)(out + 2 * i), packed);
+    }
+    encode_scalar(in + i, out + 2 * i, count - i);
+}
+
+TARGET_SSE2 static void ramp_sse2(float* samples, size_t first, size_t frames, int channels, int sample_rate,
+    int fade_in, float start, float duration) {
+    size_t n = 0;
+    if (channels == 2) {
+        //! Коэффициенты считаются в double, как в скалярной версии, по два кадра за шаг
+        const __m128d rate = _mm_set1_pd(sample_rate), st = _mm_set1_pd(start), dur = _mm_set1_pd(duration);
+        const __m128d zero = _mm_setzero_pd(), one = _mm_set1_pd(1.0), step = _mm_set1_pd(2.0);
+        __m128d index = _mm_set_pd((double)first + 1.0, (double)first);
+        for (; n + 2 <= frames; n += 2) {
+            __m128d g = _mm_div_pd(_mm_sub_pd(_mm_div_pd(index, rate), st), dur);
+            g = _mm_max_pd(zero, g); //!< Порядок операндов сохраняет -0 и NaN, как сравнения в скалярной версии
+            g = _mm_min_pd(one, g);
+            if (!fade_in) g = _mm_sub_pd(one, g);
+            __m128 gf = _mm_cvtpd_ps(g);
+            float* s = samples + 2 * n;
+            _mm_storeu_ps(s, _mm_mul_ps(_mm_loadu_ps(s), _mm_unpacklo_ps(gf, gf)));
+            index = _mm_add_pd(index, step);
+        }
+    }
+    ramp_scalar(samples, first, n, frames, channels, sample_rate, fade_in, start, duration);
+}
+
+TARGET_SSE2 static void biquad_sse2(float* samples, size_t frames, int channels, const double coef[5], double* state) {
+    if (channels != 2) {
+        biquad_scalar(samples, frames, channels, coef, state);
+        return;
+    }
+    const __m128d b0 = _mm_set1_pd(coef[0]), b1 = _mm_set1_pd(coef[1]), b2 = _mm_set1_pd(coef[2]);
+    const __m128d a1 = _mm_set1_pd(coef[3]), a2 = _mm_set1_pd(coef[4]);
+    __m128d x1 = _mm_setzero_pd(), x2 = x1, y1 = x1, y2 = x1;
+    if (state) {
+        //! Младшая половина регистра — левый канал
+        x1 = _mm_set_pd(state[4], state[0]);
+        x2 = _mm_set_pd(state[5], state[1]);
+        y1 = _mm_set_pd(state[6], state[2]);
+        y2 = _mm_set_pd(state[7], state[3]);
+    }
+    for (size_t n = 0; n < frames; n++) {
+        float* s = samples + 2 * n;
+        __m128d x = _mm_cvtps_pd(_mm_castsi128_ps(_mm_loadl_epi64((const __m128i*)s)));
+        //! Тот же порядок сложений, что и в скалярной версии
+        __m128d y = _mm_mul_pd(b0, x);
+        y = _mm_add_pd(y, _mm_mul_pd(b1, x1));
+        y = _mm_add_pd(y, _mm_mul_pd(b2, x2));
+        y = _mm_sub_pd(y, _mm_mul_pd(a1, y1));
+        y = _mm_sub_pd(y, _mm_mul_pd(a2, y2));
+        x2 = x1; x1 = x;
+        y2 = y1; y1 = y;
+        _mm_storel_epi64((__m128i*)s, _mm_castps_si128(_mm_cvtpd_ps(y)));
+    }
+    if (state) {
+        _mm_storel_pd(&state[0], x1); _mm_storeh_pd(&state[4], x1);
+        _mm_storel_pd(&state[1], x2); _mm_storeh_pd(&state[5], x2);
+        _mm_storel_pd(&state[2], y1); _mm_storeh_pd(&state[6], y1);
+        _mm_storel_pd(&state[3], y2); _mm_storeh_pd(&state[7], y2);
+    }
+}
+
+/* ---------- AVX2 ---------- */
+
+TARGET_AVX2 static void decode_avx2(const unsigned char* in, float* out, size_t count) {
+    const __m256 scale = _mm256_set1_ps(1.0f / 32768.0f);
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        __m256i lo = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i*)(in + 2 * i)));
+        __m256i hi = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i*)(in + 2 * i + 16)));
+        _mm256_storeu_ps(out + i, _mm256_mul_ps(_mm256_cvtepi32_ps(lo), scale));
+        _mm256_storeu_ps(out + i + 8, _mm256_mul_ps(_mm256_cvtepi32_ps(hi), scale));
+    }
+    decode_scalar(in + 2 * i, out + i, count - i);
+}
+
+TARGET_AVX2 static void encode_avx2(const float* in, unsigned char* out, size_t count) {
+    const __m256 scale = _mm256_set1_ps(32768.0f);
+    const __m256 hi = _mm256_set1_ps(32767.0f), lo = _mm256_set1_ps(-32768.0f);
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        __m256 a = _mm256_mul_ps(_mm256_loadu_ps(in + i), scale);
+        __m256 b = _mm256_mul_ps(_mm256_loadu_ps(in + i + 8), scale);
+        a = _mm256_max_ps(lo, _mm256_min_ps(hi, a));
+        b = _mm256_max_ps(lo, _mm256_min_ps(hi, b));
+        //! packs работает внутри 128-битных половин, перестановка возвращает порядок отсчётов
+        __m256i packed = _mm256_packs_epi32(_mm256_cvtps_epi32(a), _mm256_cvtps_epi32(b));
+        packed = _mm256_permute4x64_epi64(packed, 0xD8);
+        _mm256_storeu_si256((__m256i*)(out + 2 * i), packed);
+    }
+    encode_scalar(in + i, out + 2 * i, count - i);
+}
+
+TARGET_AVX2 static void ramp_avx2(float* samples, size_t first, size_t frames, int channels, int sample_rate,
+    int fade_in, float start, float duration) {
+    size_t n = 0;
+    if (channels == 2) {
+        const __m256d rate = _mm256_set1_pd(sample_rate), st = _mm256_set1_pd(start), dur = _mm256_set1_pd(duration);
+        const __m256d zero = _mm256_setzero_pd(), one = _mm256_set1_pd(1.0), step = _mm256_set1_pd(4.0);
+        __m256d index = _mm256_add_pd(_mm256_set1_pd((double)first), _mm256_set_pd(3.0, 2.0, 1.0, 0.0));
+        for (; n + 4 <= frames; n += 4) {
+            __m256d g = _mm256_div_pd(_mm256_sub_pd(_mm256_div_pd(index, rate), st), dur);
+            g = _mm256_max_pd(zero, g);
+            g = _mm256_min_pd(one, g);
+            if (!fade_in) g = _mm256_sub_pd(one, g);
+            __m128 gf = _mm256_cvtpd_ps(g);
+            __m256 gains = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_unpacklo_ps(gf, gf)),
+                _mm_unpackhi_ps(gf, gf), 1);
+            float* s = samples + 2 * n;
+            _mm256_storeu_ps(s, _mm256_mul_ps(_mm256_loadu_ps(s), gains));
+            index = _mm256_add_pd(index, step);
+        }
+    }
+    ramp_scalar(samples, first, n, frames, channels, sample_rate, fade_in, start, duration);
+}
+
+#endif /* DSP_SIMD_X86 */
+
+/* ---------- Выбор версии ---------- */
+
+void dsp_pcm16_decode(const unsigned char* in, float* out, size_t count) {
+#ifdef DSP_SIMD_X86
+    switch (dsp_simd_level()) {
+        case DSP_SIMD_AVX2: decode_avx2(in, out, count); return;
+        case DSP_SIMD_SSE2: decode_sse2(in, out, count); return;
+        default: break;
+    }
+#endif
+    decode_scalar(in, out, count);
+}
+
+void dsp_pcm16_encode(const float* in, unsigned char* out, size_t count) {
+#ifdef DSP_SIMD_X86
+    switch (dsp_simd_level()) {
+        case DSP_SIMD_AVX2: encode_avx2(in, out, count); return;
+        case DSP_SIMD_SSE2: encode_sse2(in, out, count); return;
+        default: break;
+    }
+#endif
+    encode_scalar(in, out, count);
+}
+
+void dsp_gain_ramp(float* samples, size_t first, size_t frames, int channels, int sample_rate,
+    int fade_in, float start, float duration) {
+#ifdef DSP_SIMD_X86
+    switch (dsp_simd_level()) {
+        case DSP_SIMD_AVX2: ramp_avx2(samples, first, frames, channels, sample_rate, fade_in, start, duration); return;
+        case DSP_SIMD_SSE2: ramp_sse2(samples, first, frames, channels, sample_rate, fade_in, start, duration); return;
+        default: break;
+    }
+#endif
+    ramp_scalar(samples, first, 0, frames, channels, sample_rate, fade_in, start, duration);
+}
+
+void dsp_biquad(float* samples, size_t frames, int channels, const double coef[5], double* state) {
+#ifdef DSP_SIMD_X86
+    if (dsp_simd_level() != DSP_SIMD_SCALAR) {
+        biquad_sse2(samples, frames, channels, coef, state);
+        return;
+    }
+#endif
+    biquad_scalar(samples, frames, channels, coef, state);
+}
@@ -0,0 +1,72 @@
+/**
+ * @file dsp_simd.h
+ * @brief Векторные ядра движка: перевод int16 ↔ float, линейные fade и биквадратный фильтр.
+ *
+ * Для каждого ядра есть скалярная версия и версии SSE2/AVX2 для x86; нужная выбирается
+ * во время выполнения по возможностям процессора. Векторные версии выполняют те же
+ * операции в той же точности и в том же порядке, что и скалярные, поэтому результат
+ * не зависит от выбранной версии.
+ */
+
+#ifndef DSP_SIMD_H
+#define DSP_SIMD_H
+
+#include <stddef.h>
+
+/** @brief Набор инструкций, которым выполняются ядра. */
+typedef enum {
+    DSP_SIMD_SCALAR,  ///< Переносимые скалярные версии
+    DSP_SIMD_SSE2,    ///< SSE2 (x86)
+    DSP_SIMD_AVX2     ///< AVX2 (x86)
+} DspSimdLevel;
+
+/** @brief Лучший набор инструкций, поддерживаемый процессором. */
+DspSimdLevel dsp_simd_detect(void);
+
+/**
+ * @brief Ограничивает набор инструкций (например, для сравнения со скалярной версией).
+ *  Уровень выше поддерживаемого процессором понижается. Вызывается до запуска потоков.
+ */
+void dsp_simd_set_level(DspSimdLevel level);
+
+/** @brief Текущий набор инструкций. */
+DspSimdLevel dsp_simd_level(void);
+
+/** @brief Название набора инструкций ("scalar", "sse2", "avx2"). */
+const char* dsp_simd_name(DspSimdLevel level);
+
+/**
+ * @brief Переводит 16-битные отсчёты little-endian в float [-1; 1).
+ * @param[in] in Байты отсчётов (2 * count байт).
+ * @param[out] out Отсчёты float.
+ * @param[in] count Количество отсчётов.
+ */
+void dsp_pcm16_decode(const unsigned char* in, float* out, size_t count);
+
+/**
+ * @brief Переводит отсчёты float в 16-битные little-endian с насыщением и округлением к ближайшему.
+ * @param[in] in Отсчёты float.
+ * @param[out] out Байты отсчётов (2 * count байт).
+ * @param[in] count Количество отсчётов.
+ */
+void dsp_pcm16_encode(const float* in, unsigned char* out, size_t count);
+
+/**
+ * @brief Линейное нарастание (fade_in) или затухание громкости, как у фильтра afade.
+ *  Коэффициент кадра n равен (n / sample_rate - start) / duration, ограниченному [0; 1].
+ * @param[in,out] samples Отсчёты, начиная с кадра first (звук можно обрабатывать блоками).
+ * @param[in] first Номер первого кадра блока во всём звуке.
+ */
+void dsp_gain_ramp(float* samples, size_t first, size_t frames, int channels, int sample_rate,
+    int fade_in, float start, float duration);
+
+/**
+ * @brief Биквадратный фильтр прямой формы I, отдельно для каждого канала.
+ * @param[in,out] samples Чередующиеся отсчёты.
+ * @param[in] coef Нормированные коэффициенты b0, b1, b2, a1, a2.
+ * @param[in,out] state x1, x2, y1, y2 каждого канала между блоками (4 * channels значений)
+ *  или NULL — фильтр начинает с нулей.
+ */
+void dsp_biquad(float* samples, size_t frames, int channels, const double coef[5], double* state);
+
+#endif /* DSP_SIMD_H */
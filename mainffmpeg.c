@@ -3,592 +3,342 @@
  * @brief Сборщик и процессор аудиофайлов с поддержкой различных эффектов. 
  * Программа предназначена для объединения и обработки набора аудиофайлов формата 
  * WAV с возможностью применения эффектов вроде смены тональности, наложения вибрато, 
- * плавного затухания и других эффектов с помощью FFmpeg. */
+ * плавного затухания и других эффектов встроенным движком (dsp.c) или, для сверки
+ * результатов, с помощью FFmpeg. Обработка выполняется библиотекой libtts (tts.h);
+ * программа читает партитуру из output.txt и записывает результат в voicebank/done/output.wav
+ * (--output=FILE — в другой файл) один раз: во временный файл рядом с назначением, который
+ * затем атомарно подменяет прежний результат.
+ * Рядом с результатом хранится манифест прошлого рендера (output.manifest): после правки
+ * output.txt заново обрабатываются только изменённые слоги, остальные берутся из прошлого результата.
+ * В режиме --watch программа не завершается, а перерисовывает результат при каждом
+ * сохранении партитуры, держа голосовой банк и движок загруженными.
+ * С --max-memory-mb=N длинная партитура (аудиокнига) рендерится окнами прямо в файл результата:
+ * память ограничена N мегабайтами независимо от длины, файл больше 4 ГБ пишется как RF64. */
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <direct.h> 
-#include <windows.h>
-#include <math.h>
-
-#define MAX_CMD_SIZE 1024
-
-/** @brief Формирует командную строку для FFmpeg с заданными параметрами обработки аудиофайла. 
- *  Формируется полная команда для запуска FFmpeg с набором фильтров, позволяющих изменить 
- *  высоту тона, добавить эффекты вибрато, затухания, эха, хоруса, эквалайзера и фленджер. 
- *  @param[in] input Исходный аудиофайл.
- *  @param[out] output Финальный аудиофайл.
- *  @param[in] semitones Количество полутонов для изменения тональности. 
- *  @param[in] duration Общая длительность файла. 
- *  @param[in] freq_vibro Частота вибрато. 
- *  @param[in] depth_vibro Глубина вибрато. 
- *  @param[in] start_fade_in Время начала плавного нарастания громкости. 
- *  @param[in] duration_fade_in Длительность плавного нарастания громкости. 
- *  @param[in] start_fade_out Время начала плавного затухания громкости. 
- *  @param[in] duration_fade_out Длительность плавного затухания громкости. 
- *  @param[in] Echo1 Первый коэффициент эха. 
- *  @param[in] Echo2 Второй коэффициент эха. 
- *  @param[in] Echo3 Третий коэффициент эха. 
- *  @param[in] Echo4 Четвертый коэффициент эха. 
- *  @param[in] chorus Интенсивность эффекта хоруса. 
- *  @param[in] Equalizerf Центральная частота эквалайзера. 
- *  @param[in] Equalizert Тип эквалайзера. 
- *  @param[in] Equalizerw Ширина полосы пропускания эквалайзера. 
- *  @param[in] Equalizerg Усиление эквалайзера. 
- *  @param[in] Flanger Величина задержки для эффекта фленджер. 
- *  @return Строку с готовой командой для запуска FFmpeg. */
-char* create_ffmpeg_command(
-    const char* input, 
-    const char* output, 
-    int semitones, 
-    float duration, 
-    int freq_vibro, 
-    float depth_vibro, 
-    float start_fade_in, 
-    float duration_fade_in, 
-    float start_fade_out, 
-    float duration_fade_out,
-
-    float Echo1,
-    float Echo2,
-    float Echo3,
-    float Echo4,
-    float chorus,
-    float Equalizerf,
-    float Equalizert,
-    float Equalizerw,
-    float Equalizerg,
-
-    float Flanger
-) {
-    static char cmd[MAX_CMD_SIZE];
-
-    //! Вычисляем коэффициент изменения частоты для изменения тональности
-    double factor = pow(2.0, semitones / 12.0);
-
-    //! Формируем базовую команду для FFmpeg
-    snprintf(cmd, MAX_CMD_SIZE, 
-        "ffmpeg -y -i \"%s\" ", input);
-
-    //! Добавляем фильтры для изменения частоты и темпоральной характеристики звука
-    snprintf(cmd + strlen(cmd), MAX_CMD_SIZE - strlen(cmd), 
-        "-af \"asetrate=44100*%.5f,atempo=1/%.5f", factor, factor);
-
-    //! Если включены параметры вибрато, добавляем этот эффект
-    if (freq_vibro > 0 && depth_vibro > 0) {
-        snprintf(cmd + strlen(cmd), MAX_CMD_SIZE - strlen(cmd), 
-            ",vibrato=f=%d:d=%.2f", freq_vibro, depth_vibro);
+#include <signal.h>
+
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <unistd.h>
+#define _chdir chdir
+#endif
+
+#include "tts.h"
+#include "trace.h"
+#include "watch.h"
+#include "workers.h"
+
+#define WATCH_DEBOUNCE_MS 50 ///< Тишина после последнего события, после которой начинается рендер
+
+/** @brief Куда и как записывается результат рендера. */
+typedef struct {
+    const char* output;     ///< Файл результата (--output=), путь относительно каталога voicebank
+    const char* manifest;   ///< Манифест прошлого рендера, рядом с файлом результата
+    size_t maxMemory;       ///< Предел памяти рендера окнами (--max-memory-mb=), байт; 0 — целиком в памяти
+} OutputTarget;
+
+/** @brief Рендерит партитуру и записывает результат один раз, сразу на место назначения, и его манифест.
+ *  Результат пишется во временный файл рядом с назначением и подменяет прежний только
+ *  целиком (outfile.h), поэтому при ошибке прежний результат и его манифест остаются в силе.
+ * @param[in] engine Движок с загруженным голосовым банком.
+ * @param[in] score Партитура.
+ * @param[in] full Обработать все слоги заново, не заглядывая в прошлый результат.
+ * @param[in] target Файл результата, манифест и предел памяти.
+ * @return 0 при успехе, -1 при ошибке (сообщение уже напечатано). */
+static int render_score(TtsEngine* engine, const Score* score, int full, const OutputTarget* target) {
+    //! Заранее сообщаем обо всех отсутствующих слогах
+    int missing = tts_check_score(engine, score);
+    if (missing > 0) {
+        printf("%d syllable(s) have no voicebank unit, nothing rendered\n", missing);
+        return -1;
     }
 
-    //! Если активированы параметры плавного нарастания громкости, добавляем их
-    if (start_fade_in >= 0 && duration_fade_in > 0) {
-        snprintf(cmd + strlen(cmd), MAX_CMD_SIZE - strlen(cmd), 
-            ",afade=t=in:st=%.2f:d=%.2f", start_fade_in, duration_fade_in);
+    if (target->maxMemory > 0) {
+        //! Окнами прямо в файл: прошлый результат целиком в память не читается, манифест не ведётся
+        remove(target->manifest);
+        uint64_t frames = 0;
+        if (tts_render_to_file(engine, score, target->output, target->maxMemory, &frames) != 0) return -1;
+        printf("Files processed successfully into %s (%.1f min)\n", target->output, frames / (60.0 * DSP_SAMPLE_RATE));
+        return 0;
     }
 
-    //! Если активированы параметры плавного затухания громкости, добавляем их
-    if (start_fade_out >= 0 && duration_fade_out > 0) {
-        snprintf(cmd + strlen(cmd), MAX_CMD_SIZE - strlen(cmd), 
-            ",afade=t=out:st=%.2f:d=%.2f", start_fade_out, duration_fade_out);
+    //! Прошлый результат и его манифест: неизменённые слоги берутся оттуда
+    TtsManifest previous, manifest;
+    AudioBuffer previousAudio;
+    memset(&previousAudio, 0, sizeof(previousAudio));
+    int havePrevious = !full && tts_manifest_load(target->manifest, &previous) == 0;
+    if (havePrevious && wav_read(target->output, &previousAudio) != 0) {
+        tts_manifest_free(&previous);
+        havePrevious = 0;
     }
 
-    //! Если настроены параметры эха, добавляем этот эффект
-    if (Echo1 > 0 && Echo2 > 0 && Echo3 > 0 && Echo4 > 0) {
-        snprintf(cmd + strlen(cmd), MAX_CMD_SIZE - strlen(cmd),
-            ",aecho=%.2f:%.2f:%.2f:%.2f", Echo1, Echo2, Echo3, Echo4);
+    //! Обработка слогов и сборка результата в памяти, запись одним файлом
+    AudioBuffer merged;
+    int reused = 0;
+    int rc = tts_render_incremental(engine, score, havePrevious ? &previous : NULL,
+        havePrevious ? &previousAudio : NULL, &merged, &manifest, &reused);
+    if (havePrevious) {
+        tts_manifest_free(&previous);
+        audio_free(&previousAudio);
     }
-
-    //! Если настроен эффект хоруса, добавляем его
-    if (chorus > 0) {
-        snprintf(cmd + strlen(cmd), MAX_CMD_SIZE - strlen(cmd),
-            ",chorus=%.2f:0.7:60:0.4:0.25:2", chorus);
-    }
-
-    //! Если настроены параметры эквалайзера, добавляем их
-    if (Equalizerf != 0 && Equalizert != 0 && Equalizerw != 0 && Equalizerg != 0) {
-        snprintf(cmd + strlen(cmd), MAX_CMD_SIZE - strlen(cmd),
-            ",equalizer=f=%.2f:t=q:w=%.2f:g=%.2f",
-            Equalizerf, Equalizert, Equalizerw, Equalizerg);
+    if (rc == 0) {
+        printf("Reused %d of %d syllable(s) from the previous output\n", reused, score->count);
+        double t = TRACE_BEGIN();
+        rc = wav_write_atomic(target->output, &merged);
+        TRACE_END(t, "io", "output write", target->output, (long long)(merged.frames * merged.channels),
+            44 + (long long)(merged.frames * merged.channels * 2));
+        audio_free(&merged);
+        if (rc != 0) {
+            printf("Error writing %s\n", target->output);
+        } else {
+            printf("Files processed successfully into %s\n", target->output);
+        }
     }
 
-    //! Если настроен эффект фленджер, добавляем его
-    if (Flanger > 0) {
-        snprintf(cmd + strlen(cmd), MAX_CMD_SIZE - strlen(cmd),
-            ",flanger=delay=%.2f", Flanger);
+    //! Манифест описывает только успешно записанный результат
+    if (rc == 0 && tts_manifest_save(target->manifest, &manifest) != 0) {
+        printf("Cannot write %s, the next run renders everything\n", target->manifest);
+        remove(target->manifest);
     }
+    tts_manifest_free(&manifest);
+    return rc;
+}
 
-    //! Добавляем заключительный этап ресемплинга
-    snprintf(cmd + strlen(cmd), MAX_CMD_SIZE - strlen(cmd), 
-        ",aresample=44100\" ");
-
-    //! Устанавливаем требуемую длительность и имя выходного файла
-    snprintf(cmd + strlen(cmd), MAX_CMD_SIZE - strlen(cmd), 
-        "-t %.2f \"%s\"", duration, output);
+static volatile sig_atomic_t stopWatching = 0; //!< Ctrl+C в режиме --watch
 
-    return cmd;
+static void on_interrupt(int sig) {
+    (void)sig;
+    stopWatching = 1;
 }
 
-/** 
- * @brief Применяет созданные параметры и команду для обработки отдельного аудиофайла. 
- *  Запускает команду FFmpeg для конкретного файла, создавая промежуточный обработанный файл.
- *  @param[in] input Исходный аудиофайл. 
- *  @param[out] output Выходной аудиофайл. 
- *  @param[in] pitch Изменение тональности в полутонах. 
- *  @param[in] duration Требуемая длительность. 
- *  @param[in] freq_vibro Частота вибрато. 
- *  @param[in] depth_vibro Глубина вибрато. 
- *  @param[in] start_fade_in Время начала плавного нарастания громкости. 
- *  @param[in] duration_fade_in Длительность плавного нарастания громкости. 
- *  @param[in] start_fade_out Время начала плавного затухания громкости. 
- *  @param[in] duration_fade_out Длительность плавного затухания громкости. 
- *  @param[in] Echo1 Первый коэффициент эха. 
- *  @param[in] Echo2 Второй коэффициент эха. 
- *  @param[in] Echo3 Третий коэффициент эха. 
- *  @param[in] Echo4 Четвертый коэффициент эха. 
- *  @param[in] chorus Интенсивность эффекта хоруса. 
- *  @param[in] Equalizerf Центральная частота эквалайзера. 
- *  @param[in] Equalizert Тип эквалайзера. 
- *  @param[in] Equalizerw Ширина полосы пропускания эквалайзера. 
- *  @param[in] Equalizerg Усиление эквалайзера. 
- *  @param[in] Flanger Величина задержки для эффекта фленджер. */
-void runModifiers(
-    const char* input, 
-    const char* output, 
-    int pitch, 
-    float duration, 
-    int freq_vibro, 
-    float depth_vibro, 
-    float start_fade_in, 
-    float duration_fade_in, 
-    float start_fade_out, 
-    float duration_fade_out,
-
-    float Echo1,
-    float Echo2,
-    float Echo3,
-    float Echo4,
-
-    float chorus,
-    float Equalizerf,
-    float Equalizert,
-    float Equalizerw,
-    float Equalizerg,
-
-    float Flanger
-) {
-    char cmd[MAX_CMD_SIZE];
-
-    //! Формируем команду FFmpeg для текущего файла
-    strcpy(cmd, create_ffmpeg_command(input, output, pitch, duration, freq_vibro, depth_vibro, start_fade_in, duration_fade_in, start_fade_out, duration_fade_out, Echo1, Echo2, Echo3, Echo4, chorus, Equalizerf, Equalizert, Equalizerw, Equalizerg, Flanger));
-
-    //! Выводим команду для контроля
-    printf("Processing command:\n%s\n", cmd);
-
-    //! Выполняем команду через систему
-    system(cmd);
+/** @brief Что изменилось с последнего рендера в режиме --watch. */
+typedef struct {
+    const char* scoreName;  ///< Имя файла партитуры в её каталоге
+    const char* outputName; ///< Имя файла результата: его запись не изменение банка
+    int scoreChanged;       ///< Партитура сохранена
+    int voicebankChanged;   ///< Изменились слоги или метки основного тона
+    double firstEvent;      ///< Момент первого события серии по workers_time(), 0 — событий нет
+} WatchState;
+
+/** @brief Обработчик событий наблюдателя: каталог 0 — партитура, каталог 1 — голосовой банк. */
+static void on_change(int dir, const char* name, void* ctx) {
+    WatchState* s = ctx;
+    size_t len = strlen(name);
+    if (dir == 0) {
+        if (name[0] != '\0' && strcmp(name, s->scoreName) != 0) return;
+        s->scoreChanged = 1;
+    } else {
+        //! Собственные файлы рендера (результат, манифест, кэш) не в счёт
+        int unit = len > 4 && strcmp(name + len - 4, ".wav") == 0 && strcmp(name, s->outputName) != 0 &&
+            strncmp(name, "temp_modifier_", 14) != 0;
+        if (name[0] != '\0' && !unit && strcmp(name, "pitchmarks.idx") != 0) return;
+        s->voicebankChanged = 1;
+    }
+    if (s->firstEvent == 0) s->firstEvent = workers_time();
 }
 
-/** 
- * @brief Процессор для объединения обработанных файлов в один аудиофайл. 
- * Обрабатывает каждый файл с заданными параметрами и затем объединяет полученные промежуточные файлы в один общий аудиофайл. 
- * @param[in] wavFiles Массив путей к исходным файлам. 
- * @param[in] pitches Массив индексов изменения тональности. 
- * @param[in] durations Массив длительностей для каждого файла. 
- * @param[in] frequencies Массив частот вибрато. 
- * @param[in] depths Массив глубин вибрато. 
- * @param[in] starts_fade_in Массив начальных точек плавного нарастания громкости. 
- * @param[in] durations_fade_in Массив длительностей плавного нарастания громкости.
- * @param[in] starts_fade_out Массив начальных точек плавного затухания громкости. 
- * @param[in] durations_fade_out Массив длительностей плавного затухания громкости. 
- * @param[in] Echo1 Массив коэффициентов первого эха. 
- * @param[in] Echo2 Массив коэффициентов второго эха. 
- * @param[in] Echo3 Массив коэффициентов третьего эха.
- * @param[in] Echo4 Массив коэффициентов четвёртого эха. 
- * @param[in] chorus Массив интенсивностей эффекта хоруса. 
- * @param[in] Equalizerf Массив центральных частот эквалайзера.
- * @param[in] Equalizert Массив типов эквалайзера. 
- * @param[in] Equalizerw Массив ширин эквалайзера. 
- * @param[in] Equalizerg Массив усилений эквалайзера. 
- * @param[in] Flanger Массив задержек для эффекта фленджер. 
- * @param[in] fileCount Количество файлов для обработки. 
- * @param[out] output Выходной файл, куда будет собран результат. */
-
-void merge_wav_files(
-    const char** wavFiles, 
-    int* pitches, 
-    float* durations, 
-    int* frequencies, 
-    float* depths, 
-    float* starts_fade_in, 
-    float* durations_fade_in, 
-    float* starts_fade_out, 
-    float* durations_fade_out, 
-
-    float* Echo1,
-    float* Echo2,
-    float* Echo3,
-    float* Echo4,
-    float* chorus,
-    float* Equalizerf,
-    float* Equalizert,
-    float* Equalizerw,
-    float* Equalizerg,
-
-    float* Flanger,
-
-    int fileCount, 
-    const char* output
-) {
-    if (fileCount == 0) {
-        printf("No files to merge.\n");
-        return;
+/** @brief Режим --watch: ждёт сохранения партитуры или изменения банка и перерисовывает результат.
+ * @param[in,out] engine Движок; пересоздаётся, если изменился голосовой банк.
+ * @param[in] options Настройки для пересоздания движка.
+ * @param[in] scoreFile Путь к партитуре относительно каталога voicebank.
+ * @param[in] target Куда записывается результат.
+ * @return 0 после Ctrl+C, 1 если наблюдение не удалось начать. */
+static int watch_score(TtsEngine** engine, const TtsOptions* options, const char* scoreFile, const OutputTarget* target) {
+    //! Каталог и имя партитуры: наблюдаем каталог, чтобы пережить сохранение через переименование
+    char scoreDir[1024];
+    const char* slash = strrchr(scoreFile, '/');
+    const char* backslash = strrchr(scoreFile, '\\');
+    if (!slash || (backslash && backslash > slash)) slash = backslash;
+    if (slash) {
+        snprintf(scoreDir, sizeof(scoreDir), "%.*s", (int)(slash - scoreFile), scoreFile);
+        if (scoreDir[0] == '\0') strcpy(scoreDir, "/");
+    } else {
+        strcpy(scoreDir, ".");
     }
-
-    //! Массив для хранения уникальных временных файлов
-    char** uniqueTmpFiles = malloc(fileCount * sizeof(char*));
-
-    //! Проходим по каждому файлу и создаем уникальные временные файлы
-    for (int i = 0; i < fileCount; i++) {
-        char tmpFileName[128];
-        snprintf(tmpFileName, sizeof(tmpFileName), "temp_modifier_%d_%s.wav", i, wavFiles[i]);
-        uniqueTmpFiles[i] = strdup(tmpFileName);
-
-        //! Обрабатываем отдельный файл с заданными параметрами
-        runModifiers(
-            wavFiles[i], 
-            uniqueTmpFiles[i], 
-            pitches[i], 
-            durations[i], 
-            frequencies[i], 
-            depths[i], 
-            starts_fade_in[i], 
-            durations_fade_in[i], 
-            starts_fade_out[i], 
-            durations_fade_out[i],
-            Echo1[i], 
-            Echo2[i], 
-            Echo3[i], 
-            Echo4[i], 
-            chorus[i], 
-            Equalizerf[i], 
-            Equalizert[i], 
-            Equalizerw[i], 
-            Equalizerg[i], 
-            Flanger[i]
-        );
+    const char* outputName = strrchr(target->output, '/');
+    const char* outputBack = strrchr(target->output, '\\');
+    if (!outputName || (outputBack && outputBack > outputName)) outputName = outputBack;
+    WatchState state = { slash ? slash + 1 : scoreFile, outputName ? outputName + 1 : target->output, 0, 0, 0 };
+
+    Watch* w = watch_create();
+    if (!w || watch_add(w, scoreDir) != 0 || watch_add(w, ".") != 1) {
+        printf("Cannot watch %s and the voicebank for changes\n", scoreDir);
+        watch_destroy(w);
+        return 1;
     }
+    signal(SIGINT, on_interrupt);
+    printf("Watching %s for changes, press Ctrl+C to stop\n", scoreFile);
 
-    //! Создаем файл-список для последующего объединения файлов
-    FILE* listFile = fopen("file_list.txt", "w");
-    if (!listFile) {
-        printf("Error creating list file\n");
-        goto cleanup;
-    }
+    while (!stopWatching) {
+        if (watch_wait(w, 500, on_change, &state) < 0) {
+            printf("Watching failed\n");
+            break;
+        }
+        if (!state.scoreChanged && !state.voicebankChanged) continue;
+
+        //! Редактор пишет файл серией событий: ждём, пока они не утихнут
+        while (!stopWatching && watch_wait(w, WATCH_DEBOUNCE_MS, on_change, &state) > 0) {}
+        double quiet = workers_time();
+
+        if (state.voicebankChanged || !*engine) {
+            tts_engine_destroy(*engine);
+            *engine = tts_engine_create(options);
+            if (!*engine) {
+                printf("Cannot read voicebank directory, waiting for the next change\n");
+            } else {
+                printf("Voicebank reloaded: %lu units\n", (unsigned long)tts_engine_unit_count(*engine));
+            }
+        }
 
-    //! Записываем в файл список временных файлов
-    for (int i = 0; i < fileCount; i++) {
-        fprintf(listFile, "file '%s'\n", uniqueTmpFiles[i]);
-    }
-    fclose(listFile);
-
-    //! Формируем команду для объединения файлов через FFmpeg
-    char mergeCmd[MAX_CMD_SIZE];
-    snprintf(mergeCmd, sizeof(mergeCmd), "ffmpeg -y -f concat -safe 0 -i file_list.txt -c copy \"%s\"", output);
-    printf("Final merge command:\n%s\n", mergeCmd);
-    system(mergeCmd);
-
-cleanup:
-    //! Чистим временные файлы и освобождаем память
-    remove("file_list.txt");
-    for (int i = 0; i < fileCount; i++) {
-        remove(uniqueTmpFiles[i]);
-        free(uniqueTmpFiles[i]);
-    }
-    free(uniqueTmpFiles);
+        Score score;
+        int rc = -1;
+        if (!*engine) {
+            //! Рендерить нечем, пока банк не исправят
+        } else if (tts_score_load(scoreFile, &score) != 0) {
+            printf("Cannot read score %s, waiting for the next save\n", scoreFile);
+        } else {
+            rc = render_score(*engine, &score, 0, target);
+            tts_score_free(&score);
+        }
 
-    printf("Files processed successfully into %s\n", output);
+        double done = workers_time();
+        if (rc == 0) {
+            printf("Edit-to-audio latency: %.1f ms (debounce %.1f ms, render and write %.1f ms)\n",
+                (done - state.firstEvent) * 1000, (quiet - state.firstEvent) * 1000, (done - quiet) * 1000);
+        }
+        state.scoreChanged = state.voicebankChanged = 0;
+        state.firstEvent = 0;
+    }
+    watch_destroy(w);
+    return 0; 
 }
+
 /** @brief Главная функция программы, выполняющая чтение параметров и обработку файлов.
  * Читает конфигурационные данные из файла "output.txt", проходит по каждому
  * указанному файлу, применяет нужные параметры * обработки и объединяет обработанные файлы в один общий файл.
+ * Ключ --backend=ffmpeg включает эталонную обработку через FFmpeg вместо встроенного движка,
+ * ключ --backend=ffmpeg-graph — то же одним процессом FFmpeg на весь рендер,
+ * ключ --threads=N задаёт число потоков рендера (по умолчанию — по числу ядер).
+ * Ключи --cache-dir=DIR и --cache-max-mb=N настраивают кэш обработанных слогов, --no-cache его отключает.
+ * Ключ --score=FILE задаёт другой файл партитуры; двоичная партитура (output.score) распознаётся по сигнатуре.
+ * Ключ --trace=FILE записывает трассировку слогов и этапов цепочки эффектов (Chrome trace-event) и печатает сводку.
+ * Ключ --full обрабатывает все слоги заново, не заглядывая в прошлый результат.
+ * Ключ --watch после первого рендера следит за партитурой и голосовым банком и перерисовывает
+ * результат после каждого сохранения, печатая задержку от правки до готового звука.
+ * Ключ --max-memory-mb=N рендерит партитуру окнами прямо в файл результата, не держа весь звук в памяти.
+ * Ключ --output=FILE задаёт файл результата вместо voicebank/done/output.wav.
  * @return Код возврата (0 — успешное завершение, другое — ошибка). */
-int main() {
-    char **fileNames = NULL;
-    int *pitches = NULL;
-    float *durations = NULL;
-    int *frequencies = NULL;  
-    float *depths = NULL;      
-    float *starts_fade_in = NULL; 
-    float *durations_fade_in = NULL; 
-    float *starts_fade_out = NULL; 
-    float *durations_fade_out = NULL; 
-    float* Echo1 = NULL;
-    float* Echo2 = NULL;
-    float* Echo3 = NULL;
-    float* Echo4 = NULL;
-    float* chorus = NULL;
-    float* Equalizerf = NULL; 
-    float* Equalizert = NULL;
-    float* Equalizerw = NULL;
-    float* Equalizerg = NULL;
-
-    float* Flanger = NULL;
-
-
-
-    int fileCount = 0;
-
-    FILE *inputFile = fopen("output.txt", "r");
-    if (!inputFile) {
-        printf("Cannot open input.txt\n");
-        return 1;
-    }
-
-    _chdir("voicebank"); 
-
-    char filenameLine[256];
-    char pitchLine[256];
-    char durationLine[256];
-    char frequencyLine[256];
-    char depthLine[256];     
-    char startFadeInLine[256]; 
-    char durationFadeInLine[256]; 
-    char startFadeOutLine[256]; 
-    char durationFadeOutLine[256]; 
-
-    char Echo1Line[256];
-    char Echo2Line[256];
-    char Echo3Line[256];
-    char Echo4Line[256];
-    char chorusLine[256];
-    char EqualizerfLine[256];
-    char EqualizertLine[256];
-    char EqualizerwLine[256];
-    char EqualizergLine[256];
-
-    char FlangeLine[256];
-
-    while (fgets(filenameLine, sizeof(filenameLine), inputFile)) {
-     
-        filenameLine[strcspn(filenameLine, "\r\n")] = 0;
-        
-        if (strlen(filenameLine) == 0) {
-            continue;
+int main(int argc, char** argv) {
+    TtsOptions options;
+    tts_default_options(&options);
+    options.voicebank_dir = ".";    //!< Работаем из каталога voicebank, как и раньше
+    options.cache_dir = "cache";    //!< Каталог кэша (--cache-dir=), относительно voicebank/
+    options.verbose = 1;
+    const char* scorePath = "output.txt"; //!< Файл партитуры (--score=), текстовый или двоичный
+    const char* tracePath = NULL;         //!< Файл трассировки (--trace=)
+    int full = 0;                         //!< Не использовать прошлый результат (--full)
+    int watch = 0;                        //!< Следить за изменениями (--watch)
+    const char* outputPath = NULL;        //!< Файл результата (--output=), по умолчанию voicebank/done/output.wav
+    OutputTarget target = { "done/output.wav", NULL, 0 };
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--backend=ffmpeg") == 0) {
+            options.backend = TTS_BACKEND_FFMPEG;
+        } else if (strcmp(argv[i], "--backend=ffmpeg-graph") == 0) {
+            options.backend = TTS_BACKEND_FFMPEG_GRAPH;
+        } else if (strcmp(argv[i], "--backend=native") == 0) {
+            options.backend = TTS_BACKEND_NATIVE;
+        } else if (strncmp(argv[i], "--threads=", 10) == 0) {
+            options.threads = atoi(argv[i] + 10);
+        } else if (strncmp(argv[i], "--cache-dir=", 12) == 0) {
+            options.cache_dir = argv[i] + 12;
+        } else if (strncmp(argv[i], "--cache-max-mb=", 15) == 0) {
+            options.cache_max_mb = strtoul(argv[i] + 15, NULL, 10);
+        } else if (strcmp(argv[i], "--no-cache") == 0) {
+            options.cache_enabled = 0;
+        } else if (strncmp(argv[i], "--score=", 8) == 0) {
+            scorePath = argv[i] + 8;
+        } else if (strncmp(argv[i], "--trace=", 8) == 0) {
+            tracePath = argv[i] + 8;
+        } else if (strcmp(argv[i], "--full") == 0) {
+            full = 1;
+        } else if (strncmp(argv[i], "--max-memory-mb=", 16) == 0) {
+            target.maxMemory = (size_t)strtoul(argv[i] + 16, NULL, 10) << 20;
+        } else if (strncmp(argv[i], "--output=", 9) == 0) {
+            outputPath = argv[i] + 9;
+        } else if (strcmp(argv[i], "--watch") == 0) {
+            watch = 1;
+            options.verbose = 0; //!< В цикле правок важна задержка, а не ход каждого слога
+        } else {
+            printf("Unknown option: %s\n", argv[i]);
+            return 1;
         }
+    }
 
-        if (!fgets(pitchLine, sizeof(pitchLine), inputFile)) break;
-        pitchLine[strcspn(pitchLine, "\r\n")] = 0;
-
-        if (!fgets(durationLine, sizeof(durationLine), inputFile)) break;
-        durationLine[strcspn(durationLine, "\r\n")] = 0;
-
-        if (!fgets(frequencyLine, sizeof(frequencyLine), inputFile)) break;
-        frequencyLine[strcspn(frequencyLine, "\r\n")] = 0;
-
-        if (!fgets(depthLine, sizeof(depthLine), inputFile)) break;
-        depthLine[strcspn(depthLine, "\r\n")] = 0;
-
-        if (!fgets(startFadeInLine, sizeof(startFadeInLine), inputFile)) break;
-        startFadeInLine[strcspn(startFadeInLine, "\r\n")] = 0;
-
-        if (!fgets(durationFadeInLine, sizeof(durationFadeInLine), inputFile)) break;
-        durationFadeInLine[strcspn(durationFadeInLine, "\r\n")] = 0;
-
-        if (!fgets(startFadeOutLine, sizeof(startFadeOutLine), inputFile)) break;
-        startFadeOutLine[strcspn(startFadeOutLine, "\r\n")] = 0;
-
-        if (!fgets(durationFadeOutLine, sizeof(durationFadeOutLine), inputFile)) break;
-        durationFadeOutLine[strcspn(durationFadeOutLine, "\r\n")] = 0;
-
-        if (!fgets(Echo1Line, sizeof(Echo1Line), inputFile)) break;
-        Echo1Line[strcspn(Echo1Line, "\r\n")] = 0;
-
-        if (!fgets(Echo2Line, sizeof(Echo2Line), inputFile)) break;
-        Echo2Line[strcspn(Echo2Line, "\r\n")] = 0;
-
-        if (!fgets(Echo3Line, sizeof(Echo3Line), inputFile)) break;
-        Echo3Line[strcspn(Echo3Line, "\r\n")] = 0;
-
-        if (!fgets(Echo4Line, sizeof(Echo4Line), inputFile)) break;
-        Echo4Line[strcspn(Echo4Line, "\r\n")] = 0;
-
-        if (!fgets(chorusLine, sizeof(chorusLine), inputFile)) break;
-        chorusLine[strcspn(chorusLine, "\r\n")] = 0;
-
-                if (!fgets(EqualizerfLine, sizeof(EqualizerfLine), inputFile)) break;
-        EqualizerfLine[strcspn(EqualizerfLine, "\r\n")] = 0;
-
-        if (!fgets(EqualizertLine, sizeof(EqualizertLine), inputFile)) break;
-        EqualizertLine[strcspn(EqualizertLine, "\r\n")] = 0;
-
-        if (!fgets(EqualizerwLine, sizeof(EqualizerwLine), inputFile)) break;
-        EqualizerwLine[strcspn(EqualizerwLine, "\r\n")] = 0;
-
-        if (!fgets(EqualizergLine, sizeof(EqualizergLine), inputFile)) break;
-        EqualizergLine[strcspn(EqualizergLine, "\r\n")] = 0;
-
-        if (!fgets(FlangeLine, sizeof(FlangeLine), inputFile)) break;
-        FlangeLine[strcspn(FlangeLine, "\r\n")] = 0;
-
-        //@{
-        //! Чтение и обработка строк с параметрами эквалайзера и фленджер.
-        //! Преобразование строк в числовую форму.
-        int pitch = atoi(pitchLine);
-        float duration = atof(durationLine);
-        int freq_vibro = atoi(frequencyLine); 
-        float depth_vibro = atof(depthLine);        
-        float start_fade_in = atof(startFadeInLine); 
-        float duration_fade_in = atof(durationFadeInLine);
-        float start_fade_out = atof(startFadeOutLine); 
-        float duration_fade_out = atof(durationFadeOutLine); 
-
-        float echo1_val = atof(Echo1Line); //!< Значение первого параметра эха.
-        float echo2_val = atof(Echo2Line); //!< Значение второго параметра эха.
-        float echo3_val = atof(Echo3Line); //!< Значение третьего параметра эха.
-        float echo4_val = atof(Echo4Line); //!< Значение четвёртого параметра эха.
-        float chorus_val = atof(chorusLine); //!< Значение параметра хоруса.
-        float equalizerf = atof(EqualizerfLine); //!< Центральная частота эквалайзера.
-        float equalizert = atof(EqualizertLine); //!< Тип эквалайзера.
-        float equalizerw = atof(EqualizerwLine); //!< Ширина полосы эквалайзера.
-        float equalizerg = atof(EqualizergLine); //!< Усиление эквалайзера.
-
-        float flange_val = atof(FlangeLine); //!< Значение задержки для эффекта фленджер.
-        //@}
-
-        //! Ограничение изменения тональности в пределах ±36 полутонов.
-        if (pitch < -36 || pitch > 36) {
-            pitch = 0;
-        }
+    if (tracePath && trace_start(tracePath) != 0) {
+        printf("Cannot create trace file %s\n", tracePath);
+        return 1;
+    }
 
-        //! Увеличение размера массивов под очередную запись.
-        fileNames = realloc(fileNames, (fileCount + 1) * sizeof(char*));
-        pitches = realloc(pitches, (fileCount + 1) * sizeof(int));
-        durations = realloc(durations, (fileCount + 1) * sizeof(float));
-        frequencies = realloc(frequencies, (fileCount + 1) * sizeof(int)); //!< Частоты вибрато.
-        depths = realloc(depths, (fileCount + 1) * sizeof(float));         //!< Глубины вибрато.
-        starts_fade_in = realloc(starts_fade_in, (fileCount + 1) * sizeof(float)); //!< Начальные точки Fade-In.
-        durations_fade_in = realloc(durations_fade_in, (fileCount + 1) * sizeof(float)); //!< Длительности Fade-In.
-        starts_fade_out = realloc(starts_fade_out, (fileCount + 1) * sizeof(float)); //!< Начальные точки Fade-Out.
-        durations_fade_out = realloc(durations_fade_out, (fileCount + 1) * sizeof(float)); //!< Длительности Fade-Out.
-
-        Echo1 = realloc(Echo1, (fileCount + 1) * sizeof(float));          //!< Echo1.
-        Echo2 = realloc(Echo2, (fileCount + 1) * sizeof(float));          //!< Echo2.
-        Echo3 = realloc(Echo3, (fileCount + 1) * sizeof(float));          //!< Echo3.
-        Echo4 = realloc(Echo4, (fileCount + 1) * sizeof(float));          //!< Echo4.
-        chorus = realloc(chorus, (fileCount + 1) * sizeof(float));        //!< Intensity of chorus effect.
-        Equalizerf = realloc(Equalizerf, (fileCount + 1) * sizeof(float)); //!< Эквалайзер (частота).
-        Equalizert = realloc(Equalizert, (fileCount + 1) * sizeof(float)); //!< Эквалайзер (тип).
-        Equalizerw = realloc(Equalizerw, (fileCount + 1) * sizeof(float)); //!< Эквалайзер (полоса пропускания).
-        Equalizerg = realloc(Equalizerg, (fileCount + 1) * sizeof(float)); //!< Эквалайзер (усиление).
-
-        Flanger = realloc(Flanger, (fileCount + 1) * sizeof(float));      //!< Delay value for flanger effect.
-
-        //! Присваивание нового имени файла с форматом `.wav`
-        size_t len = strlen(filenameLine);
-        fileNames[fileCount] = malloc(len + 5); // Осталось место для расширения ".wav"
-        snprintf(fileNames[fileCount], len + 5, "%s.wav", filenameLine);
-        pitches[fileCount] = pitch;
-        durations[fileCount] = duration;
-        frequencies[fileCount] = freq_vibro; //!< Частота вибрато.
-        depths[fileCount] = depth_vibro;     //!< Глубина вибрато.
-        starts_fade_in[fileCount] = start_fade_in; //!< Start point of fade-in.
-        durations_fade_in[fileCount] = duration_fade_in; //!< Fade-in duration.
-        starts_fade_out[fileCount] = start_fade_out; //!< Start point of fade-out.
-        durations_fade_out[fileCount] = duration_fade_out; //!< Fade-out duration.
-
-        Echo1[fileCount] = echo1_val;           //!< Echo1 coefficient.
-        Echo2[fileCount] = echo2_val;           //!< Echo2 coefficient.
-        Echo3[fileCount] = echo3_val;           //!< Echo3 coefficient.
-        Echo4[fileCount] = echo4_val;           //!< Echo4 coefficient.
-        chorus[fileCount] = chorus_val;         //!< Chorus intensity.
-        Equalizerf[fileCount] = equalizerf;     //!< Equilizer central frequency.
-        Equalizert[fileCount] = equalizert;     //!< Equilizer type.
-        Equalizerw[fileCount] = equalizerw;     //!< Equilizer bandwidth.
-        Equalizerg[fileCount] = equalizerg;     //!< Equilizer gain.
-
-        Flanger[fileCount] = flange_val;        //!< Flanger delay parameter.
-
-        fileCount++; // Переходим к следующей итерации обработки
+    //! Читаем партитуру: имя слога и 18 значений параметров на запись
+    Score score;
+    if (tts_score_load(scorePath, &score) != 0) {
+        printf("Cannot read score %s\n", scorePath);
+        return 1;
     }
 
-    fclose(inputFile); // Закрытие открытого файла
+    if (score.count == 0) { // Нет записей для обработки
+        printf("No input files found in %s\n", scorePath);
+        tts_score_free(&score);
+        return 1;
+    }
 
-    if (fileCount == 0) { // Нет записей для обработки
-        printf("No input files found in input.txt\n");
+    //! После перехода в voicebank/ относительный путь к партитуре отсчитывается на уровень выше
+    char scoreFile[1024];
+    int absolute = scorePath[0] == '/' || scorePath[0] == '\\' || (scorePath[0] && scorePath[1] == ':');
+    snprintf(scoreFile, sizeof(scoreFile), "%s%s", absolute ? "" : "../", scorePath);
+
+    //! Так же и путь результата; манифест лежит рядом с ним: done/output.wav — done/output.manifest
+    char outputFile[1024], manifestFile[1040];
+    if (outputPath) {
+        absolute = outputPath[0] == '/' || outputPath[0] == '\\' || (outputPath[0] && outputPath[1] == ':');
+        snprintf(outputFile, sizeof(outputFile), "%s%s", absolute ? "" : "../", outputPath);
+        target.output = outputFile;
+    }
+    size_t stem = strlen(target.output);
+    if (stem > 4 && strcmp(target.output + stem - 4, ".wav") == 0) stem -= 4;
+    snprintf(manifestFile, sizeof(manifestFile), "%.*s.manifest", (int)stem, target.output);
+    target.manifest = manifestFile;
+
+    _chdir("voicebank");
+
+    //! Один раз загружаем голосовой банк
+    TtsEngine* engine = tts_engine_create(&options);
+    if (!engine) {
+        printf("Cannot read voicebank directory\n");
+        tts_score_free(&score);
         return 1;
     }
+    printf("Voicebank: %lu units loaded\n", (unsigned long)tts_engine_unit_count(engine));
 
-    //! Выполнение процедуры объединения файлов с результатами обработки
-    merge_wav_files(
-        (const char**)fileNames, 
-        pitches, 
-        durations, 
-        frequencies, 
-        depths, 
-        starts_fade_in, 
-        durations_fade_in, 
-        starts_fade_out, 
-        durations_fade_out, 
-        
-        Echo1,
-        Echo2,
-        Echo3,
-        Echo4,
-        chorus,
-        Equalizerf,
-        Equalizert,
-        Equalizerw,
-        Equalizerg,
-
-        Flanger,
-
-        fileCount, 
-        "output.wav"
-    );
-
-    if (fileCount > 0) { // Если были успешно обработаны файлы
-        char srcPath[] = "output.wav"; //!< Источник для копирования.
-        char destPath[] = "done/output.wav"; //!< Назначение (каталог назначения).
-
-        //! Создаём папку "done", если она не существует
-        CreateDirectoryA("done", NULL);
-
-        //! Копируем итоговый файл в папку "done"
-        BOOL success = CopyFile(srcPath, destPath, FALSE); // Если true, заменяется существующий файл
-        if (!success) {
-            DWORD errorCode = GetLastError(); //!< Получаем код последней ошибки.
-            printf("error(copy file) (%lu)\n", errorCode);
-        } else {
-            printf("file in 'done'.\n");
-        }
+    int rc = render_score(engine, &score, full, &target);
+    tts_score_free(&score);
+    if (rc != 0 && !watch) {
+        tts_engine_destroy(engine);
+        return 1;
     }
 
+    if (watch) watch_score(&engine, &options, scoreFile, &target);
+
+    trace_stop(); //!< Пишет файл трассировки и печатает сводку, если она включена
+
     //! Освобождение памяти после завершения работы
-    for (int i = 0; i < fileCount; i++) {
-        free(fileNames[i]); //!< Освобождаем память под каждое имя файла.
-    }
-    free(fileNames); //!< Освобождаем основной массив.
-    free(pitches); //!< Освобождаем массив тональностей.
-    free(durations); //!< Освобождаем массив длительностей.
-    free(frequencies); //!< Освобождаем массив частот вибрато.
-    free(depths); //!< Освобождаем массив глубин вибрато.
-    free(starts_fade_in); //!< Освобождаем массив начальных моментов Fade-In.
-    free(durations_fade_in); //!< Освобождаем массив длительностей Fade-In.
-    free(starts_fade_out); //!< Освобождаем массив начальных моментов Fade-Out.
-    free(durations_fade_out); //!< Освобождаем массив длительностей Fade-Out.
-
-    free(Echo1); //!< Освобождаем массив коэффициентов Echo1.
-    free(Echo2); //!< Освобождаем массив коэффициентов Echo2.
-    free(Echo3); //!< Освобождаем массив коэффициентов Echo3.
-    free(Echo4); //!< Освобождаем массив коэффициентов Echo4.
-    free(chorus); //!< Освобождаем массив интенсивностей хоруса.
-    free(Equalizerf); //!< Освобождаем массив центральных частот эквалайзера.
-    free(Equalizert); //!< Освобождаем массив типов эквалайзера.
-    free(Equalizerw); //!< Освобождаем массив ширины эквалайзера.
-    free(Equalizerg); //!< Освобождаем массив усилений эквалайзера.
-
-    free(Flanger); //!< Освобождаем массив задержек для эффекта фленджер.
+    if (engine) tts_engine_print_stats(engine);
+    tts_engine_destroy(engine); //!< Сохраняем индекс кэша и освобождаем голосовой банк.
 
     return 0; 
-}
\ No newline at end of file
+}
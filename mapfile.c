@@ -0,0 +1,91 @@
+/**
+ * @file mapfile.c
+ * @brief Отображение файла в память: MapViewOfFile в Windows, mmap в POSIX.
+ */
+
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#include "mapfile.h"
+
+#ifdef _WIN32
+
+int map_file_open(MappedFile* map, const char* path) {
+    memset(map, 0, sizeof(*map));
+
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) return -1;
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size)) {
+        CloseHandle(file);
+        return -1;
+    }
+    map->file = file;
+    map->size = (size_t)size.QuadPart;
+    if (map->size == 0) {
+        return 0; //!< Пустой файл отобразить нельзя, но это не ошибка
+    }
+
+    HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (!mapping) {
+        CloseHandle(file);
+        return -1;
+    }
+    map->mapping = mapping;
+    map->data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (!map->data) {
+        CloseHandle(mapping);
+        CloseHandle(file);
+        return -1;
+    }
+    return 0;
+}
+
+void map_file_close(MappedFile* map) {
+    if (map->data) UnmapViewOfFile(map->data);
+    if (map->mapping) CloseHandle(map->mapping);
+    if (map->file) CloseHandle(map->file);
+    memset(map, 0, sizeof(*map));
+}
+
+#else
+
+int map_file_open(MappedFile* map, const char* path) {
+    memset(map, 0, sizeof(*map));
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return -1;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return -1;
+    }
+    map->size = (size_t)st.st_size;
+    if (map->size > 0) {
+        void* data = mmap(NULL, map->size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED) {
+            close(fd);
+            return -1;
+        }
+        map->data = data;
+    }
+    close(fd); //!< Отображение остаётся действительным и после закрытия дескриптора
+    return 0;
+}
+
+void map_file_close(MappedFile* map) {
+    if (map->data) munmap((void*)map->data, map->size);
+    memset(map, 0, sizeof(*map));
+}
+
+#endif
@@ -0,0 +1,35 @@
+/**
+ * @file mapfile.h
+ * @brief Отображение файла в память только для чтения.
+ *
+ * Файл не копируется и не разбирается: данные подкачиваются операционной системой
+ * по мере обращения к ним.
+ */
+
+#ifndef MAPFILE_H
+#define MAPFILE_H
+
+#include <stddef.h>
+
+/** @brief Отображённый в память файл. */
+typedef struct {
+    const void* data;   ///< Содержимое файла (NULL для пустого файла)
+    size_t size;        ///< Размер файла в байтах
+#ifdef _WIN32
+    void* file;         ///< Дескриптор файла (HANDLE)
+    void* mapping;      ///< Дескриптор отображения (HANDLE)
+#endif
+} MappedFile;
+
+/**
+ * @brief Отображает файл в память только для чтения.
+ * @param[out] map Отображение (освобождается map_file_close()).
+ * @param[in] path Путь к файлу.
+ * @return 0 при успехе, -1 если файл не удалось открыть или отобразить.
+ */
+int map_file_open(MappedFile* map, const char* path);
+
+/** @brief Снимает отображение и закрывает файл. */
+void map_file_close(MappedFile* map);
+
+#endif /* MAPFILE_H */
@@ -0,0 +1,98 @@
+/**
+ * @file outfile.c
+ * @brief Атомарная запись файла результата: MoveFileExA в Windows, rename() в POSIX.
+ */
+
+#ifdef _WIN32
+#ifndef _WIN32_WINNT
+#define _WIN32_WINNT 0x0600 //!< SetFileInformationByHandle() — с Windows Vista
+#endif
+#else
+#define _GNU_SOURCE //!< fallocate() в Linux
+#endif
+
+#include <stdio.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <direct.h>
+#include <io.h>
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#endif
+
+#include "outfile.h"
+
+/** @brief Создаёт каталог, в котором лежит path, со всеми недостающими уровнями (как mkdir -p). */
+static void make_parent_dir(const char* path) {
+    char dir[1024];
+    snprintf(dir, sizeof(dir), "%s", path);
+    //! Уровни создаются по порядку от корня; ошибки mkdir не проверяются: если каталога так и нет, это покажет fopen()
+    for (char* p = dir + 1; *p; p++) {
+        if (*p != '/' && *p != '\\') continue;
+        if (p[-1] == ':' || p[-1] == '/' || p[-1] == '\\') continue; //!< "C:\", "//": создавать нечего
+        char separator = *p;
+        *p = '\0';
+#ifdef _WIN32
+        _mkdir(dir);
+#else
+        mkdir(dir, 0777);
+#endif
+        *p = separator;
+    }
+}
+
+/** @brief Резервирует место под файл, не меняя его длины: запись не дробит файл и не упирается в нехватку места на середине. */
+static void reserve_space(FILE* file, uint64_t size) {
+#if defined(_WIN32)
+    FILE_ALLOCATION_INFO info;
+    info.AllocationSize.QuadPart = (LONGLONG)size;
+    SetFileInformationByHandle((HANDLE)_get_osfhandle(_fileno(file)), FileAllocationInfo, &info, sizeof(info));
+#elif defined(__linux__)
+    fallocate(fileno(file), FALLOC_FL_KEEP_SIZE, 0, (off_t)size);
+#else
+    (void)file;
+    (void)size;
+#endif
+}
+
+int output_open(OutputFile* out, const char* path, uint64_t size) {
+    memset(out, 0, sizeof(*out));
+    snprintf(out->path, sizeof(out->path), "%s", path);
+    snprintf(out->part, sizeof(out->part), "%s.part", path);
+
+    make_parent_dir(path);
+    out->file = fopen(out->part, "wb");
+    if (!out->file) return -1;
+    setvbuf(out->file, NULL, _IOFBF, OUTPUT_BUFFER);
+    if (size > 0) reserve_space(out->file, size);
+    return 0;
+}
+
+int output_commit(OutputFile* out) {
+    if (!out->file) return -1;
+    int ok = fflush(out->file) == 0;
+#if defined(__linux__)
+    //! Место, выделенное сверх фактической длины, возвращается файловой системе
+    struct stat st;
+    if (ok && fstat(fileno(out->file), &st) == 0) ok = ftruncate(fileno(out->file), st.st_size) == 0;
+#endif
+    if (fclose(out->file) != 0) ok = 0;
+    out->file = NULL;
+#ifdef _WIN32
+    ok = ok && MoveFileExA(out->part, out->path, MOVEFILE_REPLACE_EXISTING);
+#else
+    ok = ok && rename(out->part, out->path) == 0;
+#endif
+    if (!ok) remove(out->part);
+    return ok ? 0 : -1;
+}
+
+void output_abort(OutputFile* out) {
+    if (out->file) fclose(out->file);
+    out->file = NULL;
+    remove(out->part);
+}
@@ -0,0 +1,45 @@
+/**
+ * @file outfile.h
+ * @brief Атомарная запись файла результата.
+ *
+ * Файл пишется один раз во временный `<путь>.part` рядом с назначением, крупными
+ * буферизованными блоками и с заранее выделенным местом на диске, а затем
+ * переименовывается на место назначения. Читатели видят либо прежний файл целиком,
+ * либо новый целиком; после ошибки прежний файл остаётся нетронутым.
+ */
+
+#ifndef OUTFILE_H
+#define OUTFILE_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#define OUTPUT_BUFFER (1 << 20) ///< Буфер записи, байт
+
+/** @brief Файл результата в процессе записи. */
+typedef struct {
+    FILE* file;         ///< Временный файл, открытый для записи
+    char path[1024];    ///< Путь назначения
+    char part[1040];    ///< Путь временного файла
+} OutputFile;
+
+/**
+ * @brief Создаёт временный файл для path.
+ *  Каталог назначения создаётся со всеми недостающими уровнями.
+ * @param[in] size Ожидаемый размер файла для предварительного выделения, 0 — неизвестен.
+ *  Это лишь подсказка: файл может получиться и короче, и длиннее.
+ * @return 0 при успехе, -1 если файл не создаётся.
+ */
+int output_open(OutputFile* out, const char* path, uint64_t size);
+
+/**
+ * @brief Закрывает временный файл и переименовывает его в путь назначения,
+ *  заменяя прежний файл. При ошибке временный файл удаляется.
+ * @return 0 при успехе, -1 при ошибке записи или переименования.
+ */
+int output_commit(OutputFile* out);
+
+/** @brief Закрывает и удаляет временный файл, не трогая путь назначения. */
+void output_abort(OutputFile* out);
+
+#endif /* OUTFILE_H */
@@ -0,0 +1,342 @@
+/**
+ * @file pitchmarks.c
+ * @brief Анализ основного тона (нормированная автокорреляция) и файл-спутник с метками.
+ *
+ * Тон ищется по кадрам с шагом 10 мс: сначала грубо на сигнале, прореженном в 4 раза,
+ * затем уточняется на полной частоте около найденного периода. Из нескольких пиков
+ * автокорреляции берётся самый короткий период, близкий к лучшему, — так не
+ * путаются октавы. Метки ставятся на максимум сигнала в каждом периоде.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "pitchmarks.h"
+
+#define PITCH_HOP 441          ///< Шаг кадров анализа и неозвученных меток, отсчётов (10 мс)
+#define PITCH_WINDOW 2048      ///< Окно автокорреляции, отсчётов
+#define PITCH_DECIMATE 4       ///< Прореживание при грубом поиске
+#define PITCH_MIN_HZ 60        ///< Нижняя граница основного тона
+#define PITCH_MAX_HZ 500       ///< Верхняя граница основного тона
+#define PITCH_VOICED 0.45      ///< Порог автокорреляции для озвученного кадра
+#define PITCH_SILENCE 0.02     ///< Кадры тише этой доли самого громкого считаются неозвученными
+
+/** @brief Заголовок файла-спутника (little-endian). */
+typedef struct {
+    char magic[8];        ///< "TTSPMK\0\0"
+    uint32_t version;     ///< PITCHMARKS_VERSION
+    uint32_t unit_count;  ///< Записей единиц
+} PitchFileHeader;
+
+/** @brief Запись единицы; за ней следуют имя (name_len байт) и mark_count меток PitchMark. */
+typedef struct {
+    uint64_t unit_hash;   ///< Хеш содержимого единицы на момент анализа
+    float f0;             ///< Медианная частота основного тона, Гц
+    uint32_t mark_count;  ///< Количество меток
+    uint32_t name_len;    ///< Длина имени без нуля
+    uint32_t reserved;
+} PitchFileUnit;
+
+static const char pitch_magic[8] = { 'T', 'T', 'S', 'P', 'M', 'K', 0, 0 };
+
+/** @brief Формат хранится в little-endian; на машинах с другим порядком байт он не поддерживается. */
+static int host_is_little_endian(void) {
+    const uint16_t probe = 1;
+    return *(const unsigned char*)&probe == 1;
+}
+
+/** @brief Хеш меток для ключа кэша: FNV-1a по меткам и частоте основного тона. */
+static uint64_t hash_marks(const PitchMarks* m) {
+    uint64_t h = 14695981039346656037ull;
+    for (size_t i = 0; i < m->count; i++) {
+        h = (h ^ m->marks[i].pos) * 1099511628211ull;
+        h = (h ^ m->marks[i].period) * 1099511628211ull;
+    }
+    uint32_t f0;
+    memcpy(&f0, &m->f0, sizeof(f0));
+    return (h ^ f0) * 1099511628211ull;
+}
+
+/**
+ * @brief Нормированная автокорреляция x[0..n) с x[lag..lag+n).
+ *  Возвращает 0 для тишины, чтобы она не считалась периодической.
+ */
+static double nccf(const float* x, size_t n, size_t lag) {
+    double xy = 0, xx = 0, yy = 0;
+    for (size_t i = 0; i < n; i++) {
+        xy += (double)x[i] * x[i + lag];
+        xx += (double)x[i] * x[i];
+        yy += (double)x[i + lag] * x[i + lag];
+    }
+    return xx > 0 && yy > 0 ? xy / sqrt(xx * yy) : 0.0;
+}
+
+/**
+ * @brief Период кадра: грубый поиск по прореженному сигналу и уточнение на полной частоте.
+ * @param[in] x Моно-сигнал.
+ * @param[in] xd Прореженный сигнал.
+ * @param[in] start Начало окна кадра.
+ * @param[in] n Длина окна (start + n + наибольший период не выходит за сигнал).
+ * @return Период в отсчётах или 0, если кадр неозвучен.
+ */
+static uint32_t frame_period(const float* x, const float* xd, size_t start, size_t n, int sample_rate) {
+    size_t min_lag = (size_t)(sample_rate / PITCH_MAX_HZ) / PITCH_DECIMATE;
+    size_t max_lag = (size_t)(sample_rate / PITCH_MIN_HZ) / PITCH_DECIMATE;
+    size_t nd = n / PITCH_DECIMATE;
+    const float* fd = xd + start / PITCH_DECIMATE;
+
+    double r[PITCH_WINDOW];   //!< При 44100 Гц max_lag около 184
+    if (max_lag >= PITCH_WINDOW) max_lag = PITCH_WINDOW - 1;
+    double best = 0;
+    for (size_t lag = min_lag; lag <= max_lag; lag++) {
+        r[lag] = nccf(fd, nd, lag);
+        if (r[lag] > best) best = r[lag];
+    }
+    if (best < PITCH_VOICED) return 0;
+
+    //! Самый короткий локальный максимум, близкий к лучшему: защита от удвоения периода
+    size_t coarse = 0;
+    for (size_t lag = min_lag; lag < max_lag && !coarse; lag++) {
+        int peak = (lag == min_lag || r[lag] >= r[lag - 1]) && r[lag] >= r[lag + 1];
+        if (peak && r[lag] >= 0.9 * best) coarse = lag;
+    }
+    if (!coarse) return 0;
+
+    size_t period = 0;
+    double refined = -1;
+    for (size_t lag = (coarse - 1) * PITCH_DECIMATE; lag <= (coarse + 1) * PITCH_DECIMATE; lag++) {
+        double v = nccf(x + start, n, lag);
+        if (v > refined) {
+            refined = v;
+            period = lag;
+        }
+    }
+    return refined >= PITCH_VOICED ? (uint32_t)period : 0;
+}
+
+/** @brief Добавляет метку, расширяя массив при необходимости. */
+static int add_mark(PitchMarks* m, size_t* allocated, uint32_t pos, uint32_t period) {
+    if (m->count == *allocated) {
+        size_t grown_size = *allocated ? *allocated * 2 : 256;
+        PitchMark* grown = realloc(m->marks, grown_size * sizeof(PitchMark));
+        if (!grown) return -1;
+        m->marks = grown;
+        *allocated = grown_size;
+    }
+    m->marks[m->count].pos = pos;
+    m->marks[m->count].period = period;
+    m->count++;
+    return 0;
+}
+
+static int compare_float(const void* a, const void* b) {
+    float x = *(const float*)a, y = *(const float*)b;
+    return x < y ? -1 : x > y;
+}
+
+int pitchmarks_analyze(const AudioBuffer* audio, PitchMarks* out) {
+    memset(out, 0, sizeof(*out));
+    size_t frames = audio->frames;
+    int ch = audio->channels;
+    size_t max_period = (size_t)(audio->sample_rate / PITCH_MIN_HZ) + 2 * PITCH_DECIMATE;
+    size_t frame_count = frames / PITCH_HOP + 1;
+
+    float* x = malloc((frames + 1) * sizeof(float));
+    float* xd = malloc((frames / PITCH_DECIMATE + 1) * sizeof(float));
+    uint32_t* periods = calloc(frame_count, sizeof(uint32_t));
+    float* energy = calloc(frame_count, sizeof(float));
+    float* f0s = malloc(frame_count * sizeof(float));
+    if (!x || !xd || !periods || !energy || !f0s) goto fail;
+
+    //! Моно и прореживание усреднением — грубый фильтр нижних частот
+    for (size_t i = 0; i < frames; i++) {
+        float s = 0;
+        for (int c = 0; c < ch; c++) s += audio->samples[i * ch + c];
+        x[i] = s / ch;
+    }
+    for (size_t i = 0; i + PITCH_DECIMATE <= frames; i += PITCH_DECIMATE) {
+        float s = 0;
+        for (int k = 0; k < PITCH_DECIMATE; k++) s += x[i + k];
+        xd[i / PITCH_DECIMATE] = s / PITCH_DECIMATE;
+    }
+
+    //! Громкость кадров: тихие кадры не анализируются
+    float loudest = 0;
+    for (size_t f = 0; f < frame_count; f++) {
+        size_t from = f * PITCH_HOP, to = from + PITCH_HOP < frames ? from + PITCH_HOP : frames;
+        double e = 0;
+        for (size_t i = from; i < to; i++) e += (double)x[i] * x[i];
+        energy[f] = to > from ? (float)sqrt(e / (to - from)) : 0.0f;
+        if (energy[f] > loudest) loudest = energy[f];
+    }
+
+    //! Период каждого кадра; окно центрировано на начале кадра и прижато к краям сигнала
+    for (size_t f = 0; f < frame_count; f++) {
+        if (energy[f] < PITCH_SILENCE * loudest || energy[f] < 1e-4f) continue;
+        size_t center = f * PITCH_HOP;
+        size_t start = center > PITCH_WINDOW / 2 ? center - PITCH_WINDOW / 2 : 0;
+        start -= start % PITCH_DECIMATE;
+        if (start + PITCH_WINDOW + max_period > frames) {
+            start = frames > PITCH_WINDOW + max_period ? frames - PITCH_WINDOW - max_period : 0;
+            start -= start % PITCH_DECIMATE;
+        }
+        size_t n = frames - start > max_period ? frames - start - max_period : 0;
+        if (n > PITCH_WINDOW) n = PITCH_WINDOW;
+        if (n < PITCH_WINDOW / 2) continue;
+        periods[f] = frame_period(x, xd, start, n, audio->sample_rate);
+    }
+
+    //! Одиночные скачки периода между озвученными соседями сглаживаются медианой по трём
+    for (size_t f = 1; f + 1 < frame_count; f++) {
+        uint32_t a = periods[f - 1], b = periods[f], c = periods[f + 1];
+        if (!a || !b || !c) continue;
+        uint32_t median = a > b ? (b > c ? b : (a > c ? c : a)) : (a > c ? a : (b > c ? c : b));
+        if (median != b && (b > median * 3 / 2 || b < median * 2 / 3)) periods[f] = median;
+    }
+
+    //! Обход меток: в озвученных участках — пик каждого периода, в неозвученных — шаг PITCH_HOP
+    size_t allocated = 0, voiced = 0;
+    size_t pos = 0;
+    long last = -1;
+    int was_voiced = 0;
+    while (pos < frames) {
+        size_t f = (pos + PITCH_HOP / 2) / PITCH_HOP;
+        if (f >= frame_count) f = frame_count - 1;
+        uint32_t period = periods[f];
+        if (period == 0) {
+            if (add_mark(out, &allocated, (uint32_t)pos, 0) != 0) goto fail;
+            last = (long)pos;
+            pos += PITCH_HOP;
+            was_voiced = 0;
+            continue;
+        }
+
+        //! Первая метка участка ищется по целому периоду, следующие — в четверти периода от ожидаемой
+        size_t from = was_voiced ? (pos > period / 4 ? pos - period / 4 : 0) : pos;
+        size_t to = was_voiced ? pos + period / 4 : pos + period;
+        if ((long)from <= last) from = (size_t)(last + 1);
+        if (to >= frames) to = frames - 1;
+        if (from > to) break;
+        size_t peak = from;
+        for (size_t i = from; i <= to; i++) {
+            if (x[i] > x[peak]) peak = i;
+        }
+        if (add_mark(out, &allocated, (uint32_t)peak, period) != 0) goto fail;
+        last = (long)peak;
+        pos = peak + period;
+        was_voiced = 1;
+    }
+
+    //! Частота основного тона слога — медиана по озвученным кадрам
+    for (size_t f = 0; f < frame_count; f++) {
+        if (periods[f]) f0s[voiced++] = (float)audio->sample_rate / periods[f];
+    }
+    if (voiced > 0) {
+        qsort(f0s, voiced, sizeof(float), compare_float);
+        out->f0 = f0s[voiced / 2];
+    }
+    out->hash = hash_marks(out);
+
+    free(x); free(xd); free(periods); free(energy); free(f0s);
+    return 0;
+
+fail:
+    free(x); free(xd); free(periods); free(energy); free(f0s);
+    pitchmarks_free(out);
+    return -1;
+}
+
+void pitchmarks_free(PitchMarks* marks) {
+    free(marks->marks);
+    memset(marks, 0, sizeof(*marks));
+}
+
+int pitchmarks_save(const Voicebank* vb, const char* dir) {
+    if (!host_is_little_endian()) return -1;
+    char path[1024], temp[1100];
+    snprintf(path, sizeof(path), "%s/%s", dir, PITCHMARKS_FILE);
+    snprintf(temp, sizeof(temp), "%s.tmp", path);
+
+    FILE* f = fopen(temp, "wb");
+    if (!f) return -1;
+
+    PitchFileHeader header;
+    memcpy(header.magic, pitch_magic, sizeof(header.magic));
+    header.version = PITCHMARKS_VERSION;
+    header.unit_count = 0;
+    for (size_t i = 0; i < vb->count; i++) {
+        if (vb->units[i].marks.count > 0) header.unit_count++;
+    }
+    int ok = fwrite(&header, sizeof(header), 1, f) == 1;
+
+    for (size_t i = 0; i < vb->count && ok; i++) {
+        const VoiceUnit* u = &vb->units[i];
+        if (u->marks.count == 0) continue;
+        PitchFileUnit rec = { u->hash, u->marks.f0, (uint32_t)u->marks.count, (uint32_t)strlen(u->name), 0 };
+        ok = fwrite(&rec, sizeof(rec), 1, f) == 1 &&
+            fwrite(u->name, 1, rec.name_len, f) == rec.name_len &&
+            fwrite(u->marks.marks, sizeof(PitchMark), u->marks.count, f) == u->marks.count;
+    }
+    if (fclose(f) != 0) ok = 0;
+
+    //! Файл заменяется целиком, чтобы прерванный анализ не оставил половину записей
+    remove(path);
+    if (!ok || rename(temp, path) != 0) {
+        remove(temp);
+        return -1;
+    }
+    return 0;
+}
+
+int pitchmarks_attach(Voicebank* vb, const char* dir) {
+    char path[1024];
+    snprintf(path, sizeof(path), "%s/%s", dir, PITCHMARKS_FILE);
+    if (!host_is_little_endian()) return -1;
+    FILE* f = fopen(path, "rb");
+    if (!f) return -1;
+
+    PitchFileHeader header;
+    if (fread(&header, sizeof(header), 1, f) != 1 || memcmp(header.magic, pitch_magic, sizeof(pitch_magic)) != 0 ||
+        header.version != PITCHMARKS_VERSION) {
+        printf("Warning: %s is not a pitch mark file of version %d, ignored\n", path, PITCHMARKS_VERSION);
+        fclose(f);
+        return -1;
+    }
+
+    int attached = 0, stale = 0;
+    for (uint32_t i = 0; i < header.unit_count; i++) {
+        PitchFileUnit rec;
+        char name[256];
+        if (fread(&rec, sizeof(rec), 1, f) != 1 || rec.name_len >= sizeof(name) ||
+            fread(name, 1, rec.name_len, f) != rec.name_len) {
+            printf("Warning: %s is truncated\n", path);
+            break;
+        }
+        name[rec.name_len] = '\0';
+
+        VoiceUnit* u = (VoiceUnit*)voicebank_find_unit(vb, name);
+        if (!u || u->hash != rec.unit_hash) {
+            if (u) stale++;
+            fseek(f, (long)(rec.mark_count * sizeof(PitchMark)), SEEK_CUR);
+            continue;
+        }
+        PitchMarks m = { malloc((rec.mark_count + 1) * sizeof(PitchMark)), rec.mark_count, rec.f0, 0 };
+        if (!m.marks || fread(m.marks, sizeof(PitchMark), m.count, f) != m.count) {
+            free(m.marks);
+            printf("Warning: %s is truncated\n", path);
+            break;
+        }
+        m.hash = hash_marks(&m);
+        pitchmarks_free(&u->marks);
+        u->marks = m;
+        attached++;
+    }
+    fclose(f);
+
+    if (stale > 0) {
+        printf("Warning: pitch marks of %d unit(s) are out of date, run vbanalyze to refresh them\n", stale);
+    }
+    return attached;
+}
@@ -0,0 +1,45 @@
+/**
+ * @file pitchmarks.h
+ * @brief Метки основного тона единиц голосового банка: анализ и файл-спутник.
+ *
+ * Анализ выполняется заранее (программа vbanalyze) и сохраняется рядом со слогами
+ * в voicebank/pitchmarks.idx. При загрузке банка метки прикрепляются к единицам,
+ * у которых совпадает хеш содержимого; по ним встроенный движок сдвигает тон
+ * TD-PSOLA, а абсолютные ноты пересчитываются от частоты основного тона слога.
+ */
+
+#ifndef PITCHMARKS_H
+#define PITCHMARKS_H
+
+#include "dsp.h"
+#include "voicebank.h"
+
+#define PITCHMARKS_FILE "pitchmarks.idx" ///< Имя файла-спутника в каталоге голосового банка
+#define PITCHMARKS_VERSION 1             ///< Версия формата файла
+
+/**
+ * @brief Находит основной тон и расставляет метки по периодам.
+ *  Озвученные участки получают метку на пике каждого периода, неозвученные — через каждые 10 мс.
+ * @param[in] audio Звук единицы.
+ * @param[out] out Метки (освобождаются pitchmarks_free()).
+ * @return 0 при успехе, -1 при нехватке памяти.
+ */
+int pitchmarks_analyze(const AudioBuffer* audio, PitchMarks* out);
+
+/** @brief Освобождает метки. */
+void pitchmarks_free(PitchMarks* marks);
+
+/**
+ * @brief Записывает метки всех единиц банка в файл-спутник каталога.
+ * @return 0 при успехе, -1 при ошибке записи.
+ */
+int pitchmarks_save(const Voicebank* vb, const char* dir);
+
+/**
+ * @brief Читает файл-спутник и прикрепляет метки к единицам с тем же хешем содержимого.
+ *  Устаревшие записи (слог перезаписан после анализа) пропускаются с предупреждением.
+ * @return Количество единиц с метками или -1, если файла нет или он повреждён.
+ */
+int pitchmarks_attach(Voicebank* vb, const char* dir);
+
+#endif /* PITCHMARKS_H */
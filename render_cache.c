@@ -0,0 +1,357 @@
+/**
+ * @file render_cache.c
+ * @brief Постоянный кэш обработанных слогов: индекс, LRU-вытеснение и статистика.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <time.h>
+
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#include <direct.h>
+#include <windows.h>
+#define make_dir(path) _mkdir(path)
+#else
+#include <unistd.h>
+#define make_dir(path) mkdir(path, 0755)
+#endif
+
+#include "render_cache.h"
+#include "voicebank.h"
+#include "trace.h"
+
+#define RENDER_CACHE_VERSION 1 ///< Меняется при любом изменении алгоритмов обработки
+#define PART_STALE_AGE 600     ///< Через сколько секунд временный файл записи считается брошенным
+
+//! Номер временного файла записи, уникальный в процессе
+#ifdef _WIN32
+static volatile LONG part_serial = 0;
+#else
+static long part_serial = 0;
+#endif
+
+/** @brief Путь к файлу записи по её ключу. */
+static void entry_path(const RenderCache* cache, uint64_t key, char* path, size_t size) {
+    snprintf(path, size, "%s/%016" PRIx64 ".wav", cache->dir, key);
+}
+
+/**
+ * @brief Путь к временному файлу записи: номер процесса и счётчик делают его уникальным,
+ *  даже если каталог кэша делят несколько процессов (mainffmpeg, ttsbatch, ttsd).
+ */
+static void part_path(const char* path, char* part, size_t size) {
+#ifdef _WIN32
+    long serial = (long)InterlockedIncrement(&part_serial);
+    snprintf(part, size, "%s.%lu_%ld.part", path, (unsigned long)GetCurrentProcessId(), serial);
+#else
+    long serial = __atomic_add_fetch(&part_serial, 1, __ATOMIC_RELAXED);
+    snprintf(part, size, "%s.%ld_%ld.part", path, (long)getpid(), serial);
+#endif
+}
+
+/** @brief Путь к файлу индекса. */
+static void index_path(const RenderCache* cache, char* path, size_t size) {
+    snprintf(path, size, "%s/index.txt", cache->dir);
+}
+
+/** @brief Индекс записи в массиве entries или -1. Вызывается под блокировкой. */
+static long find_entry(const RenderCache* cache, uint64_t key) {
+    for (size_t i = 0; i < cache->count; i++) {
+        if (cache->entries[i].key == key) return (long)i;
+    }
+    return -1;
+}
+
+/** @brief Удаляет запись из индекса (без удаления файла). Вызывается под блокировкой. */
+static void drop_entry(RenderCache* cache, size_t i) {
+    cache->total_bytes -= cache->entries[i].bytes;
+    cache->entries[i] = cache->entries[--cache->count];
+}
+
+/**
+ * @brief Добавляет запись в индекс. Вызывается под блокировкой.
+ * @return 0 при успехе, -1 при нехватке памяти (индекс не меняется).
+ */
+static int add_entry(RenderCache* cache, uint64_t key, uint64_t bytes, uint64_t last_used) {
+    if (cache->count == cache->allocated) {
+        size_t allocated = cache->allocated ? cache->allocated * 2 : 256;
+        CacheEntry* grown = realloc(cache->entries, allocated * sizeof(CacheEntry));
+        if (!grown) return -1;
+        cache->entries = grown;
+        cache->allocated = allocated;
+    }
+    CacheEntry e = { key, bytes, last_used };
+    cache->entries[cache->count++] = e;
+    cache->total_bytes += bytes;
+    return 0;
+}
+
+/** @brief Вытесняет давно не использованные записи, пока не освободится incoming байт. Вызывается под блокировкой. */
+static void evict_to_fit(RenderCache* cache, uint64_t incoming) {
+    while (cache->count > 0 && cache->total_bytes + incoming > cache->max_bytes) {
+        size_t oldest = 0;
+        for (size_t j = 1; j < cache->count; j++) {
+            if (cache->entries[j].last_used < cache->entries[oldest].last_used) oldest = j;
+        }
+        char path[600];
+        entry_path(cache, cache->entries[oldest].key, path, sizeof(path));
+        remove(path);
+        drop_entry(cache, oldest);
+        cache->evictions++;
+    }
+}
+
+/**
+ * @brief Записывает индекс атомарно: во временный файл с последующим переименованием.
+ *  Прерванная запись оставляет прежний индекс целым; временный файл уникален, как у записей,
+ *  потому что индекс одного каталога могут сохранять несколько процессов сразу.
+ * @return 0 при успехе, -1 при ошибке записи.
+ */
+static int save_index(const RenderCache* cache) {
+    char path[600], part[640];
+    index_path(cache, path, sizeof(path));
+    part_path(path, part, sizeof(part));
+
+    FILE* f = fopen(part, "w");
+    if (!f) return -1;
+    fprintf(f, "ttscache %d\n", RENDER_CACHE_VERSION);
+    for (size_t i = 0; i < cache->count; i++) {
+        fprintf(f, "%016" PRIx64 " %" PRIu64 " %" PRIu64 "\n",
+            cache->entries[i].key, cache->entries[i].bytes, cache->entries[i].last_used);
+    }
+    int ok = !ferror(f);
+    if (fclose(f) != 0) ok = 0;
+#ifdef _WIN32
+    ok = ok && MoveFileExA(part, path, MOVEFILE_REPLACE_EXISTING);
+#else
+    ok = ok && rename(part, path) == 0;
+#endif
+    if (!ok) remove(part);
+    return ok ? 0 : -1;
+}
+
+/** @brief Состояние сверки индекса с содержимым каталога. */
+typedef struct {
+    RenderCache* cache;
+    char* seen;     ///< Отметки найденных файлов для записей, прочитанных из индекса
+    size_t indexed; ///< Количество записей, прочитанных из индекса
+} CacheScan;
+
+/** @brief Сверяет файл каталога кэша с индексом: уточняет размер записи или добавляет забытую. */
+static void scan_entry(const char* dir, const char* file, void* ctx) {
+    CacheScan* scan = ctx;
+    uint64_t key;
+    char tail[8];
+    if (strlen(file) != 20 || sscanf(file, "%16" SCNx64 "%7s", &key, tail) != 2 || strcmp(tail, ".wav") != 0) {
+        return; //!< Не файл записи
+    }
+
+    char path[600];
+    struct stat st;
+    snprintf(path, sizeof(path), "%s/%s", dir, file);
+    if (stat(path, &st) != 0) return;
+
+    long i = find_entry(scan->cache, key);
+    if (i >= 0) {
+        //! Размер берём с диска: индекс мог отстать от файла
+        RenderCache* cache = scan->cache;
+        cache->total_bytes = cache->total_bytes - cache->entries[i].bytes + (uint64_t)st.st_size;
+        cache->entries[i].bytes = (uint64_t)st.st_size;
+        if (scan->seen && (size_t)i < scan->indexed) scan->seen[i] = 1;
+    } else if (add_entry(scan->cache, key, (uint64_t)st.st_size, 0) != 0) {
+        remove(path); //!< Не помещается в индекс — иначе файл остался бы вне учёта навсегда
+    }
+}
+
+/**
+ * @brief Удаляет временный файл, брошенный прерванной записью.
+ *  Свежие не трогаем: их может как раз дописывать другой процесс с тем же каталогом кэша.
+ */
+static void remove_stale_part(const char* dir, const char* file, void* ctx) {
+    (void)ctx;
+    char path[600];
+    struct stat st;
+    snprintf(path, sizeof(path), "%s/%s", dir, file);
+    if (stat(path, &st) == 0 && difftime(time(NULL), st.st_mtime) > PART_STALE_AGE) remove(path);
+}
+
+int render_cache_open(RenderCache* cache, const char* dir, uint64_t max_bytes) {
+    memset(cache, 0, sizeof(*cache));
+    snprintf(cache->dir, sizeof(cache->dir), "%s", dir);
+    cache->max_bytes = max_bytes;
+    worker_mutex_init(&cache->lock);
+
+    make_dir(dir); //!< Ошибку "уже существует" не отличаем: доступность проверит индекс
+
+    char path[600];
+    index_path(cache, path, sizeof(path));
+    FILE* f = fopen(path, "r");
+    if (!f) {
+        //! Индекса нет; проверяем, что в каталог вообще можно писать
+        if (save_index(cache) != 0) {
+            worker_mutex_destroy(&cache->lock);
+            return -1;
+        }
+    } else {
+        int version = 0;
+        if (fscanf(f, "ttscache %d", &version) == 1 && version == RENDER_CACHE_VERSION) {
+            uint64_t key, bytes, last_used;
+            while (fscanf(f, "%" SCNx64 " %" SCNu64 " %" SCNu64, &key, &bytes, &last_used) == 3) {
+                if (add_entry(cache, key, bytes, last_used) != 0) break;
+                if (last_used > cache->clock) cache->clock = last_used;
+            }
+        }
+        fclose(f);
+    }
+
+    //! Индекс пишется только при закрытии, поэтому после аварийного завершения он расходится
+    //! с каталогом: файлы без записи добавляются как самые старые, записи без файла удаляются,
+    //! а временные файлы прерванных записей стираются
+    CacheScan scan = { cache, calloc(cache->count + 1, 1), cache->count };
+    voicebank_scan(dir, scan_entry, &scan);
+    voicebank_scan_suffix(dir, ".part", remove_stale_part, NULL);
+    if (scan.seen) {
+        for (size_t i = scan.indexed; i-- > 0;) {
+            if (!scan.seen[i]) drop_entry(cache, i);
+        }
+        free(scan.seen);
+    }
+
+    //! Предел мог уменьшиться с прошлого запуска
+    evict_to_fit(cache, 0);
+    return 0;
+}
+
+uint64_t render_cache_key(uint64_t unit_hash, int backend, const EffectParams* p) {
+    //! Поля хешируются по отдельности, чтобы выравнивание структуры не влияло на ключ
+    uint32_t fields[20];
+    float values[] = {
+        p->duration, p->depth_vibro,
+        p->start_fade_in, p->duration_fade_in, p->start_fade_out, p->duration_fade_out,
+        p->Echo1, p->Echo2, p->Echo3, p->Echo4, p->chorus,
+        p->Equalizerf, p->Equalizert, p->Equalizerw, p->Equalizerg, p->Flanger
+    };
+    size_t n = 0;
+    fields[n++] = RENDER_CACHE_VERSION;
+    fields[n++] = (uint32_t)backend;
+    fields[n++] = (uint32_t)p->semitones;
+    fields[n++] = (uint32_t)p->freq_vibro;
+    for (size_t i = 0; i < sizeof(values) / sizeof(values[0]) && n < 20; i++) {
+        memcpy(&fields[n++], &values[i], sizeof(uint32_t));
+    }
+
+    uint64_t h = 14695981039346656037ull;
+    h = (h ^ unit_hash) * 1099511628211ull;
+    for (size_t i = 0; i < n; i++) {
+        h = (h ^ fields[i]) * 1099511628211ull;
+    }
+    return h;
+}
+
+int render_cache_get(RenderCache* cache, uint64_t key, AudioBuffer* out) {
+    double t = TRACE_BEGIN();
+    worker_mutex_lock(&cache->lock);
+    long i = find_entry(cache, key);
+    if (i >= 0) {
+        cache->entries[i].last_used = ++cache->clock;
+    }
+    worker_mutex_unlock(&cache->lock);
+
+    if (i >= 0) {
+        char path[600];
+        entry_path(cache, key, path, sizeof(path));
+        if (wav_read(path, out) == 0) {
+            worker_mutex_lock(&cache->lock);
+            cache->hits++;
+            worker_mutex_unlock(&cache->lock);
+            TRACE_END(t, "cache", "hit", NULL, (long long)(out->frames * out->channels),
+                44 + (long long)(out->frames * out->channels * 2));
+            return 0;
+        }
+    }
+
+    //! Промах; если файл записи пропал, убираем её из индекса
+    worker_mutex_lock(&cache->lock);
+    cache->misses++;
+    if (i >= 0) {
+        long j = find_entry(cache, key);
+        if (j >= 0) drop_entry(cache, (size_t)j);
+    }
+    worker_mutex_unlock(&cache->lock);
+    TRACE_END(t, "cache", "miss", NULL, 0, 0);
+    return -1;
+}
+
+void render_cache_put(RenderCache* cache, uint64_t key, const AudioBuffer* audio) {
+    uint64_t bytes = 44 + (uint64_t)audio->frames * audio->channels * 2;
+    if (bytes > cache->max_bytes) {
+        return; //!< Запись больше всего кэша — не храним
+    }
+
+    worker_mutex_lock(&cache->lock);
+    int known = find_entry(cache, key) >= 0;
+    worker_mutex_unlock(&cache->lock);
+    if (known) {
+        return; //!< Тот же слог уже сохранил другой поток
+    }
+
+    //! Пишем во временный файл, уникальный для вызова, чтобы читатели не увидели неполную запись
+    double t = TRACE_BEGIN();
+    char path[600], part[640];
+    entry_path(cache, key, path, sizeof(path));
+    part_path(path, part, sizeof(part));
+    if (wav_write(part, audio) != 0) {
+        remove(part);
+        return;
+    }
+
+    worker_mutex_lock(&cache->lock);
+    if (find_entry(cache, key) >= 0) {
+        remove(part);
+        worker_mutex_unlock(&cache->lock);
+        return;
+    }
+
+    //! Вытесняем давно не использованные записи, пока новая не поместится
+    evict_to_fit(cache, bytes);
+
+    remove(path); //!< rename() в Windows не заменяет существующий файл
+    if (rename(part, path) == 0) {
+        if (add_entry(cache, key, bytes, ++cache->clock) == 0) {
+            cache->stores++;
+        } else {
+            remove(path); //!< Запись вне индекса не была бы ни найдена, ни вытеснена
+        }
+    } else {
+        remove(part);
+    }
+    worker_mutex_unlock(&cache->lock);
+    TRACE_END(t, "cache", "store", NULL, (long long)(audio->frames * audio->channels), (long long)bytes);
+}
+
+void render_cache_print_stats(RenderCache* cache) {
+    worker_mutex_lock(&cache->lock);
+    unsigned long lookups = cache->hits + cache->misses;
+    printf("Render cache: %lu hits, %lu misses (%.1f%% hit rate), %lu stored, %lu evicted\n",
+        cache->hits, cache->misses, lookups ? 100.0 * cache->hits / lookups : 0.0,
+        cache->stores, cache->evictions);
+    printf("Render cache: %lu entries, %.1f of %.1f MB used in %s\n",
+        (unsigned long)cache->count, cache->total_bytes / 1048576.0, cache->max_bytes / 1048576.0, cache->dir);
+    worker_mutex_unlock(&cache->lock);
+}
+
+void render_cache_close(RenderCache* cache) {
+    if (save_index(cache) != 0) {
+        char path[600];
+        index_path(cache, path, sizeof(path));
+        printf("Cannot save render cache index %s\n", path);
+    }
+
+    free(cache->entries);
+    worker_mutex_destroy(&cache->lock);
+    memset(cache, 0, sizeof(*cache));
+}
@@ -0,0 +1,81 @@
+/**
+ * @file render_cache.h
+ * @brief Постоянный кэш обработанных слогов с адресацией по содержимому.
+ *
+ * Ключ записи — хеш исходной единицы голосового банка и полного набора параметров
+ * из output.txt. Попадание в кэш избавляет от обработки слога целиком. Записи
+ * хранятся в каталоге кэша как обычные WAV-файлы `<ключ>.wav`, а индекс с размерами
+ * и временем последнего использования — в файле index.txt того же каталога.
+ * Общий объём ограничен, при переполнении удаляются давно не использованные записи (LRU).
+ */
+
+#ifndef RENDER_CACHE_H
+#define RENDER_CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "dsp.h"
+#include "workers.h"
+
+/** @brief Запись индекса кэша. */
+typedef struct {
+    uint64_t key;        ///< Ключ записи
+    uint64_t bytes;      ///< Размер файла записи
+    uint64_t last_used;  ///< Логическое время последнего обращения (для LRU)
+} CacheEntry;
+
+/** @brief Кэш обработанных слогов. Все операции потокобезопасны. */
+typedef struct {
+    char dir[512];           ///< Каталог кэша
+    uint64_t max_bytes;      ///< Предельный объём записей
+    uint64_t total_bytes;    ///< Текущий объём записей
+
+    CacheEntry* entries;     ///< Индекс записей
+    size_t count;            ///< Количество записей
+    size_t allocated;        ///< Выделено мест в entries
+    uint64_t clock;          ///< Счётчик логического времени
+
+    unsigned long hits;      ///< Попадания
+    unsigned long misses;    ///< Промахи
+    unsigned long stores;    ///< Сохранённые записи
+    unsigned long evictions; ///< Вытесненные записи
+
+    WorkerMutex lock;        ///< Защита индекса и статистики
+} RenderCache;
+
+/**
+ * @brief Открывает кэш: создаёт каталог при необходимости, читает индекс и сверяет его
+ *  с файлами каталога (индекс мог отстать, если процесс не дошёл до render_cache_close()).
+ * @param[out] cache Инициализируемый кэш.
+ * @param[in] dir Каталог кэша.
+ * @param[in] max_bytes Предельный объём записей в байтах.
+ * @return 0 при успехе, -1 если каталог недоступен.
+ */
+int render_cache_open(RenderCache* cache, const char* dir, uint64_t max_bytes);
+
+/**
+ * @brief Вычисляет ключ записи.
+ * @param[in] unit_hash Хеш содержимого исходной единицы.
+ * @param[in] backend Идентификатор способа обработки (разные движки дают разный звук).
+ * @param[in] p Параметры обработки слога.
+ * @return 64-битный ключ.
+ */
+uint64_t render_cache_key(uint64_t unit_hash, int backend, const EffectParams* p);
+
+/**
+ * @brief Ищет запись и при попадании загружает её звук.
+ * @return 0 при попадании, -1 при промахе.
+ */
+int render_cache_get(RenderCache* cache, uint64_t key, AudioBuffer* out);
+
+/** @brief Сохраняет обработанный слог, при переполнении вытесняя старые записи. */
+void render_cache_put(RenderCache* cache, uint64_t key, const AudioBuffer* audio);
+
+/** @brief Печатает статистику попаданий, промахов и заполненности кэша. */
+void render_cache_print_stats(RenderCache* cache);
+
+/** @brief Атомарно сохраняет индекс на диск и освобождает память кэша. */
+void render_cache_close(RenderCache* cache);
+
+#endif /* RENDER_CACHE_H */
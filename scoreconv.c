@@ -0,0 +1,52 @@
+/**
+ * @file scoreconv.c
+ * @brief Преобразование партитуры между текстовым форматом output.txt и двоичным форматом.
+ *
+ * Формат входного файла определяется по сигнатуре. Выходной файл записывается в двоичном
+ * формате, если его имя оканчивается на ".score", иначе — в текстовом, пригодном для правки.
+ *
+ * Пример: scoreconv output.txt output.score
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "tts.h"
+
+/** @brief Проверяет, оканчивается ли строка заданным суффиксом. */
+static int ends_with(const char* s, const char* suffix) {
+    size_t n = strlen(s), m = strlen(suffix);
+    return n >= m && strcmp(s + n - m, suffix) == 0;
+}
+
+int main(int argc, char** argv) {
+    if (argc != 3) {
+        printf("Usage: scoreconv <input> <output>\n");
+        printf("  output ending with .score is written in binary form, anything else as text\n");
+        return 1;
+    }
+
+    Score score;
+    if (tts_score_load(argv[1], &score) != 0) {
+        printf("Cannot read score %s\n", argv[1]);
+        return 1;
+    }
+
+    int binary = ends_with(argv[2], ".score");
+    FILE* out = fopen(argv[2], binary ? "wb" : "w");
+    if (!out) {
+        printf("Cannot open %s\n", argv[2]);
+        tts_score_free(&score);
+        return 1;
+    }
+    int rc = binary ? tts_score_write_binary(out, &score) : tts_score_write_text(out, &score);
+    if (fclose(out) != 0) rc = -1;
+
+    if (rc != 0) {
+        printf("Error writing %s\n", argv[2]);
+    } else {
+        printf("%d syllable(s) written to %s\n", score.count, argv[2]);
+    }
+    tts_score_free(&score);
+    return rc != 0;
+}
@@ -1,7 +1,17 @@
 @echo off
+REM Compile the libtts library (text frontend and its parallel driver, native DSP engine, voicebank index and pitch marks, worker pool, render cache, tracing, file watching, atomic output writing)
+echo Compiling libtts...
+gcc -c tts.c tts_score.c tts_score_bin.c tts_translit.c tts_syllabify.c tts_frontend.c tts_render.c tts_manifest.c dsp.c dsp_simd.c voicebank.c pitchmarks.c workers.c render_cache.c mapfile.c trace.c watch.c outfile.c
+if errorlevel 1 (
+    echo Error compiling libtts
+    pause
+    exit /b 1
+)
+ar rcs libtts.a tts.o tts_score.o tts_score_bin.o tts_translit.o tts_syllabify.o tts_frontend.o tts_render.o tts_manifest.o dsp.o dsp_simd.o voicebank.o pitchmarks.o workers.o render_cache.o mapfile.o trace.o watch.o outfile.o
+
 REM Compile poslogam.c to poslogam.exe
 echo Compiling poslogam.c...
-gcc poslogam.c -o poslogam.exe
+gcc poslogam.c libtts.a -o poslogam.exe
 if errorlevel 1 (
     echo Error compiling poslogam.c
     pause
@@ -10,7 +20,7 @@ if errorlevel 1 (
 
 REM Compile trnskrp.c to trnskrp.exe
 echo Compiling trnskrp.c...
-gcc trnskrp.c -o trnskrp.exe
+gcc trnskrp.c libtts.a -o trnskrp.exe
 if errorlevel 1 (
     echo Error compiling trnskrp.c
     pause
@@ -19,13 +29,89 @@ if errorlevel 1 (
 
 REM Compile mainffmpeg.c to mainffmpeg.exe
 echo Compiling mainffmpeg.c...
-gcc mainffmpeg.c -o mainffmpeg.exe
+gcc mainffmpeg.c libtts.a -o mainffmpeg.exe
 if errorlevel 1 (
     echo Error compiling mainffmpeg.c
     pause
     exit /b 1
 )
 
+REM Compile scoreconv.c (text <-> binary score converter) to scoreconv.exe
+echo Compiling scoreconv.c...
+gcc scoreconv.c libtts.a -o scoreconv.exe
+if errorlevel 1 (
+    echo Error compiling scoreconv.c
+    pause
+    exit /b 1
+)
+
+REM Compile dspbench.c (SIMD kernel self-check and micro-benchmark) to dspbench.exe
+echo Compiling dspbench.c...
+gcc -O2 dspbench.c libtts.a -o dspbench.exe
+if errorlevel 1 (
+    echo Error compiling dspbench.c
+    pause
+    exit /b 1
+)
+
+REM Compile ttsstream.c (streaming stdin text -> stdout PCM/WAV) to ttsstream.exe
+echo Compiling ttsstream.c...
+gcc ttsstream.c libtts.a -o ttsstream.exe
+if errorlevel 1 (
+    echo Error compiling ttsstream.c
+    pause
+    exit /b 1
+)
+
+REM Compile ttsd.c (synthesis daemon on a local Unix socket, Windows 10+) to ttsd.exe
+echo Compiling ttsd.c...
+gcc ttsd.c libtts.a -lws2_32 -o ttsd.exe
+if errorlevel 1 (
+    echo Error compiling ttsd.c
+    pause
+    exit /b 1
+)
+
+REM Compile ttsbatch.c (many texts/scores per run from a manifest) to ttsbatch.exe
+echo Compiling ttsbatch.c...
+gcc ttsbatch.c libtts.a -o ttsbatch.exe
+if errorlevel 1 (
+    echo Error compiling ttsbatch.c
+    pause
+    exit /b 1
+)
+
+REM Compile bench.c (per-stage benchmark with JSON output; on Linux use bench.sh) to bench.exe
+echo Compiling bench.c...
+gcc -O2 bench.c libtts.a -lpsapi -o bench.exe
+if errorlevel 1 (
+    echo Error compiling bench.c
+    pause
+    exit /b 1
+)
+
+REM Compile vbanalyze.c (pitch mark analysis of the voicebank for PSOLA and note pitches) to vbanalyze.exe
+echo Compiling vbanalyze.c...
+gcc -O2 vbanalyze.c libtts.a -o vbanalyze.exe
+if errorlevel 1 (
+    echo Error compiling vbanalyze.c
+    pause
+    exit /b 1
+)
+
+REM Compile vbpack.c (packs voicebank/ into one memory-mapped archive, use --voicebank=voicebank.pack) to vbpack.exe
+echo Compiling vbpack.c...
+gcc -O2 vbpack.c libtts.a -o vbpack.exe
+if errorlevel 1 (
+    echo Error compiling vbpack.c
+    pause
+    exit /b 1
+)
+
+REM Analyse the voicebank so that notes like do5 can be used
+echo Running vbanalyze...
+vbanalyze.exe
+
 REM Run poslogam.exe
 echo Running poslogam...
 poslogam.exe
@@ -45,7 +131,7 @@ echo Waiting for "done" command...
 goto waitloop
 
 :runmain
-REM Run mainffmpeg.exe
+REM Run mainffmpeg.exe (mainffmpeg.exe --watch keeps running and re-renders on every save of output.txt)
 echo Running mainffmpeg...
 mainffmpeg.exe
 
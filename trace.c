@@ -0,0 +1,194 @@
+/**
+ * @file trace.c
+ * @brief Сбор событий трассировки, запись в формате Chrome trace-event и сводка по событиям.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "trace.h"
+
+#define TRACE_DETAIL_SIZE 32   ///< Наибольшая длина уточнения события с нулём
+#define TRACE_BUCKETS 7        ///< Интервалов в гистограмме длительностей
+
+/** @brief Одно завершённое событие. */
+typedef struct {
+    double start;                   ///< Начало, сек по workers_time()
+    double end;                     ///< Конец
+    const char* cat;                ///< Категория
+    const char* name;               ///< Название
+    char detail[TRACE_DETAIL_SIZE]; ///< Уточнение или пустая строка
+    long long samples;              ///< Обработано отсчётов
+    long long bytes;                ///< Байт ввода-вывода
+    int thread;                     ///< Номер потока в порядке первого события
+} TraceEvent;
+
+volatile int trace_enabled = 0;
+
+static WorkerMutex lock;
+static FILE* file;
+static double origin;              //!< Момент trace_start(): нулевая отметка времени в файле
+static TraceEvent* events;
+static size_t count, allocated;
+static int thread_count;
+static _Thread_local int thread_id; //!< 0 — потоку ещё не выдан номер
+
+/** @brief Верхние границы интервалов гистограммы, сек; последний интервал не ограничен. */
+static const double bucket_limits[TRACE_BUCKETS - 1] = { 10e-6, 100e-6, 1e-3, 10e-3, 100e-3, 1.0 };
+static const char* bucket_names[TRACE_BUCKETS] = { "<10us", "<100us", "<1ms", "<10ms", "<100ms", "<1s", ">=1s" };
+
+int trace_start(const char* path) {
+    file = fopen(path, "w");
+    if (!file) return -1;
+    worker_mutex_init(&lock);
+    count = 0;
+    thread_count = 0;
+    origin = workers_time();
+    trace_enabled = 1;
+    return 0;
+}
+
+void trace_record(double start, const char* cat, const char* name, const char* detail,
+    long long samples, long long bytes) {
+    double end = workers_time();
+    worker_mutex_lock(&lock);
+    if (!trace_enabled) {
+        worker_mutex_unlock(&lock);
+        return;
+    }
+    if (count == allocated) {
+        size_t grown_size = allocated ? allocated * 2 : 4096;
+        TraceEvent* grown = realloc(events, grown_size * sizeof(TraceEvent));
+        if (!grown) {
+            worker_mutex_unlock(&lock);
+            return; //!< Без памяти событие теряется, рендер продолжается
+        }
+        events = grown;
+        allocated = grown_size;
+    }
+    if (thread_id == 0) thread_id = ++thread_count;
+
+    TraceEvent* e = &events[count++];
+    e->start = start;
+    e->end = end;
+    e->cat = cat;
+    e->name = name;
+    snprintf(e->detail, sizeof(e->detail), "%s", detail ? detail : "");
+    e->samples = samples;
+    e->bytes = bytes;
+    e->thread = thread_id;
+    worker_mutex_unlock(&lock);
+}
+
+/** @brief Пишет строку JSON с экранированием. */
+static void write_string(FILE* f, const char* s) {
+    fputc('"', f);
+    for (; *s; s++) {
+        if (*s == '"' || *s == '\\') fputc('\\', f);
+        if ((unsigned char)*s >= 0x20) fputc(*s, f);
+    }
+    fputc('"', f);
+}
+
+static int compare_double(const void* a, const void* b) {
+    double x = *(const double*)a, y = *(const double*)b;
+    return x < y ? -1 : x > y;
+}
+
+/** @brief Сводка по одному названию события: события с индексами из order[first..last). */
+static void print_summary_row(const size_t* order, size_t first, size_t last, double* durations) {
+    const TraceEvent* e0 = &events[order[first]];
+    size_t n = last - first;
+    double total = 0;
+    long long samples = 0, bytes = 0;
+    size_t buckets[TRACE_BUCKETS] = { 0 };
+
+    for (size_t k = 0; k < n; k++) {
+        const TraceEvent* e = &events[order[first + k]];
+        double d = e->end - e->start;
+        durations[k] = d;
+        total += d;
+        samples += e->samples;
+        bytes += e->bytes;
+        int b = 0;
+        while (b < TRACE_BUCKETS - 1 && d >= bucket_limits[b]) b++;
+        buckets[b]++;
+    }
+    qsort(durations, n, sizeof(double), compare_double);
+
+    char label[48];
+    snprintf(label, sizeof(label), "%s/%s", e0->cat, e0->name);
+    printf("%-22s %8lu %10.2f %9.3f %9.3f %9.3f %12lld %12lld ", label, (unsigned long)n, total * 1000,
+        durations[n / 2] * 1000, durations[(n * 99) / 100] * 1000, durations[n - 1] * 1000, samples, bytes);
+    for (int b = 0; b < TRACE_BUCKETS; b++) {
+        printf(" %7lu", (unsigned long)buckets[b]);
+    }
+    printf("\n");
+}
+
+/** @brief Порядок событий для сводки: по категории и названию. */
+static int compare_events(const void* a, const void* b) {
+    const TraceEvent* x = &events[*(const size_t*)a];
+    const TraceEvent* y = &events[*(const size_t*)b];
+    int c = strcmp(x->cat, y->cat);
+    return c != 0 ? c : strcmp(x->name, y->name);
+}
+
+void trace_stop(void) {
+    if (!trace_enabled) return;
+    worker_mutex_lock(&lock);
+    trace_enabled = 0;
+    worker_mutex_unlock(&lock);
+
+    //! Завершённые события ("X") с временем в микросекундах от trace_start()
+    fprintf(file, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+    for (int t = 1; t <= thread_count; t++) {
+        fprintf(file, "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %d, "
+            "\"args\": {\"name\": \"%s %d\"}},\n", t, t == 1 ? "thread" : "worker", t);
+    }
+    for (size_t i = 0; i < count; i++) {
+        const TraceEvent* e = &events[i];
+        fprintf(file, "{\"name\": ");
+        write_string(file, e->detail[0] ? e->detail : e->name);
+        fprintf(file, ", \"cat\": ");
+        write_string(file, e->cat);
+        fprintf(file, ", \"ph\": \"X\", \"ts\": %.3f, \"dur\": %.3f, \"pid\": 1, \"tid\": %d, \"args\": {\"event\": ",
+            (e->start - origin) * 1e6, (e->end - e->start) * 1e6, e->thread);
+        write_string(file, e->name);
+        fprintf(file, ", \"samples\": %lld, \"bytes\": %lld}}%s\n", e->samples, e->bytes, i + 1 < count ? "," : "");
+    }
+    fprintf(file, "]}\n");
+    int ok = fclose(file) == 0;
+    file = NULL;
+
+    //! Сводка: события группируются по категории и названию
+    size_t* order = malloc((count + 1) * sizeof(size_t));
+    double* durations = malloc((count + 1) * sizeof(double));
+    if (order && durations && count > 0) {
+        for (size_t i = 0; i < count; i++) order[i] = i;
+        qsort(order, count, sizeof(size_t), compare_events);
+
+        printf("%-22s %8s %10s %9s %9s %9s %12s %12s ", "event", "count", "total ms", "p50 ms", "p99 ms",
+            "max ms", "samples", "bytes");
+        for (int b = 0; b < TRACE_BUCKETS; b++) {
+            printf(" %7s", bucket_names[b]);
+        }
+        printf("\n");
+        size_t first = 0;
+        for (size_t i = 1; i <= count; i++) {
+            if (i == count || compare_events(&order[first], &order[i]) != 0) {
+                print_summary_row(order, first, i, durations);
+                first = i;
+            }
+        }
+    }
+    printf("Trace: %lu event(s)%s\n", (unsigned long)count, ok ? "" : ", cannot write trace file");
+
+    free(order);
+    free(durations);
+    free(events);
+    events = NULL;
+    count = allocated = 0;
+    worker_mutex_destroy(&lock);
+}
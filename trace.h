@@ -0,0 +1,48 @@
+/**
+ * @file trace.h
+ * @brief Трассировка горячих участков: события с временем, отсчётами и байтами ввода-вывода.
+ *
+ * Пока трассировка не включена, TRACE_BEGIN() сводится к проверке флага, а TRACE_END() —
+ * к сравнению с нулём, поэтому точки трассировки можно оставлять в горячих циклах.
+ * После trace_start() события копятся в памяти (из любых потоков), а trace_stop()
+ * записывает их в файл формата Chrome trace-event (chrome://tracing, Perfetto) и
+ * печатает сводку: количество, время и гистограмму длительностей по каждому событию.
+ */
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include "workers.h"
+
+extern volatile int trace_enabled; ///< Трассировка включена (только для макросов ниже)
+
+/** @brief Начало замера: момент по workers_time() или 0, если трассировка выключена. */
+#define TRACE_BEGIN() (trace_enabled ? workers_time() : 0.0)
+
+/**
+ * @brief Конец замера, начатого TRACE_BEGIN(): записывает событие.
+ * @param start Значение TRACE_BEGIN().
+ * @param cat Категория события (строковая константа): "render", "effect", "cache", "io".
+ * @param name Название события (строковая константа).
+ * @param detail Уточнение (например, имя слога) или NULL; копируется.
+ * @param samples Обработано отсчётов.
+ * @param bytes Прочитано или записано байт.
+ */
+#define TRACE_END(start, cat, name, detail, samples, bytes) \
+    do { if ((start) > 0) trace_record((start), (cat), (name), (detail), (samples), (bytes)); } while (0)
+
+/**
+ * @brief Включает трассировку.
+ * @param[in] path Файл, в который trace_stop() запишет события.
+ * @return 0 при успехе, -1 если файл не создаётся.
+ */
+int trace_start(const char* path);
+
+/** @brief Выключает трассировку, записывает события в файл и печатает сводку. */
+void trace_stop(void);
+
+/** @brief Добавляет событие; обычно вызывается через TRACE_END(). */
+void trace_record(double start, const char* cat, const char* name, const char* detail,
+    long long samples, long long bytes);
+
+#endif /* TRACE_H */
@@ -2,241 +2,82 @@
  * @file trnskrp.c
  * @brief Программная реализация разбиения текста на слоги и создание шаблона для последующей обработки
  *
- * Данная программа демонстрирует работу с текстом, проверку символов,
- * обработку специальных комбинаций букв и запись результатов в файл.
- */
-
-#include <stdio.h>          ///< Стандартная библиотека ввода-вывода
-#include <ctype.h>          ///< Библиотека для работы с типами символов
-#include <string.h>         ///< Библиотека для работы со строками
-
-// Настройки звучания без заметных эффектов
-/** @defgroup SoundSettings Настройки звука
- * @{
- */
-#define VELOCITY "1.0"               ///< Нормальная скорость воспроизведения
-#define FREQ_VIBRO "0"               ///< Без вибрато
-#define DEPTH_VIBRO "0.0"            ///< Полностью отключено вибрато
-#define START_FADE_IN "0"            ///< Нет плавного нарастания громкости
-#define DURATION_FADE_IN "0.0"       ///< Нулевое время нарастания
-#define START_FADE_OUT "0"           ///< Нет плавного затухания громкости
-#define DURATION_FADE_OUT "0.0"      ///< Нулевое время затухания
-
-#define ECHO_FEEDBACK "0.0"          ///< Отключена обратная связь эхо
-#define ECHO_GAIN_1 "0.0"            ///< Эхо первой задержки отсутствует
-#define ECHO_DELAY "0"               ///< Отсутствие задержанного сигнала
-#define ECHO_GAIN_2 "0.0"            ///< Второе эхо также выключено
-
-#define CHORUS_RATE "0.0"            ///< Чоруса нет
-
-#define EQ_FREQ "1000"               ///< Центральная частота эквалайзера остается неизменной
-#define EQ_TYPE "flat"               ///< Плоская характеристика эквалайзера (без изменений частот)
-#define EQ_WIDTH "1.0"               ///< Не влияет при flat-типе
-#define EQ_GAIN "0"                  ///< Эквалайзер нейтральный, никаких усилений/ослаблений
-
-#define FLANGER_DEPTH "0.0"          ///< Фленжер выключен
-/** @}*/
-
-/**
- * Проверяет, является ли заданный символ согласной буквой.
- *
- * @param[in] c Символ для проверки
- * @return 1, если символ является согласной буквой, иначе 0
- */
-int isConsonant(char c) {
-    c = tolower(c);
-    return strchr("bcdfghiklmnpqrstvwxz", c) != NULL;
-}
-
-/**
- * Проверяет, является ли заданный символ гласной буквой.
+ * Разбиение выполняется библиотекой libtts (tts_syllabify.c); программа читает
+ * транскрипцию из input2.txt и записывает партитуру с параметрами «без заметных
+ * эффектов» в output.txt. С ключом --binary партитура записывается в двоичном
+ * формате в output.score (текстовую форму для правки даёт scoreconv).
  *
- * @param[in] c Символ для проверки
- * @return 1, если символ является гласной буквой, иначе 0
+ * Слоги выбираются только из единиц, которые есть в каталоге голосового банка
+ * (voicebank/ или --voicebank=DIR); сами WAV при этом не читаются. Длинная
+ * транскрипция разбирается по кускам на нескольких ядрах (--threads=N, по
+ * умолчанию по числу ядер); результат не зависит от числа потоков.
  */
-int isVowel(char c) {
-    c = tolower(c);
-    return strchr("aejouy", c) != NULL;
-}
-
-/**
- * Проверяет наличие специфичных сочетаний букв ("ch", "sh" и др.).
- *
- * @param[in] str Строка для проверки
- * @return 1, если комбинация найдена, иначе 0
- */
-int isSpecialCombination(const char *str) {
-    return strcmp(str, "ch") == 0 || strcmp(str, "ch'") == 0 || strcmp(str, "tch") == 0 || strcmp(str, "sh") == 0;
-}
-
-/**
- * Записывает буфер в выходной файл с дополнительными параметрами.
- *
- * @param[out] file Выходной файл
- * @param[in] buffer Буфер с данными
- * @param[in] length Длина буфера
- */
-void printBuffer(FILE *file, const char *buffer, int length) {
-    fwrite(buffer, sizeof(char), length, file);
-    fputc('\n', file);
-    fputs("0\n", file);                   ///< Тон равен 0
-    fprintf(file, "%s\n", VELOCITY);      ///< Скорость
-    fprintf(file, "%s\n", FREQ_VIBRO);    ///< Частота вибрато
-    fprintf(file, "%s\n", DEPTH_VIBRO);   ///< Глубина вибрато
-    fprintf(file, "%s\n", START_FADE_IN); ///< Начало fade-in
-    fprintf(file, "%s\n", DURATION_FADE_IN); ///< Длительность fade-in
-    fprintf(file, "%s\n", START_FADE_OUT); ///< Начало fade-out
-    fprintf(file, "%s\n", DURATION_FADE_OUT); ///< Длительность fade-out
-
-    fprintf(file, "%s\n", ECHO_FEEDBACK); ///< Обратная связь эха
-    fprintf(file, "%s\n", ECHO_GAIN_1);   ///< Задержка эха
-    fprintf(file, "%s\n", ECHO_DELAY);    ///< Задержка эха
-    fprintf(file, "%s\n", ECHO_GAIN_2);   ///< Обратная связь эха
-
-    fprintf(file, "%s\n", CHORUS_RATE);   ///< Темп хорового эффекта
 
-    fprintf(file, "%s\n", EQ_FREQ);       ///< Центральная частота эквалайзера
-    fprintf(file, "%s\n", EQ_TYPE);       ///< Тип эквалайзера
-    fprintf(file, "%s\n", EQ_WIDTH);      ///< Диапазон эквалайзера
-    fprintf(file, "%s\n", EQ_GAIN);       ///< Усиливание эквалайзера
-
-    fprintf(file, "%s\n", FLANGER_DEPTH); ///< Глубина фленжера
-}
-
-/**
- * Записывает специальный символ "_" в выходной файл.
- *
- * @param[out] file Выходной файл
- */
-void printSpaceBuffer(FILE *file) {
-    fputs("_\n", file);
-    fputs("0\n", file);                   ///< Тон равен 0
-    fprintf(file, "%s\n", VELOCITY);      ///< Скорость
-    fprintf(file, "%s\n", FREQ_VIBRO);    ///< Частота вибрато
-    fprintf(file, "%s\n", DEPTH_VIBRO);   ///< Глубина вибрато
-    fprintf(file, "%s\n", START_FADE_IN); ///< Начало fade-in
-    fprintf(file, "%s\n", DURATION_FADE_IN); ///< Длительность fade-in
-    fprintf(file, "%s\n", START_FADE_OUT); ///< Начало fade-out
-    fprintf(file, "%s\n", DURATION_FADE_OUT); ///< Длительность fade-out
-
-    fprintf(file, "%s\n", ECHO_FEEDBACK); ///< Обратная связь эха
-    fprintf(file, "%s\n", ECHO_GAIN_1);   ///< Задержка эха
-    fprintf(file, "%s\n", ECHO_DELAY);    ///< Задержка эха
-    fprintf(file, "%s\n", ECHO_GAIN_2);   ///< Обратная связь эха
-
-    fprintf(file, "%s\n", CHORUS_RATE);   ///< Темп хорового эффекта
-
-    fprintf(file, "%s\n", EQ_FREQ);       ///< Центральная частота эквалайзера
-    fprintf(file, "%s\n", EQ_TYPE);       ///< Тип эквалайзера
-    fprintf(file, "%s\n", EQ_WIDTH);      ///< Диапазон эквалайзера
-    fprintf(file, "%s\n", EQ_GAIN);       ///< Усиливание эквалайзера
+#include <stdio.h>          ///< Стандартная библиотека ввода-вывода
+#include <stdlib.h>
+#include <string.h>
 
-    fprintf(file, "%s\n", FLANGER_DEPTH); ///< Глубина фленжера
-}
+#include "tts.h"
 
 /**
  * Главная функция программы.
  *
- * Читает данные из файла `input2.txt`, обрабатывает их и записывает результат в `output.txt`.
+ * Читает данные из файла `input2.txt`, обрабатывает их и записывает результат в `output.txt`
+ * (или в `output.score` с ключом --binary).
  *
  * @return Код завершения программы (0 — успех)
  */
-int main() {
-    FILE *inFile = fopen("input2.txt", "r");    ///< Открываем входной файл
-    FILE *outFile = fopen("output.txt", "w");   ///< Открываем выходной файл
+int main(int argc, char **argv) {
+    int binary = 0;
+    const char *voicebankDir = "voicebank";
+    int threads = 0;                                 ///< 0 — по числу ядер
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--binary") == 0) {
+            binary = 1;
+        } else if (strncmp(argv[i], "--voicebank=", 12) == 0) {
+            voicebankDir = argv[i] + 12;
+        } else if (strncmp(argv[i], "--threads=", 10) == 0) {
+            threads = atoi(argv[i] + 10);
+        } else {
+            fprintf(stderr, "Неизвестный ключ: %s\n", argv[i]);
+            return 1;
+        }
+    }
+    const char *outName = binary ? "output.score" : "output.txt";
 
-    if (inFile == NULL || outFile == NULL) {
-        perror("Ошибка открытия файлов");
+    TtsInventory *inventory = tts_inventory_load(voicebankDir); ///< Набор слогов банка
+    if (inventory == NULL) {
+        fprintf(stderr, "Ошибка чтения каталога голосового банка %s\n", voicebankDir);
         return 1;
     }
 
-    char input[256];                            ///< Буфер для чтения строк
-    while (fgets(input, sizeof(input), inFile)) {
-        size_t len = strlen(input);
-        if (len > 0 && input[len - 1] == '\n') {
-            input[len - 1] = '\0';              ///< Удаляем символ новой строки
-        }
-
-        char buffer[8];                         ///< Буфер для хранения слогов
-        int buf_len = 0;
-        int space_count = 0;                    ///< Количество встреченных пробелов
-
-        for (size_t i = 0; i < len; ) {
-            char c = input[i++];
-
-            ///< Игнорируем первые два пробела
-            if (space_count < 2 && c == ' ') {
-                ++space_count;
-                continue;
-            }
-
-            ///< Другие непечатаемые символы пропускаем
-            if (!(isalpha(c) || c == '-' || c == '_')) {
-                continue;
-            }
-
-            if (c == ' ') {                     ///< Обработка пробела между словами
-                if (buf_len > 0) {
-                    printBuffer(outFile, buffer, buf_len); ///< выводим накопленный слог
-                    buf_len = 0;
-                }
+    size_t len = 0;
+    char *text = tts_read_file("input2.txt", &len); ///< Читаем входной файл
+    FILE *outFile = fopen(outName, binary ? "wb" : "w"); ///< Открываем выходной файл
 
-                printSpaceBuffer(outFile);       ///< специальный символ разделения слов
-                continue;
-            }
-
-            if (c == '-') {                     ///< Апостроф добавляется прямо в буфер
-                buffer[buf_len++] = c;
-                continue;
-            }
-
-            ///< Если накапливается больше одного символа
-            if (buf_len == 0) {
-                buffer[buf_len++] = c;
-                continue;
-            }
-
-            ///< Формируем временный буфер для анализа
-            char tempBuf[4] = {buffer[buf_len-1], c};
-            tempBuf[2] = '\0';
-
-            ///< Проверка особых комбинаций букв (например, "ch")
-            if (isSpecialCombination(tempBuf)) {
-                buffer[buf_len++] = c;
-                continue;
-            }
-
-            ///< Обработка пары согласная+гласная
-            if (isConsonant(buffer[0]) && isVowel(c)) {
-                buffer[buf_len++] = c;
-                printBuffer(outFile, buffer, buf_len); ///< выводим сочетание согласная-гласная
-                buf_len = 0;
-                continue;
-            }
-
-            ///< Специальные комбинации вида "ia", "io", "iu"
-            if (buf_len >= 1 &&
-                ((buffer[buf_len - 1] == 'i' && isVowel(c)) ||
-                 (buffer[buf_len - 1] == 'a' && c == 'i') ||
-                 (buffer[buf_len - 1] == 'o' && c == 'i'))) {
-                buffer[buf_len++] = c;
-                continue;
-            }
+    if (text == NULL || outFile == NULL) {
+        perror("Ошибка открытия файлов");
+        free(text);
+        if (outFile) fclose(outFile);
+        tts_inventory_free(inventory);
+        return 1;
+    }
 
-            ///< Общее правило
-            printBuffer(outFile, buffer, buf_len); ///< выводим текущий буфер
-            buf_len = 0;
-            buffer[buf_len++] = c;                 ///< формируем новый буфер
-        }
+    Score score;
+    tts_score_init(&score);
+    int rc = tts_syllabify_parallel(inventory, text, len, threads, &score);
+    free(text);
+    tts_inventory_free(inventory);
 
-        ///< Последний остаток буфера после цикла
-        if (buf_len > 0) {
-            printBuffer(outFile, buffer, buf_len);
-        }
+    if (rc == 0) {
+        rc = binary ? tts_score_write_binary(outFile, &score) : tts_score_write_text(outFile, &score);
     }
+    if (fclose(outFile) != 0) rc = -1;            ///< Закрытие файлов
+    tts_score_free(&score);
 
-    fclose(inFile);                               ///< Закрытие файлов
-    fclose(outFile);
-
+    if (rc != 0) {
+        fprintf(stderr, "Ошибка записи %s\n", outName);
+        return 1;
+    }
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,169 @@
+/**
+ * @file tts.c
+ * @brief Движок libtts: создание, проверка партитуры и полный синтез текста.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "tts_internal.h"
+
+char* tts_read_file(const char* path, size_t* len) {
+    FILE* f = fopen(path, "rb");
+    if (!f) return NULL;
+
+    size_t size = 0, allocated = 4096;
+    char* data = malloc(allocated);
+    size_t n;
+    while (data && (n = fread(data + size, 1, allocated - size - 1, f)) > 0) {
+        size += n;
+        if (allocated - size - 1 == 0) {
+            char* p = realloc(data, allocated * 2);
+            if (!p) {
+                free(data);
+                data = NULL;
+                break;
+            }
+            data = p;
+            allocated *= 2;
+        }
+    }
+    fclose(f);
+
+    if (!data) return NULL;
+    data[size] = '\0';
+    if (len) *len = size;
+    return data;
+}
+
+void tts_default_options(TtsOptions* options) {
+    memset(options, 0, sizeof(*options));
+    options->voicebank_dir = "voicebank";
+    options->backend = TTS_BACKEND_NATIVE;
+    options->threads = 0;
+    options->cache_enabled = 1;
+    options->cache_dir = NULL;
+    options->cache_max_mb = 512;
+    options->verbose = 0;
+}
+
+TtsEngine* tts_engine_create(const TtsOptions* options) {
+    TtsEngine* engine = calloc(1, sizeof(TtsEngine));
+    if (!engine) return NULL;
+
+    engine->options = *options;
+    snprintf(engine->voicebank_dir, sizeof(engine->voicebank_dir), "%s", options->voicebank_dir);
+
+    //! FFmpeg читает слоги из WAV-файлов, а в архиве их нет
+    int packed = voicebank_is_pack(engine->voicebank_dir);
+    if (packed && options->backend != TTS_BACKEND_NATIVE) {
+        printf("The ffmpeg backend needs a voicebank directory, not the archive %s\n", engine->voicebank_dir);
+        free(engine);
+        return NULL;
+    }
+
+    //! Один раз загружаем голосовой банк
+    if (voicebank_load(&engine->voicebank, engine->voicebank_dir) != 0) {
+        free(engine);
+        return NULL;
+    }
+
+    //! Слоги текста выбираются только из загруженных единиц
+    const char** names = malloc((engine->voicebank.count + 1) * sizeof(char*));
+    if (names) {
+        for (size_t i = 0; i < engine->voicebank.count; i++) {
+            names[i] = engine->voicebank.units[i].name;
+        }
+        engine->inventory = tts_inventory_create(names, engine->voicebank.count);
+        free(names);
+    }
+    if (!engine->inventory) {
+        voicebank_free(&engine->voicebank);
+        free(engine);
+        return NULL;
+    }
+
+    if (options->cache_enabled) {
+        char dir[600];
+        if (options->cache_dir) {
+            snprintf(dir, sizeof(dir), "%s", options->cache_dir);
+        } else if (packed) {
+            //! Кэш архива лежит рядом с ним: <архив без ".pack">.cache
+            snprintf(dir, sizeof(dir), "%.*s.cache", (int)strlen(engine->voicebank_dir) - 5, engine->voicebank_dir);
+        } else {
+            snprintf(dir, sizeof(dir), "%s/cache", engine->voicebank_dir);
+        }
+        if (render_cache_open(&engine->cache, dir, (uint64_t)options->cache_max_mb * 1024 * 1024) == 0) {
+            engine->cache_enabled = 1;
+        } else {
+            printf("Cannot open render cache %s, rendering without it\n", dir);
+        }
+    }
+    return engine;
+}
+
+void tts_engine_destroy(TtsEngine* engine) {
+    if (!engine) return;
+    if (engine->cache_enabled) {
+        render_cache_close(&engine->cache); //!< Сохраняем индекс кэша.
+    }
+    tts_inventory_free(engine->inventory);
+    voicebank_free(&engine->voicebank);
+    free(engine);
+}
+
+size_t tts_engine_unit_count(const TtsEngine* engine) {
+    return engine->voicebank.count;
+}
+
+const TtsInventory* tts_engine_inventory(const TtsEngine* engine) {
+    return engine->inventory;
+}
+
+void tts_engine_print_stats(TtsEngine* engine) {
+    if (engine->cache_enabled) {
+        render_cache_print_stats(&engine->cache);
+    }
+}
+
+int tts_check_score(TtsEngine* engine, const Score* score) {
+    int missing = voicebank_check(&engine->voicebank, (const char**)score->names, score->count);
+
+    //! Абсолютная нота пересчитывается от основного тона слога; без анализа слог не сдвигается
+    int unpitched = 0;
+    for (int i = 0; i < score->count; i++) {
+        if (score->pitches[i] < DSP_PITCH_NOTE) continue;
+        const VoiceUnit* u = voicebank_find_unit(&engine->voicebank, score->names[i]);
+        if (u && u->marks.f0 <= 0) {
+            if (unpitched++ == 0) printf("Warning: notes on units without pitch analysis are not shifted (run vbanalyze):\n");
+            if (unpitched <= 10) printf("  %s (syllable %d)\n", score->names[i], i + 1);
+        }
+    }
+    if (unpitched > 10) printf("  ... %d more\n", unpitched - 10);
+    return missing;
+}
+
+int tts_synthesize(TtsEngine* engine, const char* text, AudioBuffer* out) {
+    memset(out, 0, sizeof(*out));
+
+    //! Длинный текст транскрибируется и разбирается на слоги по кускам на тех же потоках, что и рендер
+    int threads = engine->options.threads > 0 ? engine->options.threads : workers_cpu_count();
+    size_t len = 0;
+    char* translit = tts_transliterate_parallel(text, strlen(text), threads, &len);
+    if (!translit) return -1;
+
+    Score score;
+    tts_score_init(&score);
+    int rc = tts_syllabify_parallel(engine->inventory, translit, len, threads, &score);
+    free(translit);
+
+    if (rc == 0 && tts_check_score(engine, &score) > 0) {
+        rc = -1; //!< Отсутствующие слоги уже перечислены
+    }
+    if (rc == 0) {
+        rc = tts_render(engine, &score, out);
+    }
+    tts_score_free(&score);
+    return rc;
+}
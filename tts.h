@@ -0,0 +1,494 @@
+/**
+ * @file tts.h
+ * @brief Встраиваемая библиотека синтеза речи: текст → слоги → PCM в одном процессе.
+ *
+ * Библиотека объединяет три этапа, которые раньше были отдельными программами,
+ * связанными файлами input.txt → input2.txt → output.txt:
+ *  - фонетическая транскрипция русского текста латиницей (poslogam);
+ *  - разбиение транскрипции на слоги с параметрами обработки (trnskrp);
+ *  - обработка слогов и сборка звука (mainffmpeg).
+ * Все этапы работают с данными в памяти; программы poslogam, trnskrp и mainffmpeg
+ * остаются тонкими обёртками над библиотекой, работающими с прежними файлами.
+ */
+
+#ifndef TTS_H
+#define TTS_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "dsp.h"
+#include "mapfile.h"
+
+/** @defgroup Score Партитура
+ * @{
+ */
+
+/**
+ * @brief Партитура — последовательность слогов с параметрами обработки.
+ *  Хранится параллельными массивами, по одному на каждый параметр из output.txt.
+ *  Все массивы нарезаются из одного блока памяти, имена слогов лежат в общих
+ *  блоках строк, поэтому загрузка не выделяет память на каждый слог.
+ */
+typedef struct {
+    int count;                 ///< Количество слогов
+    int allocated;             ///< Выделено мест в массивах
+    void* block;               ///< Общий блок памяти всех массивов
+    char** name_blocks;        ///< Блоки строк с именами слогов
+    int name_block_count;      ///< Количество блоков строк
+    size_t name_block_used;    ///< Занято байт в последнем блоке строк
+    size_t name_block_size;    ///< Размер последнего блока строк
+
+    char** names;              ///< Имена слогов (единиц голосового банка) без ".wav"
+    int* pitches;              ///< Сдвиг тона, полутоны, или нота (DSP_PITCH_NOTE + MIDI-номер)
+    float* durations;          ///< Ограничение длительности, сек
+    int* frequencies;          ///< Частоты вибрато
+    float* depths;             ///< Глубины вибрато
+    float* starts_fade_in;     ///< Начала нарастания громкости
+    float* durations_fade_in;  ///< Длительности нарастания громкости
+    float* starts_fade_out;    ///< Начала затухания громкости
+    float* durations_fade_out; ///< Длительности затухания громкости
+    float* Echo1;              ///< Коэффициенты первого эха
+    float* Echo2;              ///< Коэффициенты второго эха
+    float* Echo3;              ///< Коэффициенты третьего эха
+    float* Echo4;              ///< Коэффициенты четвёртого эха
+    float* chorus;             ///< Интенсивности хоруса
+    float* Equalizerf;         ///< Центральные частоты эквалайзера
+    float* Equalizert;         ///< Типы эквалайзера
+    float* Equalizerw;         ///< Ширины полосы эквалайзера
+    float* Equalizerg;         ///< Усиления эквалайзера
+    float* Flanger;            ///< Задержки фленджера
+} Score;
+
+/** @brief Инициализирует пустую партитуру. */
+void tts_score_init(Score* score);
+
+/** @brief Освобождает память партитуры. */
+void tts_score_free(Score* score);
+
+/**
+ * @brief Заранее выделяет место под capacity слогов (одним блоком для всех массивов).
+ * @return 0 при успехе, -1 при нехватке памяти.
+ */
+int tts_score_reserve(Score* score, int capacity);
+
+/**
+ * @brief Добавляет слог в конец партитуры.
+ * @param[in,out] score Партитура.
+ * @param[in] name Имя слога.
+ * @param[in] params Параметры обработки.
+ * @return 0 при успехе, -1 при нехватке памяти.
+ */
+int tts_score_append(Score* score, const char* name, const EffectParams* params);
+
+/**
+ * @brief Добавляет в конец партитуры слоги first..first+count-1 другой партитуры.
+ *  Параметры копируются столбцами, а не по одному слогу.
+ * @return 0 при успехе, -1 при нехватке памяти.
+ */
+int tts_score_append_range(Score* score, const Score* from, int first, int count);
+
+/** @brief Собирает параметры i-го слога в одну структуру. */
+void tts_score_params(const Score* score, int i, EffectParams* params);
+
+/** @brief Параметры «без заметных эффектов», которые trnskrp подставляет каждому слогу. */
+void tts_default_params(EffectParams* params);
+
+/**
+ * @brief Разбирает партитуру в текстовом формате output.txt (имя и 18 значений на слог)
+ *  за один проход, не копируя текст. Место под слоги выделяется заранее по размеру текста.
+ *  Неполная запись и значения, которые не являются числами, считаются ошибкой: сообщение
+ *  с номером строки печатается в виде "source:line: ...".
+ * @param[in] text Текст партитуры (завершающий ноль не требуется).
+ * @param[in] len Длина текста в байтах.
+ * @param[in] source Имя источника для сообщений об ошибках.
+ * @param[out] score Партитура (инициализируется функцией).
+ * @return 0 при успехе, -1 при ошибке формата или нехватке памяти.
+ */
+int tts_score_parse_text(const char* text, size_t len, const char* source, Score* score);
+
+/**
+ * @brief Читает партитуру в текстовом формате output.txt из открытого потока.
+ * @param[in] file Открытый файл.
+ * @param[out] score Партитура (инициализируется функцией).
+ * @return 0 при успехе, -1 при ошибке формата или нехватке памяти.
+ */
+int tts_score_read_text(FILE* file, Score* score);
+
+/**
+ * @brief Записывает партитуру в текстовом формате output.txt.
+ * @return 0 при успехе, -1 при ошибке записи.
+ */
+int tts_score_write_text(FILE* file, const Score* score);
+
+/**
+ * @brief Читает партитуру из файла, определяя формат по сигнатуре:
+ *  двоичный (TTS_SCORE_MAGIC) или текстовый формат output.txt.
+ * @param[in] path Путь к файлу.
+ * @param[out] score Партитура (инициализируется функцией).
+ * @return 0 при успехе, -1 если файл не читается или повреждён.
+ */
+int tts_score_load(const char* path, Score* score);
+/** @}*/
+
+/** @defgroup ScoreBinary Двоичный формат партитуры
+ * Файл состоит из заголовка, таблицы различающихся наборов параметров, записей слогов
+ * фиксированного размера и таблицы имён. Одинаковые наборы параметров и одинаковые имена
+ * хранятся один раз, записи ссылаются на них по индексу и смещению. Все поля выровнены
+ * на 4 байта и хранятся в порядке little-endian, поэтому отображённый в память файл
+ * используется без разбора.
+ * @{
+ */
+
+#define TTS_SCORE_MAGIC "TTSSCORE"  ///< Сигнатура двоичной партитуры (8 байт)
+#define TTS_SCORE_VERSION 1         ///< Версия формата
+
+/** @brief Заголовок двоичной партитуры. */
+typedef struct {
+    char magic[8];          ///< TTS_SCORE_MAGIC без завершающего нуля
+    uint32_t version;       ///< TTS_SCORE_VERSION
+    uint32_t count;         ///< Количество записей слогов
+    uint32_t param_count;   ///< Количество наборов параметров
+    uint32_t names_size;    ///< Размер таблицы имён в байтах
+} ScoreFileHeader;
+
+/** @brief Набор параметров обработки в файле — те же 18 значений, что и в output.txt. */
+typedef struct {
+    int32_t semitones;
+    float duration;
+    int32_t freq_vibro;
+    float depth_vibro;
+    float start_fade_in;
+    float duration_fade_in;
+    float start_fade_out;
+    float duration_fade_out;
+    float Echo1;
+    float Echo2;
+    float Echo3;
+    float Echo4;
+    float chorus;
+    float Equalizerf;
+    float Equalizert;
+    float Equalizerw;
+    float Equalizerg;
+    float Flanger;
+} ScoreFileParams;
+
+/** @brief Запись слога фиксированного размера. */
+typedef struct {
+    uint32_t name;          ///< Смещение имени (строка с нулём) в таблице имён
+    uint32_t params;        ///< Индекс набора параметров
+} ScoreFileRecord;
+
+/** @brief Двоичная партитура, отображённая в память. */
+typedef struct {
+    MappedFile file;                ///< Отображение файла
+    const ScoreFileParams* params;  ///< Наборы параметров
+    const ScoreFileRecord* records; ///< Записи слогов
+    const char* names;              ///< Таблица имён
+    int count;                      ///< Количество записей
+    int param_count;                ///< Количество наборов параметров
+} ScoreMap;
+
+/**
+ * @brief Отображает двоичную партитуру в память и проверяет её структуру.
+ *  После проверки записи читаются напрямую из отображения.
+ * @return 0 при успехе, -1 если файл не читается, не является партитурой или повреждён.
+ */
+int tts_score_map_open(ScoreMap* map, const char* path);
+
+/** @brief Имя i-го слога отображённой партитуры. */
+const char* tts_score_map_name(const ScoreMap* map, int i);
+
+/** @brief Параметры i-го слога отображённой партитуры. */
+void tts_score_map_params(const ScoreMap* map, int i, EffectParams* params);
+
+/** @brief Снимает отображение партитуры. */
+void tts_score_map_close(ScoreMap* map);
+
+/**
+ * @brief Записывает партитуру в двоичном формате.
+ * @return 0 при успехе, -1 при ошибке записи или нехватке памяти.
+ */
+int tts_score_write_binary(FILE* file, const Score* score);
+/** @}*/
+
+/** @defgroup Frontend Текстовая часть
+ * @{
+ */
+
+/**
+ * @brief Фонетическая транскрипция русского текста латиницей (бывший poslogam).
+ * @param[in] text Текст в UTF-8 (BOM в начале допускается).
+ * @param[in] len Длина текста в байтах.
+ * @param[out] out_len Длина результата в байтах (может быть NULL).
+ * @return Транскрипция в UTF-8, завершённая нулём (освобождается free()), или NULL.
+ */
+char* tts_transliterate(const char* text, size_t len, size_t* out_len);
+
+#define TTS_TRANSLIT_BUFFER 65536 ///< Размер выходного буфера потоковой транскрипции
+
+/**
+ * @brief Приёмник результата потоковой транскрипции.
+ * @return 0 при успехе, -1 при ошибке записи (транскрипция прекращается).
+ */
+typedef int (*TtsWriteFn)(const char* data, size_t len, void* ctx);
+
+/**
+ * @brief Состояние потоковой транскрипции: текст подаётся кусками любого размера,
+ *  результат копится в выходном буфере и отдаётся приёмнику крупными блоками.
+ *  Память не зависит от длины текста и строк; результат совпадает с tts_transliterate().
+ */
+typedef struct {
+    TtsWriteFn write;                  ///< Приёмник результата
+    void* ctx;                         ///< Контекст приёмника
+    char buffer[TTS_TRANSLIT_BUFFER];  ///< Выходной буфер
+    size_t used;                       ///< Заполнено байт буфера
+    unsigned char partial[4];          ///< Неполная последовательность UTF-8 в конце куска
+    size_t partial_len;                ///< Её длина
+    uint32_t prev;                     ///< Предыдущая кодовая точка строки, 0 в начале строки
+    uint32_t pending;                  ///< Согласная, ждущая следующую букву, или 0
+    int pending_cr;                    ///< Последним прочитан '\r' (перед '\n' он отбрасывается)
+    int line_open;                     ///< В текущей строке уже что-то прочитано
+    int started;                       ///< Начало текста пройдено (BOM проверен)
+    int failed;                        ///< Приёмник вернул ошибку
+} TtsTranslit;
+
+/** @brief Начинает потоковую транскрипцию с приёмником write. */
+void tts_translit_init(TtsTranslit* t, TtsWriteFn write, void* ctx);
+
+/**
+ * @brief Транскрибирует очередной кусок текста; кодовая точка может быть разрезана между кусками.
+ * @return 0 при успехе, -1 если приёмник вернул ошибку.
+ */
+int tts_translit_feed(TtsTranslit* t, const char* data, size_t len);
+
+/**
+ * @brief Завершает текст: дописывает последнюю строку и отдаёт остаток буфера приёмнику.
+ * @return 0 при успехе, -1 если приёмник вернул ошибку.
+ */
+int tts_translit_finish(TtsTranslit* t);
+
+/**
+ * @brief Читает файл целиком (в двоичном режиме).
+ * @param[in] path Путь к файлу.
+ * @param[out] len Длина содержимого в байтах (может быть NULL).
+ * @return Содержимое, завершённое нулём (освобождается free()), или NULL.
+ */
+char* tts_read_file(const char* path, size_t* len);
+
+/**
+ * @brief Набор слогов голосового банка, скомпилированный в префиксный автомат
+ *  для разбиения транскрипции на слоги наибольшим совпадением.
+ */
+typedef struct TtsInventory TtsInventory;
+
+#define TTS_UNIT_NAME_MAX 31 ///< Наибольшая длина имени слога в наборе; более длинные пропускаются
+
+/**
+ * @brief Строит набор слогов по именам единиц.
+ * @param[in] names Имена слогов без ".wav".
+ * @param[in] count Количество имён.
+ * @return Набор (освобождается tts_inventory_free()) или NULL при нехватке памяти.
+ */
+TtsInventory* tts_inventory_create(const char* const* names, size_t count);
+
+/**
+ * @brief Строит набор слогов по файлам каталога голосового банка, не читая сами WAV.
+ * @return Набор или NULL, если каталог не читается.
+ */
+TtsInventory* tts_inventory_load(const char* dir);
+
+/** @brief Освобождает набор слогов. */
+void tts_inventory_free(TtsInventory* inventory);
+
+/**
+ * @brief Разбиение транскрипции на слоги (бывший trnskrp).
+ *  Слоги выбираются жадно: с текущей позиции берётся самый длинный слог набора,
+ *  совпадающий с транскрипцией (пробелы и знаки препинания внутри пропускаются).
+ *  Если длинного сочетания в наборе нет, берутся более короткие слоги; символ,
+ *  с которого не начинается ни один слог, пропускается. Поэтому каждый слог
+ *  результата есть в наборе. Время линейно по длине текста, память не зависит от длины строк.
+ *  Каждый слог добавляется в партитуру с параметрами tts_default_params().
+ * @param[in] inventory Набор слогов голосового банка.
+ * @param[in] text Транскрипция, построчно.
+ * @param[in] len Длина в байтах.
+ * @param[in,out] score Партитура, в которую добавляются слоги.
+ * @return 0 при успехе, -1 при нехватке памяти.
+ */
+int tts_syllabify(const TtsInventory* inventory, const char* text, size_t len, Score* score);
+
+/**
+ * @brief Параллельная транскрипция длинного текста; результат совпадает с tts_transliterate().
+ *  Текст режется на куски по переводам строк и концам предложений (". ", "! ", "? "),
+ *  куски транскрибируются на разных потоках и склеиваются по порядку.
+ * @param[in] threads Потоков, 0 — по числу ядер. Короткий текст обрабатывается в одном куске.
+ */
+char* tts_transliterate_parallel(const char* text, size_t len, int threads, size_t* out_len);
+
+/**
+ * @brief Параллельное разбиение транскрипции на слоги; результат совпадает с tts_syllabify().
+ *  Слог может начаться до границы куска и закончиться после неё, поэтому при склейке
+ *  разбор продолжается от конца предыдущего куска, пока не сойдётся с разбором следующего.
+ * @param[in] threads Потоков, 0 — по числу ядер.
+ * @return 0 при успехе, -1 при нехватке памяти.
+ */
+int tts_syllabify_parallel(const TtsInventory* inventory, const char* text, size_t len, int threads,
+    Score* score);
+/** @}*/
+
+/** @defgroup Engine Движок рендера
+ * @{
+ */
+
+/** @brief Способ обработки отдельного слога. */
+typedef enum {
+    TTS_BACKEND_NATIVE, ///< Встроенный движок dsp.c, без запуска внешних процессов
+    TTS_BACKEND_FFMPEG, ///< Эталонный путь: отдельный процесс FFmpeg на каждый слог
+    TTS_BACKEND_FFMPEG_GRAPH ///< Один процесс FFmpeg на весь рендер: граф filter_complex из файла скрипта
+} TtsBackend;
+
+/** @brief Настройки движка. */
+typedef struct {
+    const char* voicebank_dir;   ///< Каталог голосового банка или архив *.pack (только встроенный движок)
+    TtsBackend backend;          ///< Способ обработки слогов
+    int threads;                 ///< Потоков рендера, 0 — по числу ядер
+    int cache_enabled;           ///< Использовать кэш обработанных слогов
+    const char* cache_dir;       ///< Каталог кэша, NULL — <voicebank_dir>/cache (для архива X.pack — X.cache)
+    unsigned long cache_max_mb;  ///< Предельный объём кэша, МБ
+    int verbose;                 ///< Печатать ход обработки каждого слога
+} TtsOptions;
+
+/** @brief Движок: загруженный голосовой банк, кэш и настройки. */
+typedef struct TtsEngine TtsEngine;
+
+/** @brief Заполняет настройки значениями по умолчанию. */
+void tts_default_options(TtsOptions* options);
+
+/**
+ * @brief Создаёт движок и загружает голосовой банк.
+ * @return Движок или NULL, если каталог голосового банка не читается.
+ */
+TtsEngine* tts_engine_create(const TtsOptions* options);
+
+/** @brief Сохраняет индекс кэша и освобождает движок. */
+void tts_engine_destroy(TtsEngine* engine);
+
+/** @brief Количество единиц в загруженном голосовом банке. */
+size_t tts_engine_unit_count(const TtsEngine* engine);
+
+/** @brief Набор слогов загруженного голосового банка для tts_syllabify(). */
+const TtsInventory* tts_engine_inventory(const TtsEngine* engine);
+
+/** @brief Печатает статистику кэша (если он включён). */
+void tts_engine_print_stats(TtsEngine* engine);
+
+/**
+ * @brief Проверяет, что все слоги партитуры есть в голосовом банке, и печатает отсутствующие.
+ *  Также предупреждает о нотах на слогах без частоты основного тона.
+ * @return Количество отсутствующих слогов.
+ */
+int tts_check_score(TtsEngine* engine, const Score* score);
+
+/**
+ * @brief Обрабатывает все слоги партитуры и склеивает их в порядке партитуры.
+ * @param[in] engine Движок.
+ * @param[in] score Партитура.
+ * @param[out] out Результат (освобождается audio_free()).
+ * @return 0 при успехе, -1 при ошибке.
+ */
+int tts_render(TtsEngine* engine, const Score* score, AudioBuffer* out);
+
+/**
+ * @brief Обрабатывает слоги first..first+count-1 и склеивает их в порядке партитуры.
+ *  Склейка соседних диапазонов даёт тот же звук, что и tts_render() всей партитуры,
+ *  поэтому длинную партитуру можно выдавать по частям, не дожидаясь конца рендера.
+ * @return 0 при успехе, -1 при ошибке или диапазоне за пределами партитуры.
+ */
+int tts_render_range(TtsEngine* engine, const Score* score, int first, int count, AudioBuffer* out);
+
+/**
+ * @brief Рендер длинной партитуры прямо в файл WAV с ограниченной памятью.
+ *  Партитура обрабатывается окнами из подряд идущих слогов, каждое окно сразу
+ *  дописывается в файл и освобождается, поэтому память не растёт с длиной партитуры.
+ *  Отсчёты файла совпадают с tts_render() всей партитуры; файл больше 4 ГБ
+ *  записывается как RF64.
+ * @param[in] path Файл результата; заменяется атомарно, при ошибке прежний файл остаётся.
+ * @param[in] max_memory Предел памяти на окно, байт (окно — не меньше одного слога).
+ * @param[out] frames Записано кадров (может быть NULL).
+ * @return 0 при успехе, -1 при ошибке.
+ */
+int tts_render_to_file(TtsEngine* engine, const Score* score, const char* path, size_t max_memory,
+    uint64_t* frames);
+
+#define TTS_DEADLINE_EXPIRED (-2) ///< Код возврата tts_render_until() при истёкшем сроке
+
+/**
+ * @brief Как tts_render(), но с крайним сроком: после него оставшиеся слоги не обрабатываются,
+ *  а запущенный процесс FFmpeg (бэкенд TTS_BACKEND_FFMPEG_GRAPH) завершается.
+ * @param[in] deadline Момент по часам workers_time(), 0 — без срока.
+ * @return 0 при успехе, TTS_DEADLINE_EXPIRED, если срок истёк, -1 при ошибке.
+ */
+int tts_render_until(TtsEngine* engine, const Score* score, double deadline, AudioBuffer* out);
+
+#define TTS_MANIFEST_VERSION 1 ///< Версия текстового формата манифеста рендера
+
+/**
+ * @brief Манифест рендера: что и где лежит в записанном результате.
+ *  Ключ слога — тот же, что у кэша обработанных слогов (содержимое единицы, метки
+ *  и все параметры), поэтому совпадение ключа означает совпадение звука слога.
+ */
+typedef struct {
+    uint64_t* keys;         ///< Ключ обработки каждого слога
+    size_t* offsets;        ///< Первый кадр слога в результате
+    size_t* frames;         ///< Кадров слога
+    int count;              ///< Слогов
+    size_t total_frames;    ///< Кадров в результате
+    int channels;           ///< Каналов результата
+    int sample_rate;        ///< Частота дискретизации результата
+    uint64_t audio_hash;    ///< Хеш отсчётов PCM16 результата: файл не изменён после записи
+} TtsManifest;
+
+/** @brief Инициализирует пустой манифест. */
+void tts_manifest_init(TtsManifest* manifest);
+
+/** @brief Освобождает манифест. */
+void tts_manifest_free(TtsManifest* manifest);
+
+/**
+ * @brief Читает манифест.
+ * @return 0 при успехе, -1 если файла нет, он другой версии или повреждён.
+ */
+int tts_manifest_load(const char* path, TtsManifest* manifest);
+
+/** @brief Записывает манифест; 0 при успехе, -1 при ошибке записи. */
+int tts_manifest_save(const char* path, const TtsManifest* manifest);
+
+/**
+ * @brief Рендер с повторным использованием предыдущего результата.
+ *  Слоги, чей ключ есть в предыдущем манифесте, копируются из previous_audio (где бы они
+ *  там ни стояли), остальные обрабатываются как в tts_render(). Предыдущий результат
+ *  используется, только если он совпадает с манифестом по формату, длине и хешу;
+ *  результат совпадает с полным рендером после записи в PCM16.
+ * @param[in] previous Манифест прошлого рендера или NULL.
+ * @param[in] previous_audio Прошлый результат, прочитанный из файла, или NULL.
+ * @param[out] out Результат (освобождается audio_free()).
+ * @param[out] manifest Манифест нового результата (освобождается tts_manifest_free()).
+ * @param[out] reused Сколько слогов взято из прошлого результата (может быть NULL).
+ * @return 0 при успехе, -1 при ошибке.
+ */
+int tts_render_incremental(TtsEngine* engine, const Score* score, const TtsManifest* previous,
+    const AudioBuffer* previous_audio, AudioBuffer* out, TtsManifest* manifest, int* reused);
+
+/**
+ * @brief Полный синтез: текст → транскрипция → слоги → звук.
+ * @param[in] engine Движок.
+ * @param[in] text Русский текст в UTF-8.
+ * @param[out] out Результат (освобождается audio_free()).
+ * @return 0 при успехе, -1 при ошибке или отсутствии слогов в банке.
+ */
+int tts_synthesize(TtsEngine* engine, const char* text, AudioBuffer* out);
+/** @}*/
+
+#endif /* TTS_H */
@@ -0,0 +1,316 @@
+/**
+ * @file tts_frontend.c
+ * @brief Параллельный текстовый фронтенд: транскрипция и разбиение на слоги по кускам.
+ *
+ * Текст режется на куски по переводам строк, а длинные строки — после пробела,
+ * завершающего предложение. После '\n' транскрипция начинается заново, а сразу
+ * после пробела её состояние известно заранее (предыдущий символ — пробел,
+ * отложенной согласной нет), поэтому куски транскрибируются независимо и
+ * склеиваются по порядку.
+ *
+ * Разбиение на слоги продолжается через пробелы, так что слог с конца куска
+ * может захватить начало следующего. Каждый кусок разбирается со своего начала,
+ * а при склейке разбор продолжается от конца предыдущего куска, пока не попадёт
+ * на начало одного из слогов следующего: шаг разбора зависит только от позиции,
+ * поэтому дальше оба разбора совпадают. Обычно это происходит сразу.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "tts_internal.h"
+#include "workers.h"
+
+#define FRONTEND_MIN_CHUNK 65536 ///< Наименьший кусок: на более мелких потоки не окупаются
+
+/** @brief Кусок текста. */
+typedef struct {
+    size_t start;  ///< Начало куска
+    size_t end;    ///< Конец куска (начало следующего)
+    int mid_line;  ///< Кусок начинается после пробела внутри строки, а не с начала строки
+} Chunk;
+
+/** @brief Первая граница строки или предложения не раньше from; конец текста, если их нет. */
+static size_t find_boundary(const char* text, size_t len, size_t from, int* mid_line) {
+    for (size_t i = from; i < len; i++) {
+        if (text[i] == '\n') {
+            *mid_line = 0;
+            return i + 1;
+        }
+        if (text[i] == ' ' && (text[i - 1] == '.' || text[i - 1] == '!' || text[i - 1] == '?')) {
+            *mid_line = 1;
+            return i + 1;
+        }
+    }
+    *mid_line = 0;
+    return len;
+}
+
+/**
+ * @brief Режет текст на куски примерно по len / (threads * 4) байт, но не меньше FRONTEND_MIN_CHUNK.
+ * @return Количество кусков (не меньше 1) или -1 при нехватке памяти.
+ */
+static int split_text(const char* text, size_t len, int threads, Chunk** chunks) {
+    size_t target = len / ((size_t)threads * 4);
+    if (target < FRONTEND_MIN_CHUNK) target = FRONTEND_MIN_CHUNK;
+
+    int count = 0, allocated = 16;
+    *chunks = malloc(allocated * sizeof(Chunk));
+    if (!*chunks) return -1;
+
+    size_t start = 0;
+    int mid_line = 0;
+    do {
+        if (count == allocated) {
+            allocated *= 2;
+            Chunk* grown = realloc(*chunks, allocated * sizeof(Chunk));
+            if (!grown) {
+                free(*chunks);
+                return -1;
+            }
+            *chunks = grown;
+        }
+        int next_mid_line = 0;
+        size_t end = len - start > target ? find_boundary(text, len, start + target, &next_mid_line) : len;
+        (*chunks)[count].start = start;
+        (*chunks)[count].end = end;
+        (*chunks)[count].mid_line = mid_line;
+        count++;
+        start = end;
+        mid_line = next_mid_line;
+    } while (start < len);
+    return count;
+}
+
+/** @brief Результат транскрипции одного куска. */
+typedef struct {
+    char* data;   ///< Байты результата
+    size_t len;   ///< Заполнено байт
+    size_t cap;   ///< Выделено байт
+    int failed;   ///< Нехватка памяти
+} Piece;
+
+/** @brief Приёмник, дописывающий результат в Piece. */
+static int piece_write(const char* data, size_t len, void* ctx) {
+    Piece* piece = ctx;
+    if (piece->len + len > piece->cap) {
+        size_t cap = piece->cap ? piece->cap * 2 : 4096;
+        while (cap < piece->len + len) cap *= 2;
+        char* p = realloc(piece->data, cap);
+        if (!p) return -1;
+        piece->data = p;
+        piece->cap = cap;
+    }
+    memcpy(piece->data + piece->len, data, len);
+    piece->len += len;
+    return 0;
+}
+
+/** @brief Общий контекст заданий транскрипции. */
+typedef struct {
+    const char* text;
+    const Chunk* chunks;
+    int count;
+    Piece* pieces;
+} TranslitJobs;
+
+/** @brief Задание пула потоков: транскрибирует один кусок. */
+static void translit_job(int k, void* ctx) {
+    TranslitJobs* jobs = ctx;
+    const Chunk* c = &jobs->chunks[k];
+    Piece* piece = &jobs->pieces[k];
+
+    TtsTranslit* t = malloc(sizeof(TtsTranslit));
+    if (!t) {
+        piece->failed = 1;
+        return;
+    }
+    if (k == 0) {
+        tts_translit_init(t, piece_write, piece);
+    } else {
+        translit_resume(t, piece_write, piece, c->mid_line);
+    }
+    int rc = tts_translit_feed(t, jobs->text + c->start, c->end - c->start);
+    //! Строка, разрезанная после пробела, завершится в следующем куске
+    int ends_mid_line = k + 1 < jobs->count && jobs->chunks[k + 1].mid_line;
+    if (rc == 0) rc = ends_mid_line ? translit_flush(t) : tts_translit_finish(t);
+    piece->failed = rc != 0;
+    free(t);
+}
+
+char* tts_transliterate_parallel(const char* text, size_t len, int threads, size_t* out_len) {
+    if (threads <= 0) threads = workers_cpu_count();
+    Chunk* chunks;
+    int count = split_text(text, len, threads, &chunks);
+    if (count < 0) return NULL;
+    if (count == 1) {
+        free(chunks);
+        return tts_transliterate(text, len, out_len);
+    }
+
+    Piece* pieces = calloc(count, sizeof(Piece));
+    char* result = NULL;
+    if (pieces) {
+        TranslitJobs jobs = { text, chunks, count, pieces };
+        workers_run(count, threads, translit_job, &jobs);
+
+        //! Склейка по порядку кусков
+        size_t total = 0;
+        int failed = 0;
+        for (int k = 0; k < count; k++) {
+            total += pieces[k].len;
+            failed |= pieces[k].failed;
+        }
+        result = failed ? NULL : malloc(total + 1);
+        if (result) {
+            size_t pos = 0;
+            for (int k = 0; k < count; k++) {
+                if (pieces[k].len > 0) memcpy(result + pos, pieces[k].data, pieces[k].len);
+                pos += pieces[k].len;
+            }
+            result[total] = '\0';
+            if (out_len) *out_len = total;
+        }
+        for (int k = 0; k < count; k++) {
+            free(pieces[k].data);
+        }
+    }
+    free(pieces);
+    free(chunks);
+    return result;
+}
+
+/** @brief Разбор одного куска на слоги. */
+typedef struct {
+    Score score;      ///< Слоги куска с параметрами по умолчанию
+    size_t* starts;   ///< Позиция шага, на котором найден каждый слог
+    int allocated;    ///< Выделено мест в starts
+    size_t final;     ///< Позиция, на которой разбор вышел за конец куска
+    int first;        ///< Первый слог, вошедший в результат (после склейки)
+    Score fixup;      ///< Слоги, разобранные при склейке перед first
+    int failed;       ///< Нехватка памяти
+} Syllables;
+
+/** @brief Общий контекст заданий разбиения на слоги. */
+typedef struct {
+    const TtsInventory* inventory;
+    const unsigned char* text;
+    size_t len;
+    const Chunk* chunks;
+    Syllables* parts;
+} SyllabifyJobs;
+
+/** @brief Задание пула потоков: разбирает кусок с его начала; последний слог может выйти за конец. */
+static void syllabify_job(int k, void* ctx) {
+    SyllabifyJobs* jobs = ctx;
+    const Chunk* c = &jobs->chunks[k];
+    Syllables* w = &jobs->parts[k];
+    EffectParams params;
+    char name[TTS_UNIT_NAME_MAX + 1];
+    int name_len;
+
+    tts_default_params(&params);
+    size_t i = c->start;
+    while (i < c->end) {
+        size_t at = i;
+        i = syllabify_step(jobs->inventory, jobs->text, jobs->len, i, name, &name_len);
+        if (name_len == 0) continue;
+        if (w->score.count == w->allocated) {
+            int allocated = w->allocated ? w->allocated * 2 : 1024;
+            size_t* grown = realloc(w->starts, allocated * sizeof(size_t));
+            if (!grown) {
+                w->failed = 1;
+                return;
+            }
+            w->starts = grown;
+            w->allocated = allocated;
+        }
+        w->starts[w->score.count] = at;
+        if (tts_score_append(&w->score, name, &params) != 0) {
+            w->failed = 1;
+            return;
+        }
+    }
+    w->final = i;
+}
+
+/**
+ * @brief Склейка: ведёт последовательный разбор от конца предыдущего куска, пока он не
+ *  попадёт на начало куска или одного из его слогов; слоги до этой точки идут в fixup.
+ * @param[in,out] pos Позиция последовательного разбора.
+ * @return 0 при успехе, -1 при нехватке памяти.
+ */
+static int stitch_chunk(const TtsInventory* inventory, const unsigned char* s, size_t len,
+    const Chunk* c, Syllables* w, size_t* pos) {
+    EffectParams params;
+    char name[TTS_UNIT_NAME_MAX + 1];
+    int name_len;
+
+    tts_default_params(&params);
+    w->first = w->score.count; //!< Кусок целиком перекрыт слогами предыдущего
+    int j = 0;
+    while (*pos < c->end) {
+        while (j < w->score.count && w->starts[j] < *pos) j++;
+        if (*pos == c->start || (j < w->score.count && w->starts[j] == *pos)) {
+            w->first = j;          //!< Разбор сошёлся с разбором куска: дальше они совпадают
+            *pos = w->final;
+            return 0;
+        }
+        *pos = syllabify_step(inventory, s, len, *pos, name, &name_len);
+        if (name_len > 0 && tts_score_append(&w->fixup, name, &params) != 0) return -1;
+    }
+    return 0;
+}
+
+int tts_syllabify_parallel(const TtsInventory* inventory, const char* text, size_t len, int threads,
+    Score* score) {
+    if (threads <= 0) threads = workers_cpu_count();
+    Chunk* chunks;
+    int count = split_text(text, len, threads, &chunks);
+    if (count < 0) return -1;
+    if (count == 1) {
+        free(chunks);
+        return tts_syllabify(inventory, text, len, score);
+    }
+
+    Syllables* parts = calloc(count, sizeof(Syllables));
+    if (!parts) {
+        free(chunks);
+        return -1;
+    }
+    for (int k = 0; k < count; k++) {
+        tts_score_init(&parts[k].score);
+        tts_score_init(&parts[k].fixup);
+    }
+    const unsigned char* s = (const unsigned char*)text;
+    SyllabifyJobs jobs = { inventory, s, len, chunks, parts };
+    workers_run(count, threads, syllabify_job, &jobs);
+
+    //! Склейка последовательна, но обычно не разбирает ни одного слога заново
+    int rc = 0;
+    size_t pos = 0;
+    int total = score->count;
+    for (int k = 0; k < count && rc == 0; k++) {
+        rc = parts[k].failed ? -1 : stitch_chunk(inventory, s, len, &chunks[k], &parts[k], &pos);
+        total += parts[k].fixup.count + parts[k].score.count - parts[k].first;
+    }
+
+    //! Сборка результата столбцами
+    if (rc == 0) rc = tts_score_reserve(score, total);
+    for (int k = 0; k < count && rc == 0; k++) {
+        rc = tts_score_append_range(score, &parts[k].fixup, 0, parts[k].fixup.count);
+        if (rc == 0) {
+            rc = tts_score_append_range(score, &parts[k].score, parts[k].first,
+                parts[k].score.count - parts[k].first);
+        }
+    }
+
+    for (int k = 0; k < count; k++) {
+        tts_score_free(&parts[k].score);
+        tts_score_free(&parts[k].fixup);
+        free(parts[k].starts);
+    }
+    free(parts);
+    free(chunks);
+    return rc;
+}
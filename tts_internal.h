@@ -0,0 +1,78 @@
+/**
+ * @file tts_internal.h
+ * @brief Внутреннее устройство движка libtts, общее для его модулей.
+ */
+
+#ifndef TTS_INTERNAL_H
+#define TTS_INTERNAL_H
+
+#include "tts.h"
+#include "voicebank.h"
+#include "render_cache.h"
+
+#define MAX_CMD_SIZE 1024
+
+/** @brief Движок: загруженный голосовой банк, кэш и настройки рендера. */
+struct TtsEngine {
+    TtsOptions options;     ///< Копия настроек
+    char voicebank_dir[512];///< Каталог голосового банка (для FFmpeg)
+    Voicebank voicebank;    ///< Голосовой банк, загружаемый один раз
+    TtsInventory* inventory;///< Набор слогов банка для разбиения текста
+    RenderCache cache;      ///< Постоянный кэш обработанных слогов
+    int cache_enabled;      ///< Кэш открыт и используется
+};
+
+/**
+ * @brief Начинает транскрипцию куска, вырезанного из текста (см. tts_frontend.c):
+ *  кусок начинается после '\n' (mid_line = 0) или сразу после пробела внутри строки (mid_line = 1).
+ *  Результаты кусков, сложенные по порядку, совпадают с транскрипцией всего текста.
+ */
+void translit_resume(TtsTranslit* t, TtsWriteFn write, void* ctx, int mid_line);
+
+/** @brief Отдаёт накопленный результат, не завершая строку (кусок кончается пробелом внутри строки). */
+int translit_flush(TtsTranslit* t);
+
+/**
+ * @brief Один шаг жадного разбиения на слоги с позиции i (см. tts_syllabify.c).
+ * @param[out] name Слог (не меньше TTS_UNIT_NAME_MAX + 1 байт).
+ * @param[out] name_len Длина слога, 0 — шаг только пропустил символ.
+ * @return Позиция следующего шага; результат зависит только от i, а не от предыдущих шагов.
+ */
+size_t syllabify_step(const TtsInventory* inv, const unsigned char* s, size_t len, size_t i,
+    char* name, int* name_len);
+
+/** @brief Выделяет массивы манифеста на count слогов; при ошибке манифест остаётся пустым. */
+int manifest_reserve(TtsManifest* manifest, int count);
+
+/** @brief Хеш отсчётов в том виде, в каком их записывает wav_write() (PCM16). */
+uint64_t manifest_audio_hash(const AudioBuffer* audio);
+
+/**
+ * @brief Формирует командную строку FFmpeg для обработки одного слога (см. tts_render.c).
+ */
+char* create_ffmpeg_command(
+    char* cmd,
+    size_t cmdSize,
+    const char* input, 
+    const char* output, 
+    double factor, 
+    float duration, 
+    int freq_vibro, 
+    float depth_vibro, 
+    float start_fade_in, 
+    float duration_fade_in, 
+    float start_fade_out, 
+    float duration_fade_out,
+    float Echo1,
+    float Echo2,
+    float Echo3,
+    float Echo4,
+    float chorus,
+    float Equalizerf,
+    float Equalizert,
+    float Equalizerw,
+    float Equalizerg,
+    float Flanger
+);
+
+#endif /* TTS_INTERNAL_H */
@@ -0,0 +1,113 @@
+/**
+ * @file tts_manifest.c
+ * @brief Манифест рендера: ключи и положение слогов в записанном результате.
+ *
+ * Текстовый формат, как у индекса кэша:
+ *
+ *     ttsmanifest 1
+ *     <кадров> <каналов> <частота> <хеш PCM16>
+ *     <ключ слога> <первый кадр> <кадров>      — по строке на слог
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include "tts_internal.h"
+#include "dsp_simd.h"
+
+void tts_manifest_init(TtsManifest* manifest) {
+    memset(manifest, 0, sizeof(*manifest));
+}
+
+void tts_manifest_free(TtsManifest* manifest) {
+    free(manifest->keys);
+    free(manifest->offsets);
+    free(manifest->frames);
+    tts_manifest_init(manifest);
+}
+
+int manifest_reserve(TtsManifest* manifest, int count) {
+    manifest->keys = malloc((count + 1) * sizeof(uint64_t));
+    manifest->offsets = malloc((count + 1) * sizeof(size_t));
+    manifest->frames = malloc((count + 1) * sizeof(size_t));
+    if (!manifest->keys || !manifest->offsets || !manifest->frames) {
+        tts_manifest_free(manifest);
+        return -1;
+    }
+    return 0;
+}
+
+uint64_t manifest_audio_hash(const AudioBuffer* audio) {
+    //! Хеш берётся по отсчётам в том виде, в каком они попадут в файл
+    uint64_t h = 14695981039346656037ull;
+    unsigned char block[4096];
+    size_t total = audio->frames * audio->channels;
+    for (size_t i = 0; i < total; ) {
+        size_t n = total - i < sizeof(block) / 2 ? total - i : sizeof(block) / 2;
+        dsp_pcm16_encode(audio->samples + i, block, n);
+        for (size_t k = 0; k + 8 <= n * 2; k += 8) {
+            uint64_t w;
+            memcpy(&w, block + k, 8);
+            h = (h ^ w) * 1099511628211ull;
+        }
+        for (size_t k = (n * 2) & ~(size_t)7; k < n * 2; k++) {
+            h = (h ^ block[k]) * 1099511628211ull;
+        }
+        i += n;
+    }
+    return h;
+}
+
+int tts_manifest_load(const char* path, TtsManifest* manifest) {
+    tts_manifest_init(manifest);
+    FILE* f = fopen(path, "r");
+    if (!f) return -1;
+
+    int version = 0, count = 0, channels = 0, sample_rate = 0;
+    uint64_t total = 0, hash = 0;
+    int ok = fscanf(f, "ttsmanifest %d %d", &version, &count) == 2 && version == TTS_MANIFEST_VERSION &&
+        count >= 0 && fscanf(f, "%" SCNu64 " %d %d %" SCNx64, &total, &channels, &sample_rate, &hash) == 4 &&
+        manifest_reserve(manifest, count) == 0;
+
+    //! Слоги идут подряд: каждый начинается там, где кончился предыдущий
+    uint64_t next = 0;
+    for (int i = 0; i < count && ok; i++) {
+        uint64_t key, offset, frames;
+        ok = fscanf(f, "%" SCNx64 " %" SCNu64 " %" SCNu64, &key, &offset, &frames) == 3 && offset == next &&
+            frames <= total - offset;
+        if (!ok) break;
+        manifest->keys[i] = key;
+        manifest->offsets[i] = (size_t)offset;
+        manifest->frames[i] = (size_t)frames;
+        next = offset + frames;
+    }
+    fclose(f);
+    if (!ok || next != total) {
+        tts_manifest_free(manifest);
+        return -1;
+    }
+    manifest->count = count;
+    manifest->total_frames = (size_t)total;
+    manifest->channels = channels;
+    manifest->sample_rate = sample_rate;
+    manifest->audio_hash = hash;
+    return 0;
+}
+
+int tts_manifest_save(const char* path, const TtsManifest* manifest) {
+    FILE* f = fopen(path, "w");
+    if (!f) return -1;
+    fprintf(f, "ttsmanifest %d %d\n", TTS_MANIFEST_VERSION, manifest->count);
+    fprintf(f, "%" PRIu64 " %d %d %016" PRIx64 "\n", (uint64_t)manifest->total_frames, manifest->channels,
+        manifest->sample_rate, manifest->audio_hash);
+    for (int i = 0; i < manifest->count; i++) {
+        fprintf(f, "%016" PRIx64 " %" PRIu64 " %" PRIu64 "\n", manifest->keys[i],
+            (uint64_t)manifest->offsets[i], (uint64_t)manifest->frames[i]);
+    }
+    int ok = !ferror(f);
+    if (fclose(f) != 0) ok = 0;
+    if (!ok) remove(path);
+    return ok ? 0 : -1;
+}
@@ -0,0 +1,984 @@
+/**
+ * @file tts_render.c
+ * @brief Рендер партитуры: обработка слогов встроенным движком или FFmpeg и сборка в памяти.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "tts_internal.h"
+#include "workers.h"
+#include "dsp_simd.h"
+#include "trace.h"
+
+#ifndef _WIN32
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#endif
+
+/**
+ * @brief Ключ обработанного слога для кэша и манифеста: содержимое исходного слога плюс
+ *  все параметры обработки; при сдвиге тона результат зависит и от меток основного тона.
+ */
+static uint64_t syllable_key(const TtsEngine* engine, const VoiceUnit* unit, const EffectParams* params) {
+    uint64_t source_hash = unit->hash;
+    if (params->semitones != 0 && unit->marks.count > 0) {
+        source_hash = (source_hash ^ unit->marks.hash) * 1099511628211ull;
+    }
+    return render_cache_key(source_hash, (int)engine->options.backend, params);
+}
+
+/**
+ * @brief Цепочка фильтров FFmpeg для одного слога: от asetrate до aresample, через запятую.
+ *  Общая для команды на слог и для графа всей партитуры; условия включения эффектов
+ *  совпадают с dsp_chain_mask().
+ * @param[out] buf Буфер для цепочки.
+ * @param[in] size Размер буфера buf.
+ * @param[in] factor Во сколько раз повышается тон (см. dsp_pitch_factor()).
+ * @param[in] p Параметры обработки (semitones и duration не используются).
+ */
+static void ffmpeg_filters(char* buf, size_t size, double factor, const EffectParams* p) {
+    buf[0] = '\0';
+    //! Добавляем фильтры для изменения частоты и темпоральной характеристики звука
+    snprintf(buf + strlen(buf), size - strlen(buf), 
+        "asetrate=44100*%.5f,atempo=1/%.5f", factor, factor);
+
+    //! Если включены параметры вибрато, добавляем этот эффект
+    if (p->freq_vibro > 0 && p->depth_vibro > 0) {
+        snprintf(buf + strlen(buf), size - strlen(buf), 
+            ",vibrato=f=%d:d=%.2f", p->freq_vibro, p->depth_vibro);
+    }
+
+    //! Если активированы параметры плавного нарастания громкости, добавляем их
+    if (p->start_fade_in >= 0 && p->duration_fade_in > 0) {
+        snprintf(buf + strlen(buf), size - strlen(buf), 
+            ",afade=t=in:st=%.2f:d=%.2f", p->start_fade_in, p->duration_fade_in);
+    }
+
+    //! Если активированы параметры плавного затухания громкости, добавляем их
+    if (p->start_fade_out >= 0 && p->duration_fade_out > 0) {
+        snprintf(buf + strlen(buf), size - strlen(buf), 
+            ",afade=t=out:st=%.2f:d=%.2f", p->start_fade_out, p->duration_fade_out);
+    }
+
+    //! Если настроены параметры эха, добавляем этот эффект
+    if (p->Echo1 > 0 && p->Echo2 > 0 && p->Echo3 > 0 && p->Echo4 > 0) {
+        snprintf(buf + strlen(buf), size - strlen(buf),
+            ",aecho=%.2f:%.2f:%.2f:%.2f", p->Echo1, p->Echo2, p->Echo3, p->Echo4);
+    }
+
+    //! Если настроен эффект хоруса, добавляем его
+    if (p->chorus > 0) {
+        snprintf(buf + strlen(buf), size - strlen(buf),
+            ",chorus=%.2f:0.7:60:0.4:0.25:2", p->chorus);
+    }
+
+    //! Если настроены параметры эквалайзера, добавляем их
+    if (p->Equalizerf != 0 && p->Equalizert != 0 && p->Equalizerw != 0 && p->Equalizerg != 0) {
+        snprintf(buf + strlen(buf), size - strlen(buf),
+            ",equalizer=f=%.2f:t=q:w=%.2f:g=%.2f",
+            p->Equalizerf, p->Equalizerw, p->Equalizerg);
+    }
+
+    //! Если настроен эффект фленджер, добавляем его
+    if (p->Flanger > 0) {
+        snprintf(buf + strlen(buf), size - strlen(buf),
+            ",flanger=delay=%.2f", p->Flanger);
+    }
+
+    //! Добавляем заключительный этап ресемплинга
+    snprintf(buf + strlen(buf), size - strlen(buf), 
+        ",aresample=44100");
+}
+
+/** @brief Формирует командную строку для FFmpeg с заданными параметрами обработки аудиофайла. 
+ *  Формируется полная команда для запуска FFmpeg с набором фильтров, позволяющих изменить 
+ *  высоту тона, добавить эффекты вибрато, затухания, эха, хоруса, эквалайзера и фленджер. 
+ *  Функция реентерабельна: команда пишется в буфер вызывающего, что позволяет
+ *  формировать команды из нескольких потоков одновременно.
+ *  @param[out] cmd Буфер для команды.
+ *  @param[in] cmdSize Размер буфера cmd.
+ *  @param[in] input Исходный аудиофайл.
+ *  @param[out] output Финальный аудиофайл или NULL — тогда сырой PCM s16le пишется в stdout.
+ *  @param[in] factor Во сколько раз повышается тон (см. dsp_pitch_factor()). 
+ *  @param[in] duration Общая длительность файла. 
+ *  @param[in] freq_vibro Частота вибрато. 
+ *  @param[in] depth_vibro Глубина вибрато. 
+ *  @param[in] start_fade_in Время начала плавного нарастания громкости. 
+ *  @param[in] duration_fade_in Длительность плавного нарастания громкости. 
+ *  @param[in] start_fade_out Время начала плавного затухания громкости. 
+ *  @param[in] duration_fade_out Длительность плавного затухания громкости. 
+ *  @param[in] Echo1 Первый коэффициент эха. 
+ *  @param[in] Echo2 Второй коэффициент эха. 
+ *  @param[in] Echo3 Третий коэффициент эха. 
+ *  @param[in] Echo4 Четвертый коэффициент эха. 
+ *  @param[in] chorus Интенсивность эффекта хоруса. 
+ *  @param[in] Equalizerf Центральная частота эквалайзера. 
+ *  @param[in] Equalizert Тип эквалайзера. 
+ *  @param[in] Equalizerw Ширина полосы пропускания эквалайзера. 
+ *  @param[in] Equalizerg Усиление эквалайзера. 
+ *  @param[in] Flanger Величина задержки для эффекта фленджер. 
+ *  @return Строку с готовой командой для запуска FFmpeg. */
+char* create_ffmpeg_command(
+    char* cmd,
+    size_t cmdSize,
+    const char* input, 
+    const char* output, 
+    double factor, 
+    float duration, 
+    int freq_vibro, 
+    float depth_vibro, 
+    float start_fade_in, 
+    float duration_fade_in, 
+    float start_fade_out, 
+    float duration_fade_out,
+
+    float Echo1,
+    float Echo2,
+    float Echo3,
+    float Echo4,
+    float chorus,
+    float Equalizerf,
+    float Equalizert,
+    float Equalizerw,
+    float Equalizerg,
+
+    float Flanger
+) {
+    //! Формируем базовую команду для FFmpeg
+    snprintf(cmd, cmdSize, 
+        "ffmpeg -y -i \"%s\" ", input);
+
+    //! Цепочка фильтров слога
+    EffectParams params = {
+        0, duration, freq_vibro, depth_vibro,
+        start_fade_in, duration_fade_in, start_fade_out, duration_fade_out,
+        Echo1, Echo2, Echo3, Echo4, chorus,
+        Equalizerf, Equalizert, Equalizerw, Equalizerg,
+        Flanger
+    };
+    snprintf(cmd + strlen(cmd), cmdSize - strlen(cmd), "-af \"");
+    ffmpeg_filters(cmd + strlen(cmd), cmdSize - strlen(cmd), factor, &params);
+    snprintf(cmd + strlen(cmd), cmdSize - strlen(cmd), "\" ");
+
+    //! Устанавливаем требуемую длительность и имя выходного файла (или канал stdout)
+    if (output) {
+        snprintf(cmd + strlen(cmd), cmdSize - strlen(cmd), 
+            "-t %.2f \"%s\"", duration, output);
+    } else {
+        snprintf(cmd + strlen(cmd), cmdSize - strlen(cmd), 
+            "-t %.2f -f s16le -loglevel error pipe:1", duration);
+    }
+
+    return cmd;
+}
+
+/**
+ * @brief Процесс FFmpeg, чей stdout читается через канал.
+ *  В отличие от popen() процесс можно завершить, не дожидаясь его выхода: он запускается
+ *  вместе с командным интерпретатором в своей группе процессов (POSIX) или объекте задания (Windows).
+ */
+typedef struct {
+#ifdef _WIN32
+    HANDLE process; ///< cmd.exe, запускающий команду
+    HANDLE job;     ///< Объект задания: cmd.exe и FFmpeg завершаются вместе
+    HANDLE out;     ///< Читающий конец канала stdout
+#else
+    pid_t pid;      ///< sh, запускающий команду; он же глава группы процессов
+    int out;        ///< Читающий конец канала stdout
+#endif
+} FfmpegProcess;
+
+/** @brief Запускает команду через командный интерпретатор, как popen(cmd, "r"). @return 0 или -1. */
+static int ffmpeg_start(FfmpegProcess* p, const char* cmd) {
+#ifdef _WIN32
+    SECURITY_ATTRIBUTES sa = { sizeof(sa), NULL, TRUE };
+    HANDLE read_end, write_end;
+    if (!CreatePipe(&read_end, &write_end, &sa, 0)) return -1;
+    SetHandleInformation(read_end, HANDLE_FLAG_INHERIT, 0);
+
+    STARTUPINFOA si;
+    memset(&si, 0, sizeof(si));
+    si.cb = sizeof(si);
+    si.dwFlags = STARTF_USESTDHANDLES;
+    si.hStdInput = GetStdHandle(STD_INPUT_HANDLE);
+    si.hStdOutput = write_end;
+    si.hStdError = GetStdHandle(STD_ERROR_HANDLE);
+
+    char line[MAX_CMD_SIZE + 16];
+    snprintf(line, sizeof(line), "cmd.exe /c %s", cmd);
+    PROCESS_INFORMATION pi;
+    p->job = CreateJobObjectA(NULL, NULL);
+    //! Процесс стартует приостановленным, чтобы попасть в задание раньше, чем запустит FFmpeg
+    BOOL ok = p->job && CreateProcessA(NULL, line, NULL, NULL, TRUE, CREATE_SUSPENDED, NULL, NULL, &si, &pi);
+    CloseHandle(write_end);
+    if (!ok) {
+        CloseHandle(read_end);
+        if (p->job) CloseHandle(p->job);
+        return -1;
+    }
+    AssignProcessToJobObject(p->job, pi.hProcess);
+    ResumeThread(pi.hThread);
+    CloseHandle(pi.hThread);
+    p->process = pi.hProcess;
+    p->out = read_end;
+#else
+    int fds[2];
+    if (pipe(fds) != 0) return -1;
+    //! Канал не должен достаться процессам, которые одновременно запускают другие потоки
+    fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+    fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+    pid_t pid = fork();
+    if (pid < 0) {
+        close(fds[0]);
+        close(fds[1]);
+        return -1;
+    }
+    if (pid == 0) {
+        setpgid(0, 0);
+        dup2(fds[1], STDOUT_FILENO);
+        execl("/bin/sh", "sh", "-c", cmd, (char*)NULL);
+        _exit(127);
+    }
+    setpgid(pid, pid); //!< И здесь: группа должна существовать, даже если потомок ещё не дошёл до setpgid()
+    close(fds[1]);
+    p->pid = pid;
+    p->out = fds[0];
+#endif
+    return 0;
+}
+
+/**
+ * @brief Читает из stdout процесса, ожидая данных не дольше срока.
+ * @param[in] deadline Крайний срок по workers_time(), 0 — без срока.
+ * @return Прочитано байт, 0 — конец потока, -1 — ошибка, TTS_DEADLINE_EXPIRED — срок истёк.
+ */
+static long ffmpeg_read(FfmpegProcess* p, void* data, size_t size, double deadline) {
+#ifdef _WIN32
+    DWORD avail = 0;
+    //! Канал без данных опрашивается; ошибка PeekNamedPipe — конец потока, его вернёт ReadFile
+    while (deadline > 0 && PeekNamedPipe(p->out, NULL, 0, NULL, &avail, NULL) && avail == 0) {
+        if (workers_time() > deadline) return TTS_DEADLINE_EXPIRED;
+        Sleep(5);
+    }
+    DWORD n = 0;
+    if (!ReadFile(p->out, data, (DWORD)size, &n, NULL)) {
+        return GetLastError() == ERROR_BROKEN_PIPE ? 0 : -1;
+    }
+    return (long)n;
+#else
+    while (deadline > 0) {
+        double left = deadline - workers_time();
+        if (left <= 0) return TTS_DEADLINE_EXPIRED;
+        struct pollfd pfd = { p->out, POLLIN, 0 };
+        int ready = poll(&pfd, 1, (int)(left * 1000) + 1);
+        if (ready > 0) break;
+        if (ready < 0 && errno != EINTR) return -1;
+    }
+    ssize_t n;
+    do {
+        n = read(p->out, data, size);
+    } while (n < 0 && errno == EINTR);
+    return (long)n;
+#endif
+}
+
+/**
+ * @brief Дожидается выхода процесса; с kill_tree — сначала завершает его вместе с FFmpeg.
+ * @return 0, если процесс завершился сам с кодом 0, иначе -1.
+ */
+static int ffmpeg_finish(FfmpegProcess* p, int kill_tree) {
+#ifdef _WIN32
+    if (kill_tree) TerminateJobObject(p->job, 1);
+    CloseHandle(p->out);
+    WaitForSingleObject(p->process, INFINITE);
+    DWORD code = 1;
+    GetExitCodeProcess(p->process, &code);
+    CloseHandle(p->process);
+    CloseHandle(p->job);
+    return code == 0 && !kill_tree ? 0 : -1;
+#else
+    if (kill_tree) kill(-p->pid, SIGKILL);
+    close(p->out);
+    int status = 0;
+    while (waitpid(p->pid, &status, 0) < 0) {
+        if (errno != EINTR) return -1;
+    }
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0 && !kill_tree ? 0 : -1;
+#endif
+}
+
+/**
+ * @brief Запускает команду FFmpeg и читает сырой PCM s16le из её stdout в память.
+ * @param[in] cmd Команда, сформированная create_ffmpeg_command() с output == NULL.
+ * @param[in] channels Количество каналов в потоке.
+ * @param[in] deadline Крайний срок по workers_time(), 0 — без срока. Если данные не успевают
+ *  прийти к сроку, процесс завершается, не дожидаясь конца обработки.
+ * @param[out] out Полученный звук.
+ * @return 0 при успехе, TTS_DEADLINE_EXPIRED, если срок истёк, -1 если процесс не запустился
+ *  или завершился с ошибкой.
+ */
+static int read_ffmpeg_pcm(const char* cmd, int channels, double deadline, AudioBuffer* out) {
+    memset(out, 0, sizeof(*out));
+    out->channels = channels;
+    out->sample_rate = DSP_SAMPLE_RATE;
+    if (deadline > 0 && workers_time() > deadline) return TTS_DEADLINE_EXPIRED;
+
+    double t = TRACE_BEGIN();
+    FfmpegProcess process;
+    if (ffmpeg_start(&process, cmd) != 0) {
+        return -1;
+    }
+
+    size_t frame_bytes = 2 * (size_t)channels;
+    size_t allocated = 0;
+    unsigned char chunk[16384];
+    size_t pending = 0; //!< Байты неполного кадра, оставшиеся с прошлого чтения
+    long n;
+    while ((n = ffmpeg_read(&process, chunk + pending, sizeof(chunk) - pending, deadline)) > 0) {
+        n += (long)pending;
+        size_t frames = (size_t)n / frame_bytes;
+        if (out->frames + frames > allocated) {
+            allocated = (out->frames + frames) * 2;
+            float* grown = realloc(out->samples, allocated * channels * sizeof(float));
+            if (!grown) {
+                n = -1;
+                break;
+            }
+            out->samples = grown;
+        }
+        dsp_pcm16_decode(chunk, out->samples + out->frames * channels, frames * channels);
+        out->frames += frames;
+        pending = (size_t)n - frames * frame_bytes;
+        memmove(chunk, chunk + frames * frame_bytes, pending);
+    }
+
+    //! Ошибка или истёкший срок: процесс завершается сразу, а не когда FFmpeg доработает
+    if (ffmpeg_finish(&process, n < 0) != 0 || n < 0) {
+        audio_free(out);
+        return n == TTS_DEADLINE_EXPIRED ? TTS_DEADLINE_EXPIRED : -1;
+    }
+    TRACE_END(t, "io", "ffmpeg", NULL, (long long)(out->frames * channels), (long long)(out->frames * frame_bytes));
+    return 0;
+}
+
+/** 
+ * @brief Применяет созданные параметры и команду для обработки отдельного аудиофайла. 
+ *  В режиме TTS_BACKEND_FFMPEG запускает команду FFmpeg для конкретного файла и забирает
+ *  результат из её stdout, в режиме TTS_BACKEND_NATIVE обрабатывает его встроенным движком;
+ *  в обоих случаях результат остаётся в памяти, промежуточные файлы не создаются.
+ *  Если такой же слог с теми же параметрами уже обрабатывался, результат берётся из кэша.
+ *  @param[in] engine Движок: голосовой банк, кэш и способ обработки.
+ *  @param[in] input Имя слога (единицы голосового банка). 
+ *  @param[out] output Буфер для обработанного звука (освобождается audio_free()). 
+ *  @param[in] pitch Изменение тональности в полутонах. 
+ *  @param[in] duration Требуемая длительность. 
+ *  @param[in] freq_vibro Частота вибрато. 
+ *  @param[in] depth_vibro Глубина вибрато. 
+ *  @param[in] start_fade_in Время начала плавного нарастания громкости. 
+ *  @param[in] duration_fade_in Длительность плавного нарастания громкости. 
+ *  @param[in] start_fade_out Время начала плавного затухания громкости. 
+ *  @param[in] duration_fade_out Длительность плавного затухания громкости. 
+ *  @param[in] Echo1 Первый коэффициент эха. 
+ *  @param[in] Echo2 Второй коэффициент эха. 
+ *  @param[in] Echo3 Третий коэффициент эха. 
+ *  @param[in] Echo4 Четвертый коэффициент эха. 
+ *  @param[in] chorus Интенсивность эффекта хоруса. 
+ *  @param[in] Equalizerf Центральная частота эквалайзера. 
+ *  @param[in] Equalizert Тип эквалайзера. 
+ *  @param[in] Equalizerw Ширина полосы пропускания эквалайзера. 
+ *  @param[in] Equalizerg Усиление эквалайзера. 
+ *  @param[in] Flanger Величина задержки для эффекта фленджер. 
+ *  @return 0 при успехе, -1 при ошибке обработки. */
+static int runModifiers(
+    TtsEngine* engine,
+    const char* input, 
+    AudioBuffer* output, 
+    int pitch, 
+    float duration, 
+    int freq_vibro, 
+    float depth_vibro, 
+    float start_fade_in, 
+    float duration_fade_in, 
+    float start_fade_out, 
+    float duration_fade_out,
+
+    float Echo1,
+    float Echo2,
+    float Echo3,
+    float Echo4,
+
+    float chorus,
+    float Equalizerf,
+    float Equalizert,
+    float Equalizerw,
+    float Equalizerg,
+
+    float Flanger
+) {
+    memset(output, 0, sizeof(*output));
+    double t = TRACE_BEGIN();
+#define SYLLABLE_DONE() TRACE_END(t, "render", "syllable", input, (long long)(output->frames * output->channels), 0)
+
+    const VoiceUnit* unit = voicebank_find_unit(&engine->voicebank, input);
+    if (!unit) {
+        printf("Missing voicebank unit %s\n", input);
+        return -1;
+    }
+    const AudioBuffer* src = &unit->audio;
+
+    EffectParams params = {
+        pitch, duration, freq_vibro, depth_vibro,
+        start_fade_in, duration_fade_in, start_fade_out, duration_fade_out,
+        Echo1, Echo2, Echo3, Echo4, chorus,
+        Equalizerf, Equalizert, Equalizerw, Equalizerg,
+        Flanger
+    };
+
+    uint64_t key = syllable_key(engine, unit, &params);
+    if (engine->cache_enabled && render_cache_get(&engine->cache, key, output) == 0) {
+        if (engine->options.verbose) printf("Cached: %s\n", input);
+        SYLLABLE_DONE();
+        return 0;
+    }
+
+    if (engine->options.backend == TTS_BACKEND_NATIVE) {
+        if (engine->options.verbose) printf("Processing natively: %s\n", input);
+
+        //! Берём слог из резидентного банка и прогоняем через цепочку эффектов
+        if (dsp_apply_chain(src, &params, &unit->marks, output) != 0) {
+            printf("Error processing %s\n", input);
+            return -1;
+        }
+        if (engine->cache_enabled) {
+            render_cache_put(&engine->cache, key, output);
+        }
+        SYLLABLE_DONE();
+        return 0;
+    }
+
+    char path[600];
+    char cmd[MAX_CMD_SIZE];
+
+    //! Формируем команду FFmpeg для файла слога в каталоге голосового банка
+    snprintf(path, sizeof(path), "%s/%s.wav", engine->voicebank_dir, unit->name);
+    double factor = dsp_pitch_factor(pitch, &unit->marks);
+    create_ffmpeg_command(cmd, sizeof(cmd), path, NULL, factor, duration, freq_vibro, depth_vibro, start_fade_in, duration_fade_in, start_fade_out, duration_fade_out, Echo1, Echo2, Echo3, Echo4, chorus, Equalizerf, Equalizert, Equalizerw, Equalizerg, Flanger);
+
+    //! Выводим команду для контроля
+    if (engine->options.verbose) printf("Processing command:\n%s\n", cmd);
+
+    //! Выполняем команду и забираем PCM из её stdout
+    if (read_ffmpeg_pcm(cmd, src->channels, 0, output) != 0) {
+        printf("Error running ffmpeg for %s\n", input);
+        return -1;
+    }
+    if (engine->cache_enabled) {
+        render_cache_put(&engine->cache, key, output);
+    }
+    SYLLABLE_DONE();
+    return 0;
+#undef SYLLABLE_DONE
+}
+
+/** @brief Номер следующего скрипта графа: у одновременных рендеров (ttsd, ttsbatch) свои файлы. */
+#ifdef _WIN32
+static volatile LONG graph_serial = 0;
+#else
+static int graph_serial = 0;
+#endif
+
+/**
+ * @brief Путь скрипта графа во временном каталоге системы.
+ *  Номер процесса в имени разводит процессы с общим голосовым банком (две копии ttsbatch,
+ *  ttsd и mainffmpeg), номер скрипта — одновременные рендеры внутри процесса;
+ *  каталог голосового банка может быть и только для чтения.
+ */
+static void graph_script_path(char* path, size_t size, long serial) {
+#ifdef _WIN32
+    char dir[MAX_PATH + 1];
+    DWORD n = GetTempPathA(sizeof(dir), dir); //!< С завершающей обратной косой чертой
+    if (n == 0 || n >= sizeof(dir)) strcpy(dir, ".\\");
+    snprintf(path, size, "%stts_graph_%lu_%ld.txt", dir, (unsigned long)GetCurrentProcessId(), serial);
+#else
+    const char* dir = getenv("TMPDIR");
+    if (!dir || !dir[0]) dir = "/tmp";
+    snprintf(path, size, "%s/tts_graph_%ld_%ld.txt", dir, (long)getpid(), serial);
+#endif
+}
+
+/**
+ * @brief Записывает путь к файлу как значение параметра фильтра в описании графа.
+ *  Описание разбирается дважды: значение параметра экранирует '\', '\'' и ':' обратной
+ *  косой чертой, а описание графа целиком берётся в одинарные кавычки.
+ */
+static void graph_write_path(FILE* f, const char* path) {
+    fputc('\'', f);
+    for (const char* p = path; *p; p++) {
+        if (*p == '\'') {
+            fputs("\\'\\''", f); //!< \' для параметра; кавычка графа закрывается, экранируется и открывается снова
+            continue;
+        }
+        if (*p == '\\' || *p == ':') fputc('\\', f);
+        fputc(*p, f);
+    }
+    fputc('\'', f);
+}
+
+/**
+ * @brief Рендер бэкендом TTS_BACKEND_FFMPEG_GRAPH: все необработанные слоги — одним процессом FFmpeg.
+ *  Граф filter_complex получает по одному источнику amovie на каждую различную единицу
+ *  голосового банка (asplit, если она звучит несколько раз), ветку фильтров на каждый слог
+ *  и concat в конце. Каждая ветка добивается тишиной и обрезается ровно до длины слога,
+ *  поэтому результат процесса режется обратно на слоги для кэша и манифеста.
+ *  Граф не помещается в командную строку (MAX_CMD_SIZE) и передаётся файлом скрипта.
+ *  Слоги из кэша и готовые слоги (reuse) в граф не попадают.
+ * @param[in] deadline Крайний срок по workers_time(), 0 — без срока; по его истечении FFmpeg завершается.
+ * @param[out] rendered Буферы слогов first..first+count-1.
+ * @return 0 при успехе, TTS_DEADLINE_EXPIRED, если срок истёк, -1 если слога нет в банке,
+ *  FFmpeg не запустился или вернул не тот объём звука.
+ */
+static int render_graph(TtsEngine* engine, const Score* score, int first, int count,
+    const AudioBuffer* reuse, double deadline, AudioBuffer* rendered) {
+    const Voicebank* vb = &engine->voicebank;
+    int* branches = malloc((count + 1) * sizeof(int));          //!< Слоги, идущие в граф
+    size_t* lengths = malloc((count + 1) * sizeof(size_t));     //!< Их длина в кадрах
+    int* inputs = malloc((vb->count + 1) * sizeof(int));        //!< Номер источника единицы, -1 — нет
+    int* uses = calloc(vb->count + 1, sizeof(int));             //!< Сколько веток берут единицу
+    int* order = malloc((vb->count + 1) * sizeof(int));         //!< Единица источника
+    if (!branches || !lengths || !inputs || !uses || !order) {
+        free(branches); free(lengths); free(inputs); free(uses); free(order);
+        return -1;
+    }
+    for (size_t u = 0; u < vb->count; u++) inputs[u] = -1;
+
+    int branch_count = 0, input_count = 0, channels = 0;
+    for (int job = 0; job < count; job++) {
+        int i = first + job;
+        memset(&rendered[job], 0, sizeof(AudioBuffer));
+        if (reuse && reuse[job].channels > 0) continue;
+
+        const VoiceUnit* unit = voicebank_find_unit(vb, score->names[i]);
+        if (!unit) {
+            printf("Missing voicebank unit %s\n", score->names[i]);
+            free(branches); free(lengths); free(inputs); free(uses); free(order);
+            return -1;
+        }
+        EffectParams params;
+        tts_score_params(score, i, &params);
+        uint64_t key = syllable_key(engine, unit, &params);
+        if (engine->cache_enabled && render_cache_get(&engine->cache, key, &rendered[job]) == 0) {
+            if (engine->options.verbose) printf("Cached: %s\n", score->names[i]);
+            continue;
+        }
+
+        //! Длина как у "-t duration" встроенного движка; пустой слог в граф не идёт
+        double limit = params.duration > 0 ? (double)params.duration * DSP_SAMPLE_RATE : 0.0;
+        size_t frames = (double)unit->audio.frames > limit ? (size_t)limit : unit->audio.frames;
+        if (frames == 0) continue;
+
+        int u = (int)(unit - vb->units);
+        if (inputs[u] < 0) {
+            order[input_count] = u;
+            inputs[u] = input_count++;
+        }
+        uses[u]++;
+        if (channels == 0) channels = unit->audio.channels;
+        branches[branch_count] = job;
+        lengths[branch_count++] = frames;
+    }
+
+    int rc = 0;
+    if (branch_count > 0) {
+#ifdef _WIN32
+        long serial = (long)InterlockedIncrement(&graph_serial);
+#else
+        long serial = (long)__atomic_add_fetch(&graph_serial, 1, __ATOMIC_RELAXED);
+#endif
+        char script[600], path[600], filters[MAX_CMD_SIZE], cmd[MAX_CMD_SIZE];
+        graph_script_path(script, sizeof(script), serial);
+
+        FILE* f = fopen(script, "w");
+        if (!f) rc = -1;
+        for (int k = 0; f && k < input_count; k++) {
+            const VoiceUnit* unit = &vb->units[order[k]];
+            snprintf(path, sizeof(path), "%s/%s.wav", engine->voicebank_dir, unit->name);
+            fputs("amovie=", f);
+            graph_write_path(f, path);
+            if (uses[order[k]] > 1) {
+                fprintf(f, ",asplit=%d", uses[order[k]]);
+            }
+            for (int b = 0; b < uses[order[k]]; b++) fprintf(f, "[u%d_%d]", k, b);
+            fputs(";\n", f);
+            uses[order[k]] = 0; //!< Дальше — счётчик уже занятых выходов asplit
+        }
+        for (int k = 0; f && k < branch_count; k++) {
+            int i = first + branches[k];
+            const VoiceUnit* unit = voicebank_find_unit(vb, score->names[i]);
+            int u = (int)(unit - vb->units);
+            EffectParams params;
+            tts_score_params(score, i, &params);
+            ffmpeg_filters(filters, sizeof(filters), dsp_pitch_factor(params.semitones, &unit->marks), &params);
+            fprintf(f, "[u%d_%d]%s,aformat=sample_fmts=s16:channel_layouts=%s,apad=whole_len=%lu,"
+                "atrim=end_sample=%lu[s%d];\n", inputs[u], uses[u]++, filters, channels == 1 ? "mono" : "stereo",
+                (unsigned long)lengths[k], (unsigned long)lengths[k], k);
+        }
+        for (int k = 0; f && k < branch_count; k++) fprintf(f, "[s%d]", k);
+        if (f) {
+            fprintf(f, "concat=n=%d:v=0:a=1[out]\n", branch_count);
+            if (ferror(f)) rc = -1;
+            if (fclose(f) != 0) rc = -1;
+        }
+
+        //! Один процесс и одно кодирование на весь рендер
+        AudioBuffer all;
+        memset(&all, 0, sizeof(all));
+        if (rc == 0) {
+            snprintf(cmd, sizeof(cmd),
+                "ffmpeg -y -loglevel error -filter_complex_script \"%s\" -map \"[out]\" -f s16le pipe:1", script);
+            if (engine->options.verbose) {
+                printf("Processing %d syllable(s) from %d unit(s) in one ffmpeg graph:\n%s\n",
+                    branch_count, input_count, cmd);
+            }
+            rc = read_ffmpeg_pcm(cmd, channels, deadline, &all);
+        }
+        remove(script);
+
+        size_t total = 0;
+        for (int k = 0; k < branch_count; k++) total += lengths[k];
+        if (rc == 0 && all.frames != total) {
+            printf("ffmpeg graph returned %lu frame(s) instead of %lu\n", (unsigned long)all.frames,
+                (unsigned long)total);
+            rc = -1;
+        }
+
+        //! Режем результат обратно на слоги
+        size_t offset = 0;
+        for (int k = 0; rc == 0 && k < branch_count; k++) {
+            AudioBuffer* part = &rendered[branches[k]];
+            part->samples = malloc(lengths[k] * channels * sizeof(float) + 1);
+            if (!part->samples) {
+                rc = -1;
+                break;
+            }
+            memcpy(part->samples, all.samples + offset * channels, lengths[k] * channels * sizeof(float));
+            part->frames = lengths[k];
+            part->channels = channels;
+            part->sample_rate = DSP_SAMPLE_RATE;
+            offset += lengths[k];
+
+            if (engine->cache_enabled) {
+                int i = first + branches[k];
+                const VoiceUnit* unit = voicebank_find_unit(vb, score->names[i]);
+                EffectParams params;
+                tts_score_params(score, i, &params);
+                render_cache_put(&engine->cache, syllable_key(engine, unit, &params), part);
+            }
+        }
+        audio_free(&all);
+        if (rc != 0 && rc != TTS_DEADLINE_EXPIRED) printf("Error running the ffmpeg graph\n");
+    }
+
+    free(branches); free(lengths); free(inputs); free(uses); free(order);
+    return rc;
+}
+
+/** @brief Общий контекст заданий рендера: движок, партитура, первый слог и буферы результатов. */
+typedef struct {
+    TtsEngine* engine;
+    const Score* score;
+    int first;            ///< Индекс слога партитуры, соответствующий заданию 0
+    AudioBuffer* rendered;
+    const AudioBuffer* reuse; ///< Готовые слоги (channels > 0) или NULL
+    double deadline;      ///< Крайний срок по workers_time(), 0 — без срока
+    volatile int expired; ///< Срок истёк, оставшиеся задания пропускаются
+    volatile int failed;  ///< Хотя бы один слог не обработан, результат не собирается
+} RenderJobs;
+
+/** 
+ * @brief Задание пула потоков: обрабатывает слог first + job в его собственный буфер.
+ *  Слоги независимы друг от друга, поэтому задания можно выполнять в любом порядке.
+ * @param[in] job Индекс задания.
+ * @param[in] ctx Указатель на RenderJobs. */
+static void render_syllable_job(int job, void* ctx) {
+    RenderJobs* jobs = ctx;
+    const Score* s = jobs->score;
+    int i = jobs->first + job;
+    if (jobs->reuse && jobs->reuse[job].channels > 0) return;
+
+    //! После крайнего срока слоги не обрабатываются: результат всё равно будет отброшен
+    if (jobs->expired) return;
+    if (jobs->deadline > 0 && workers_time() > jobs->deadline) {
+        jobs->expired = 1;
+        return;
+    }
+
+    int rc = runModifiers(
+        jobs->engine,
+        s->names[i], 
+        &jobs->rendered[job], 
+        s->pitches[i], 
+        s->durations[i], 
+        s->frequencies[i], 
+        s->depths[i], 
+        s->starts_fade_in[i], 
+        s->durations_fade_in[i], 
+        s->starts_fade_out[i], 
+        s->durations_fade_out[i],
+        s->Echo1[i], 
+        s->Echo2[i], 
+        s->Echo3[i], 
+        s->Echo4[i], 
+        s->chorus[i], 
+        s->Equalizerf[i], 
+        s->Equalizert[i], 
+        s->Equalizerw[i], 
+        s->Equalizerg[i], 
+        s->Flanger[i]
+    );
+    if (rc != 0) jobs->failed = 1;
+}
+
+/** 
+ * @brief Процессор для объединения обработанных слогов в один звук. 
+ * Обрабатывает каждый слог диапазона с заданными параметрами и затем объединяет полученные буферы. 
+ * Слоги обрабатываются параллельно; объединение идёт строго в порядке партитуры,
+ * поэтому результат совпадает с последовательной обработкой (threads = 1). 
+ * @param[in] engine Движок.
+ * @param[in] score Партитура.
+ * @param[in] first Первый слог диапазона.
+ * @param[in] count Количество слогов.
+ * @param[in] deadline Крайний срок по workers_time(), 0 — без срока.
+ * @param[in] reuse Готовый звук слогов (channels > 0 — слог не обрабатывается) или NULL.
+ * @param[out] part_frames Кадров каждого слога в результате или NULL.
+ * @param[out] output Собранный результат.
+ * @return 0 при успехе, TTS_DEADLINE_EXPIRED, если срок истёк до конца обработки, -1 при ошибке. */
+static int merge_wav_files(TtsEngine* engine, const Score* score, int first, int count, double deadline,
+    const AudioBuffer* reuse, size_t* part_frames, AudioBuffer* output) {
+    memset(output, 0, sizeof(*output));
+    if (count <= 0) {
+        printf("No files to merge.\n");
+        return -1;
+    }
+
+    //! Буферы обработанных слогов, по одному на запись партитуры
+    AudioBuffer* rendered = calloc(count, sizeof(AudioBuffer));
+    if (!rendered) return -1;
+
+    RenderJobs jobs = { engine, score, first, rendered, reuse, deadline, 0, 0 };
+    if (engine->options.backend == TTS_BACKEND_FFMPEG_GRAPH) {
+        //! Один граф на все слоги; по истечении срока процесс FFmpeg завершается, не дорабатывая
+        int rc = render_graph(engine, score, first, count, reuse, deadline, rendered);
+        if (rc != 0) {
+            for (int i = 0; i < count; i++) audio_free(&rendered[i]);
+            free(rendered);
+            return rc == TTS_DEADLINE_EXPIRED ? rc : -1;
+        }
+        if (deadline > 0 && workers_time() > deadline) jobs.expired = 1;
+    } else {
+        //! Обрабатываем все слоги в пуле потоков
+        int threads = engine->options.threads > 0 ? engine->options.threads : workers_cpu_count();
+        if (engine->options.verbose) printf("Rendering %d syllables on %d thread(s)\n", count, threads);
+        workers_run(count, threads, render_syllable_job, &jobs);
+    }
+
+    //! Готовые слоги подставляются без копирования: буферы указывают в чужую память
+    for (int i = 0; i < count && reuse; i++) {
+        if (reuse[i].channels > 0) rendered[i] = reuse[i];
+    }
+    for (int i = 0; i < count && part_frames; i++) {
+        part_frames[i] = rendered[i].frames;
+    }
+
+    //! Склеиваем буферы в порядке партитуры
+    double t = TRACE_BEGIN();
+    int rc = jobs.failed ? -1 : jobs.expired ? TTS_DEADLINE_EXPIRED : audio_concat(rendered, count, output);
+    TRACE_END(t, "render", "assemble", NULL, (long long)(output->frames * output->channels), 0);
+    for (int i = 0; i < count; i++) {
+        if (!reuse || reuse[i].channels == 0) audio_free(&rendered[i]);
+    }
+    free(rendered);
+
+    if (rc == TTS_DEADLINE_EXPIRED) return rc;
+    if (jobs.failed) {
+        printf("Some syllables failed to render, nothing assembled\n");
+        return -1;
+    }
+    if (rc != 0) {
+        printf("Error assembling output\n");
+        return -1;
+    }
+    return 0;
+}
+
+int tts_render(TtsEngine* engine, const Score* score, AudioBuffer* out) {
+    return merge_wav_files(engine, score, 0, score->count, 0, NULL, NULL, out);
+}
+
+int tts_render_range(TtsEngine* engine, const Score* score, int first, int count, AudioBuffer* out) {
+    if (first < 0 || count < 0 || first > score->count || count > score->count - first) {
+        memset(out, 0, sizeof(*out));
+        return -1;
+    }
+    return merge_wav_files(engine, score, first, count, 0, NULL, NULL, out);
+}
+
+int tts_render_until(TtsEngine* engine, const Score* score, double deadline, AudioBuffer* out) {
+    return merge_wav_files(engine, score, 0, score->count, deadline, NULL, NULL, out);
+}
+
+/**
+ * @brief Оценка памяти на слог при рендере окнами: обработанный звук и его копия в склейке.
+ *  Сдвиг тона длину не меняет, поэтому берётся длина единицы, урезанная по duration.
+ */
+static size_t syllable_bytes(TtsEngine* engine, const Score* score, int i) {
+    const VoiceUnit* unit = voicebank_find_unit(&engine->voicebank, score->names[i]);
+    if (!unit) return 0;
+    EffectParams params;
+    tts_score_params(score, i, &params);
+    double frames = (double)unit->audio.frames;
+    double limit = params.duration > 0 ? (double)params.duration * unit->audio.sample_rate : 0.0;
+    if (frames > limit) frames = limit;
+    return (size_t)frames * unit->audio.channels * sizeof(float) * 2;
+}
+
+int tts_render_to_file(TtsEngine* engine, const Score* score, const char* path, size_t max_memory,
+    uint64_t* frames) {
+    if (frames) *frames = 0;
+
+    //! Размер результата известен заранее: сдвиг тона длину не меняет, отсчёты PCM16 вчетверо меньше оценки
+    uint64_t expected = 0;
+    for (int i = 0; i < score->count; i++) expected += syllable_bytes(engine, score, i) / 4;
+
+    WavWriter writer;
+    if (wav_writer_open(&writer, path, expected) != 0) {
+        printf("Error creating %s\n", path);
+        return -1;
+    }
+
+    //! Окно — подряд идущие слоги, чья оценка помещается в половину предела:
+    //! вторая половина остаётся под буферы эффектов и исходники в работе
+    int windows = 0;
+    int rc = 0;
+    for (int first = 0; rc == 0 && first < score->count; ) {
+        size_t budget = max_memory / 2;
+        size_t used = syllable_bytes(engine, score, first);
+        int count = 1;
+        while (first + count < score->count) {
+            size_t bytes = syllable_bytes(engine, score, first + count);
+            if (used + bytes > budget) break;
+            used += bytes;
+            count++;
+        }
+
+        AudioBuffer window;
+        rc = tts_render_range(engine, score, first, count, &window);
+        if (rc == 0 && wav_writer_write(&writer, &window) != 0) {
+            printf("Error writing %s\n", path);
+            rc = -1;
+        }
+        audio_free(&window);
+        first += count;
+        windows++;
+    }
+
+    if (rc != 0) {
+        wav_writer_abort(&writer);
+        return -1;
+    }
+    if (wav_writer_close(&writer) != 0) {
+        printf("Error writing %s\n", path);
+        return -1;
+    }
+    if (engine->options.verbose) printf("Rendered %d syllables in %d window(s)\n", score->count, windows);
+    if (frames) *frames = writer.frames;
+    return 0;
+}
+
+/** @brief Совпадает ли прочитанный прошлый результат с тем, что описывает его манифест. */
+static int previous_matches(const TtsManifest* previous, const AudioBuffer* audio) {
+    return previous && audio && previous->count > 0 && audio->frames == previous->total_frames &&
+        audio->channels == previous->channels && audio->sample_rate == previous->sample_rate &&
+        manifest_audio_hash(audio) == previous->audio_hash;
+}
+
+int tts_render_incremental(TtsEngine* engine, const Score* score, const TtsManifest* previous,
+    const AudioBuffer* previous_audio, AudioBuffer* out, TtsManifest* manifest, int* reused) {
+    memset(out, 0, sizeof(*out));
+    tts_manifest_init(manifest);
+    if (reused) *reused = 0;
+    if (manifest_reserve(manifest, score->count) != 0) return -1;
+
+    //! Ключи новых слогов; отсутствующий слог получает ключ 0 и ошибку при рендере
+    for (int i = 0; i < score->count; i++) {
+        EffectParams params;
+        tts_score_params(score, i, &params);
+        const VoiceUnit* unit = voicebank_find_unit(&engine->voicebank, score->names[i]);
+        manifest->keys[i] = unit ? syllable_key(engine, unit, &params) : 0;
+    }
+
+    //! Таблица прошлых ключей: слог находится, даже если перед ним вставили или удалили другие
+    AudioBuffer* reuse = calloc(score->count + 1, sizeof(AudioBuffer));
+    int* slots = NULL;
+    size_t capacity = 16;
+    int found = 0;
+    if (!reuse) {
+        tts_manifest_free(manifest);
+        return -1;
+    }
+    if (previous_matches(previous, previous_audio)) {
+        while (capacity < (size_t)previous->count * 2) capacity *= 2;
+        slots = malloc(capacity * sizeof(int));
+    }
+    if (slots) {
+        memset(slots, -1, capacity * sizeof(int));
+        for (int j = 0; j < previous->count; j++) {
+            size_t s = previous->keys[j] & (capacity - 1);
+            while (slots[s] >= 0 && previous->keys[slots[s]] != previous->keys[j]) s = (s + 1) & (capacity - 1);
+            if (slots[s] < 0) slots[s] = j;
+        }
+        int ch = previous_audio->channels;
+        for (int i = 0; i < score->count; i++) {
+            if (manifest->keys[i] == 0) continue;
+            size_t s = manifest->keys[i] & (capacity - 1);
+            while (slots[s] >= 0 && previous->keys[slots[s]] != manifest->keys[i]) s = (s + 1) & (capacity - 1);
+            if (slots[s] < 0) continue;
+            int j = slots[s];
+            //! Пустой слог, который не должен быть пустым, — след неудачной обработки: обрабатываем заново
+            if (previous->frames[j] == 0 && syllable_bytes(engine, score, i) > 0) continue;
+            reuse[i].samples = previous_audio->samples + previous->offsets[j] * ch;
+            reuse[i].frames = previous->frames[j];
+            reuse[i].channels = ch;
+            reuse[i].sample_rate = previous_audio->sample_rate;
+            found++;
+        }
+        free(slots);
+    }
+
+    int rc = merge_wav_files(engine, score, 0, score->count, 0, reuse, manifest->frames, out);
+    free(reuse);
+    if (rc != 0) {
+        tts_manifest_free(manifest);
+        return -1;
+    }
+
+    size_t offset = 0;
+    for (int i = 0; i < score->count; i++) {
+        manifest->offsets[i] = offset;
+        offset += manifest->frames[i];
+    }
+    manifest->count = score->count;
+    manifest->total_frames = out->frames;
+    manifest->channels = out->channels;
+    manifest->sample_rate = out->sample_rate;
+    manifest->audio_hash = manifest_audio_hash(out);
+    if (reused) *reused = found;
+    return 0;
+}
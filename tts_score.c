@@ -0,0 +1,517 @@
+/**
+ * @file tts_score.c
+ * @brief Партитура: хранение слогов и текстовый формат output.txt.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <stdint.h>
+
+#include "tts.h"
+
+/** @defgroup SoundSettings Настройки звука
+ * Значения «без заметных эффектов», которые trnskrp подставляет каждому слогу.
+ * @{
+ */
+#define VELOCITY 1.0f               ///< Нормальная скорость воспроизведения
+#define EQ_FREQ 1000.0f             ///< Центральная частота эквалайзера остается неизменной
+#define EQ_WIDTH 1.0f               ///< Не влияет при flat-типе
+/** @}*/
+
+/**
+ * @brief Минимальное число знаков после запятой для каждого из 18 значений слога.
+ *  Подобрано так, чтобы параметры по умолчанию записывались ровно как раньше
+ *  ("1.0", "0", "0.0", "1000" ...), а остальные значения — без потери точности.
+ */
+static const int min_decimals[18] = {
+    0, 1, 0, 1, 0, 1, 0, 1,   //!< тон, скорость, вибрато, fade-in, fade-out
+    1, 1, 0, 1,               //!< эхо
+    1,                        //!< хорус
+    0, 0, 1, 0,               //!< эквалайзер
+    1                         //!< фленджер
+};
+
+void tts_score_init(Score* score) {
+    memset(score, 0, sizeof(*score));
+}
+
+void tts_score_free(Score* score) {
+    for (int i = 0; i < score->name_block_count; i++) {
+        free(score->name_blocks[i]);
+    }
+    free(score->name_blocks);
+    free(score->block);
+    memset(score, 0, sizeof(*score));
+}
+
+/** @brief Нарезает массив из n элементов размера size из блока памяти и сдвигает указатель блока. */
+static void* carve(char** cursor, int n, size_t size) {
+    void* p = *cursor;
+    *cursor += (size_t)n * size;
+    return p;
+}
+
+/** @brief Копирует count элементов столбца; отсутствующий (ещё не выделенный) столбец пропускается. */
+static void move_column(void* to, const void* from, int count, size_t size) {
+    if (from && count > 0) memcpy(to, from, (size_t)count * size);
+}
+
+int tts_score_reserve(Score* score, int capacity) {
+    if (capacity <= score->allocated) return 0;
+
+    //! Сначала массив указателей, затем 4-байтовые значения — выравнивание сохраняется
+    size_t row = sizeof(char*) + 2 * sizeof(int) + 16 * sizeof(float);
+    char* block = malloc((size_t)capacity * row);
+    if (!block) return -1;
+
+    Score old = *score;
+    char* cursor = block;
+    score->names = carve(&cursor, capacity, sizeof(char*));
+    score->pitches = carve(&cursor, capacity, sizeof(int));
+    score->durations = carve(&cursor, capacity, sizeof(float));
+    score->frequencies = carve(&cursor, capacity, sizeof(int));
+    score->depths = carve(&cursor, capacity, sizeof(float));
+    score->starts_fade_in = carve(&cursor, capacity, sizeof(float));
+    score->durations_fade_in = carve(&cursor, capacity, sizeof(float));
+    score->starts_fade_out = carve(&cursor, capacity, sizeof(float));
+    score->durations_fade_out = carve(&cursor, capacity, sizeof(float));
+    score->Echo1 = carve(&cursor, capacity, sizeof(float));
+    score->Echo2 = carve(&cursor, capacity, sizeof(float));
+    score->Echo3 = carve(&cursor, capacity, sizeof(float));
+    score->Echo4 = carve(&cursor, capacity, sizeof(float));
+    score->chorus = carve(&cursor, capacity, sizeof(float));
+    score->Equalizerf = carve(&cursor, capacity, sizeof(float));
+    score->Equalizert = carve(&cursor, capacity, sizeof(float));
+    score->Equalizerw = carve(&cursor, capacity, sizeof(float));
+    score->Equalizerg = carve(&cursor, capacity, sizeof(float));
+    score->Flanger = carve(&cursor, capacity, sizeof(float));
+
+    int n = old.count;
+    move_column(score->names, old.names, n, sizeof(char*));
+    move_column(score->pitches, old.pitches, n, sizeof(int));
+    move_column(score->durations, old.durations, n, sizeof(float));
+    move_column(score->frequencies, old.frequencies, n, sizeof(int));
+    move_column(score->depths, old.depths, n, sizeof(float));
+    move_column(score->starts_fade_in, old.starts_fade_in, n, sizeof(float));
+    move_column(score->durations_fade_in, old.durations_fade_in, n, sizeof(float));
+    move_column(score->starts_fade_out, old.starts_fade_out, n, sizeof(float));
+    move_column(score->durations_fade_out, old.durations_fade_out, n, sizeof(float));
+    move_column(score->Echo1, old.Echo1, n, sizeof(float));
+    move_column(score->Echo2, old.Echo2, n, sizeof(float));
+    move_column(score->Echo3, old.Echo3, n, sizeof(float));
+    move_column(score->Echo4, old.Echo4, n, sizeof(float));
+    move_column(score->chorus, old.chorus, n, sizeof(float));
+    move_column(score->Equalizerf, old.Equalizerf, n, sizeof(float));
+    move_column(score->Equalizert, old.Equalizert, n, sizeof(float));
+    move_column(score->Equalizerw, old.Equalizerw, n, sizeof(float));
+    move_column(score->Equalizerg, old.Equalizerg, n, sizeof(float));
+    move_column(score->Flanger, old.Flanger, n, sizeof(float));
+
+    free(old.block);
+    score->block = block;
+    score->allocated = capacity;
+    return 0;
+}
+
+/**
+ * @brief Копирует имя слога в блоки строк партитуры.
+ *  Блоки не перемещаются, поэтому указатели в names остаются действительными.
+ * @return Копия имени или NULL при нехватке памяти.
+ */
+static char* store_name(Score* score, const char* name, size_t len) {
+    if (score->name_block_count == 0 || score->name_block_used + len + 1 > score->name_block_size) {
+        size_t size = len + 1 > 65536 ? len + 1 : 65536;
+        char** blocks = realloc(score->name_blocks, (score->name_block_count + 1) * sizeof(char*));
+        if (!blocks) return NULL;
+        score->name_blocks = blocks;
+        blocks[score->name_block_count] = malloc(size);
+        if (!blocks[score->name_block_count]) return NULL;
+        score->name_block_count++;
+        score->name_block_used = 0;
+        score->name_block_size = size;
+    }
+
+    char* copy = score->name_blocks[score->name_block_count - 1] + score->name_block_used;
+    memcpy(copy, name, len);
+    copy[len] = '\0';
+    score->name_block_used += len + 1;
+    return copy;
+}
+
+/** @brief Добавляет слог с именем заданной длины (имя может не завершаться нулём). */
+static int append_record(Score* score, const char* name, size_t len, const EffectParams* p) {
+    if (score->count == score->allocated &&
+        tts_score_reserve(score, score->allocated ? score->allocated * 2 : 64) != 0) {
+        return -1;
+    }
+
+    int i = score->count;
+    score->names[i] = store_name(score, name, len);
+    if (!score->names[i]) return -1;
+
+    score->pitches[i] = p->semitones;
+    score->durations[i] = p->duration;
+    score->frequencies[i] = p->freq_vibro;
+    score->depths[i] = p->depth_vibro;
+    score->starts_fade_in[i] = p->start_fade_in;
+    score->durations_fade_in[i] = p->duration_fade_in;
+    score->starts_fade_out[i] = p->start_fade_out;
+    score->durations_fade_out[i] = p->duration_fade_out;
+    score->Echo1[i] = p->Echo1;
+    score->Echo2[i] = p->Echo2;
+    score->Echo3[i] = p->Echo3;
+    score->Echo4[i] = p->Echo4;
+    score->chorus[i] = p->chorus;
+    score->Equalizerf[i] = p->Equalizerf;
+    score->Equalizert[i] = p->Equalizert;
+    score->Equalizerw[i] = p->Equalizerw;
+    score->Equalizerg[i] = p->Equalizerg;
+    score->Flanger[i] = p->Flanger;
+
+    score->count++;
+    return 0;
+}
+
+int tts_score_append(Score* score, const char* name, const EffectParams* p) {
+    return append_record(score, name, strlen(name), p);
+}
+
+int tts_score_append_range(Score* score, const Score* from, int first, int count) {
+    if (count <= 0) return 0;
+    if (score->count + count > score->allocated) {
+        int capacity = score->allocated ? score->allocated : 64;
+        while (capacity < score->count + count) capacity *= 2;
+        if (tts_score_reserve(score, capacity) != 0) return -1;
+    }
+
+    int n = score->count;
+    for (int i = 0; i < count; i++) {
+        const char* name = from->names[first + i];
+        score->names[n + i] = store_name(score, name, strlen(name));
+        if (!score->names[n + i]) return -1;
+    }
+    move_column(score->pitches + n, from->pitches + first, count, sizeof(int));
+    move_column(score->durations + n, from->durations + first, count, sizeof(float));
+    move_column(score->frequencies + n, from->frequencies + first, count, sizeof(int));
+    move_column(score->depths + n, from->depths + first, count, sizeof(float));
+    move_column(score->starts_fade_in + n, from->starts_fade_in + first, count, sizeof(float));
+    move_column(score->durations_fade_in + n, from->durations_fade_in + first, count, sizeof(float));
+    move_column(score->starts_fade_out + n, from->starts_fade_out + first, count, sizeof(float));
+    move_column(score->durations_fade_out + n, from->durations_fade_out + first, count, sizeof(float));
+    move_column(score->Echo1 + n, from->Echo1 + first, count, sizeof(float));
+    move_column(score->Echo2 + n, from->Echo2 + first, count, sizeof(float));
+    move_column(score->Echo3 + n, from->Echo3 + first, count, sizeof(float));
+    move_column(score->Echo4 + n, from->Echo4 + first, count, sizeof(float));
+    move_column(score->chorus + n, from->chorus + first, count, sizeof(float));
+    move_column(score->Equalizerf + n, from->Equalizerf + first, count, sizeof(float));
+    move_column(score->Equalizert + n, from->Equalizert + first, count, sizeof(float));
+    move_column(score->Equalizerw + n, from->Equalizerw + first, count, sizeof(float));
+    move_column(score->Equalizerg + n, from->Equalizerg + first, count, sizeof(float));
+    move_column(score->Flanger + n, from->Flanger + first, count, sizeof(float));
+    score->count += count;
+    return 0;
+}
+
+void tts_score_params(const Score* score, int i, EffectParams* p) {
+    p->semitones = score->pitches[i];
+    p->duration = score->durations[i];
+    p->freq_vibro = score->frequencies[i];
+    p->depth_vibro = score->depths[i];
+    p->start_fade_in = score->starts_fade_in[i];
+    p->duration_fade_in = score->durations_fade_in[i];
+    p->start_fade_out = score->starts_fade_out[i];
+    p->duration_fade_out = score->durations_fade_out[i];
+    p->Echo1 = score->Echo1[i];
+    p->Echo2 = score->Echo2[i];
+    p->Echo3 = score->Echo3[i];
+    p->Echo4 = score->Echo4[i];
+    p->chorus = score->chorus[i];
+    p->Equalizerf = score->Equalizerf[i];
+    p->Equalizert = score->Equalizert[i];
+    p->Equalizerw = score->Equalizerw[i];
+    p->Equalizerg = score->Equalizerg[i];
+    p->Flanger = score->Flanger[i];
+}
+
+void tts_default_params(EffectParams* p) {
+    memset(p, 0, sizeof(*p));
+    p->duration = VELOCITY;
+    p->Equalizerf = EQ_FREQ;
+    p->Equalizerw = EQ_WIDTH;
+}
+
+/** @brief Названия 18 значений слога для сообщений об ошибках. */
+static const char* value_names[18] = {
+    "pitch", "duration", "vibrato frequency", "vibrato depth",
+    "fade-in start", "fade-in duration", "fade-out start", "fade-out duration",
+    "echo 1", "echo 2", "echo 3", "echo 4", "chorus",
+    "equalizer frequency", "equalizer type", "equalizer width", "equalizer gain", "flanger"
+};
+
+/** @brief Названия нот от до, по возрастанию на полутон; диезы пишутся как "#". */
+static const char* note_names[12] = {
+    "do", "do#", "re", "re#", "mi", "fa", "fa#", "sol", "sol#", "la", "la#", "si"
+};
+
+/**
+ * @brief Разбирает абсолютную ноту: do re mi fa sol la si (ti) или C D E F G A B,
+ *  необязательный знак "#" или "b" и номер октавы ("do5", "sol#4", "Eb3", "A4").
+ * @param[out] value DSP_PITCH_NOTE + MIDI-номер ноты (do5 = C5 = 72).
+ * @return 0 при успехе, -1 если строка не является нотой.
+ */
+static int parse_note(const char* s, double* value) {
+    static const struct { const char* name; int pc; } steps[] = {
+        { "sol", 7 }, { "do", 0 }, { "re", 2 }, { "mi", 4 }, { "fa", 5 }, { "la", 9 }, { "si", 11 }, { "ti", 11 },
+        { "c", 0 }, { "d", 2 }, { "e", 4 }, { "f", 5 }, { "g", 7 }, { "a", 9 }, { "b", 11 }
+    };
+    int pc = -1;
+    size_t i = 0;
+    for (size_t k = 0; k < sizeof(steps) / sizeof(steps[0]) && pc < 0; k++) {
+        size_t n = strlen(steps[k].name);
+        size_t j = 0;
+        while (j < n && tolower((unsigned char)s[j]) == steps[k].name[j]) j++;
+        if (j == n) {
+            pc = steps[k].pc;
+            i = n;
+        }
+    }
+    if (pc < 0) return -1;
+    if (s[i] == '#') {
+        pc++;
+        i++;
+    } else if (s[i] == 'b') {
+        pc--;
+        i++;
+    }
+
+    char* end;
+    long octave = strtol(s + i, &end, 10);
+    if (end == s + i || *end != '\0') return -1;
+    long midi = 12 * (octave + 1) + pc;
+    if (midi < 0 || midi > 127) return -1;
+    *value = DSP_PITCH_NOTE + midi;
+    return 0;
+}
+
+/** @brief Печатает абсолютную ноту так, как её читает parse_note(). */
+static void print_note(FILE* file, int pitch) {
+    int midi = pitch - DSP_PITCH_NOTE;
+    fprintf(file, "%s%d\n", note_names[midi % 12], midi / 12 - 1);
+}
+
+/**
+ * @brief Разбирает одно значение строки партитуры.
+ *  Дробная часть целых полей отбрасывается, как это делал atoi(). Тип эквалайзера может
+ *  быть словом ("flat" и т.п.) — тогда он равен 0, как прежде давал atof(). Тон может
+ *  быть абсолютной нотой (см. parse_note()).
+ * @return 0 при успехе, -1 если строка не является числом.
+ */
+static int parse_value(const char* token, size_t len, int field, double* value) {
+    //! Быстрый путь для обычных десятичных записей ("0", "1.0", "-12.5"): мантисса до 15 цифр
+    //! и степень десяти точно представимы в double, поэтому деление округляется так же, как strtod()
+    static const double powers[16] = {
+        1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12, 1e13, 1e14, 1e15
+    };
+    size_t i = (len > 0 && token[0] == '-') ? 1 : 0;
+    uint64_t mantissa = 0;
+    int digits = 0, decimals = -1;
+    for (; i < len && digits <= 15; i++) {
+        if (token[i] >= '0' && token[i] <= '9') {
+            mantissa = mantissa * 10 + (token[i] - '0');
+            digits++;
+            if (decimals >= 0) decimals++;
+        } else if (token[i] == '.' && decimals < 0) {
+            decimals = 0;
+        } else {
+            break;
+        }
+    }
+    if (i == len && digits > 0 && digits <= 15) {
+        double v = decimals > 0 ? (double)mantissa / powers[decimals] : (double)mantissa;
+        *value = token[0] == '-' ? -v : v;
+        return 0;
+    }
+
+    char number[64];
+    if (len == 0 || len >= sizeof(number)) return -1;
+    memcpy(number, token, len);
+    number[len] = '\0';
+
+    char* end;
+    *value = strtod(number, &end);
+    if (end == number + len) return 0;
+
+    if (field == 0) return parse_note(number, value);
+    if (field == 14) {
+        for (size_t i = 0; i < len; i++) {
+            if (!isalpha((unsigned char)number[i])) return -1;
+        }
+        *value = 0;
+        return 0;
+    }
+    return -1;
+}
+
+int tts_score_parse_text(const char* text, size_t len, const char* source, Score* score) {
+    tts_score_init(score);
+
+    //! Запись занимает не меньше 19 непустых строк, то есть не меньше 37 байт:
+    //! этой оценки хватает, чтобы больше не расширять массивы во время разбора
+    if (tts_score_reserve(score, (int)(len / 37) + 1) != 0) return -1;
+
+    const char* p = text;
+    const char* end = text + len;
+    int line = 0;
+
+    const char* name = NULL;        //!< Имя текущей записи (указывает в текст)
+    size_t name_len = 0;
+    int name_line = 0;
+    int field = 0;                  //!< Номер следующего значения записи
+    double values[18];
+
+    while (p < end) {
+        //! Выделяем строку без перевода строки и пробелов по краям
+        const char* nl = memchr(p, '\n', end - p);
+        const char* stop = nl ? nl : end;
+        const char* token = p;
+        p = nl ? nl + 1 : end;
+        line++;
+        while (token < stop && isspace((unsigned char)*token)) token++;
+        while (stop > token && isspace((unsigned char)stop[-1])) stop--;
+        size_t token_len = stop - token;
+
+        if (!name) {
+            if (token_len == 0) continue; //!< Пустые строки между записями пропускаются
+            name = token;
+            name_len = token_len;
+            name_line = line;
+            field = 0;
+            continue;
+        }
+
+        if (parse_value(token, token_len, field, &values[field]) != 0) {
+            printf("%s:%d: %s of '%.*s' is not a number: '%.*s'\n", source, line,
+                value_names[field], (int)name_len, name, (int)token_len, token);
+            tts_score_free(score);
+            return -1;
+        }
+        if (++field < 18) continue;
+
+        EffectParams params;
+        params.semitones = (int)values[0];
+        params.duration = values[1];
+        params.freq_vibro = (int)values[2];
+        params.depth_vibro = values[3];
+        params.start_fade_in = values[4];
+        params.duration_fade_in = values[5];
+        params.start_fade_out = values[6];
+        params.duration_fade_out = values[7];
+        params.Echo1 = values[8];
+        params.Echo2 = values[9];
+        params.Echo3 = values[10];
+        params.Echo4 = values[11];
+        params.chorus = values[12];
+        params.Equalizerf = values[13];
+        params.Equalizert = values[14];
+        params.Equalizerw = values[15];
+        params.Equalizerg = values[16];
+        params.Flanger = values[17];
+
+        //! Ограничение изменения тональности в пределах ±36 полутонов; ноты ограничены при рендере.
+        int is_note = params.semitones >= DSP_PITCH_NOTE && params.semitones <= DSP_PITCH_NOTE + 127;
+        if (!is_note && (params.semitones < -36 || params.semitones > 36)) {
+            params.semitones = 0;
+        }
+
+        if (append_record(score, name, name_len, &params) != 0) {
+            tts_score_free(score);
+            return -1;
+        }
+        name = NULL;
+    }
+
+    if (name) {
+        printf("%s:%d: record '%.*s' is truncated: %d of 18 values\n", source, name_line,
+            (int)name_len, name, field);
+        tts_score_free(score);
+        return -1;
+    }
+    return 0;
+}
+
+int tts_score_read_text(FILE* file, Score* score) {
+    size_t size = 0, allocated = 65536;
+    char* text = malloc(allocated);
+    size_t n;
+    while (text && (n = fread(text + size, 1, allocated - size, file)) > 0) {
+        size += n;
+        if (size == allocated) {
+            char* grown = realloc(text, allocated * 2);
+            if (!grown) {
+                free(text);
+                text = NULL;
+                break;
+            }
+            text = grown;
+            allocated *= 2;
+        }
+    }
+    if (!text) {
+        tts_score_init(score);
+        return -1;
+    }
+
+    int rc = tts_score_parse_text(text, size, "<stream>", score);
+    free(text);
+    return rc;
+}
+
+/** @brief Печатает значение с не менее чем decimals знаками после запятой и без лишних нулей. */
+static void print_value(FILE* file, double v, int decimals) {
+    char text[64];
+    snprintf(text, sizeof(text), "%.6f", v);
+
+    //! Убираем незначащие нули, оставляя не меньше decimals знаков
+    char* dot = strchr(text, '.');
+    char* end = text + strlen(text);
+    while (end > dot + 1 + decimals && end[-1] == '0') {
+        *--end = '\0';
+    }
+    if (end == dot + 1) {
+        *dot = '\0';
+    }
+    if (strcmp(text, "-0") == 0) {
+        strcpy(text, "0");
+    }
+    fprintf(file, "%s\n", text);
+}
+
+int tts_score_write_text(FILE* file, const Score* score) {
+    for (int i = 0; i < score->count; i++) {
+        EffectParams p;
+        tts_score_params(score, i, &p);
+
+        double values[18] = {
+            p.semitones, p.duration, p.freq_vibro, p.depth_vibro,
+            p.start_fade_in, p.duration_fade_in, p.start_fade_out, p.duration_fade_out,
+            p.Echo1, p.Echo2, p.Echo3, p.Echo4, p.chorus,
+            p.Equalizerf, p.Equalizert, p.Equalizerw, p.Equalizerg, p.Flanger
+        };
+
+        fprintf(file, "%s\n", score->names[i]);
+        for (int v = 0; v < 18; v++) {
+            if (v == 0 && p.semitones >= DSP_PITCH_NOTE && p.semitones <= DSP_PITCH_NOTE + 127) {
+                print_note(file, p.semitones);
+                continue;
+            }
+            if (v == 14 && values[v] == 0) {
+                fputs("flat\n", file); //!< Плоская характеристика эквалайзера (без изменений частот)
+                continue;
+            }
+            print_value(file, values[v], min_decimals[v]);
+        }
+    }
+    return ferror(file) ? -1 : 0;
+}
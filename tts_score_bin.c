@@ -0,0 +1,253 @@
+/**
+ * @file tts_score_bin.c
+ * @brief Двоичный формат партитуры: запись, отображение в память и загрузка с определением формата.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "tts.h"
+#include "trace.h"
+
+/** @brief Формат хранится в little-endian; на машинах с другим порядком байт он не поддерживается. */
+static int host_is_little_endian(void) {
+    const uint16_t probe = 1;
+    return *(const unsigned char*)&probe == 1;
+}
+
+/** @brief FNV-1a по байтам ключа. */
+static uint32_t hash_bytes(const void* data, size_t size) {
+    const unsigned char* p = data;
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < size; i++) {
+        h = (h ^ p[i]) * 16777619u;
+    }
+    return h;
+}
+
+/** @brief Переводит параметры слога в запись файла. */
+static void pack_params(const EffectParams* p, ScoreFileParams* f) {
+    memset(f, 0, sizeof(*f));
+    f->semitones = p->semitones;
+    f->duration = p->duration;
+    f->freq_vibro = p->freq_vibro;
+    f->depth_vibro = p->depth_vibro;
+    f->start_fade_in = p->start_fade_in;
+    f->duration_fade_in = p->duration_fade_in;
+    f->start_fade_out = p->start_fade_out;
+    f->duration_fade_out = p->duration_fade_out;
+    f->Echo1 = p->Echo1;
+    f->Echo2 = p->Echo2;
+    f->Echo3 = p->Echo3;
+    f->Echo4 = p->Echo4;
+    f->chorus = p->chorus;
+    f->Equalizerf = p->Equalizerf;
+    f->Equalizert = p->Equalizert;
+    f->Equalizerw = p->Equalizerw;
+    f->Equalizerg = p->Equalizerg;
+    f->Flanger = p->Flanger;
+}
+
+int tts_score_write_binary(FILE* file, const Score* score) {
+    if (!host_is_little_endian()) return -1;
+
+    //! Таблицы с открытой адресацией для поиска уже записанных наборов параметров и имён
+    size_t capacity = 16;
+    while (capacity < (size_t)score->count * 2) capacity *= 2;
+    int* param_slots = malloc(capacity * sizeof(int));
+    int* name_slots = malloc(capacity * sizeof(int));
+    ScoreFileParams* params = malloc((score->count + 1) * sizeof(ScoreFileParams));
+    ScoreFileRecord* records = malloc((score->count + 1) * sizeof(ScoreFileRecord));
+    size_t names_size = 0, names_allocated = 256;
+    char* names = malloc(names_allocated);
+    int rc = -1;
+    if (!param_slots || !name_slots || !params || !records || !names) goto done;
+    memset(param_slots, -1, capacity * sizeof(int));
+    memset(name_slots, -1, capacity * sizeof(int));
+
+    uint32_t param_count = 0;
+    for (int i = 0; i < score->count; i++) {
+        EffectParams p;
+        ScoreFileParams packed;
+        tts_score_params(score, i, &p);
+        pack_params(&p, &packed);
+
+        //! Одинаковый набор параметров хранится один раз
+        size_t slot = hash_bytes(&packed, sizeof(packed)) & (capacity - 1);
+        while (param_slots[slot] >= 0 && memcmp(&params[param_slots[slot]], &packed, sizeof(packed)) != 0) {
+            slot = (slot + 1) & (capacity - 1);
+        }
+        if (param_slots[slot] < 0) {
+            params[param_count] = packed;
+            param_slots[slot] = (int)param_count++;
+        }
+        records[i].params = (uint32_t)param_slots[slot];
+
+        //! Одинаковое имя тоже хранится один раз
+        const char* name = score->names[i];
+        size_t len = strlen(name) + 1;
+        slot = hash_bytes(name, len) & (capacity - 1);
+        while (name_slots[slot] >= 0 && strcmp(names + name_slots[slot], name) != 0) {
+            slot = (slot + 1) & (capacity - 1);
+        }
+        if (name_slots[slot] < 0) {
+            if (names_size + len > names_allocated) {
+                while (names_size + len > names_allocated) names_allocated *= 2;
+                char* grown = realloc(names, names_allocated);
+                if (!grown) goto done;
+                names = grown;
+            }
+            memcpy(names + names_size, name, len);
+            name_slots[slot] = (int)names_size;
+            names_size += len;
+        }
+        records[i].name = (uint32_t)name_slots[slot];
+    }
+
+    //! Таблица имён дополняется нулями до границы 4 байт
+    while (names_size % 4 != 0) {
+        if (names_size + 1 > names_allocated) {
+            char* grown = realloc(names, names_allocated * 2);
+            if (!grown) goto done;
+            names = grown;
+            names_allocated *= 2;
+        }
+        names[names_size++] = '\0';
+    }
+
+    ScoreFileHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, TTS_SCORE_MAGIC, sizeof(header.magic));
+    header.version = TTS_SCORE_VERSION;
+    header.count = (uint32_t)score->count;
+    header.param_count = param_count;
+    header.names_size = (uint32_t)names_size;
+
+    fwrite(&header, sizeof(header), 1, file);
+    fwrite(params, sizeof(ScoreFileParams), param_count, file);
+    fwrite(records, sizeof(ScoreFileRecord), score->count, file);
+    fwrite(names, 1, names_size, file);
+    rc = ferror(file) ? -1 : 0;
+
+done:
+    free(param_slots);
+    free(name_slots);
+    free(params);
+    free(records);
+    free(names);
+    return rc;
+}
+
+int tts_score_map_open(ScoreMap* map, const char* path) {
+    memset(map, 0, sizeof(*map));
+    if (!host_is_little_endian()) return -1;
+    if (map_file_open(&map->file, path) != 0) return -1;
+
+    const unsigned char* data = map->file.data;
+    size_t size = map->file.size;
+    ScoreFileHeader header;
+    if (size < sizeof(header)) goto invalid;
+    memcpy(&header, data, sizeof(header));
+    if (memcmp(header.magic, TTS_SCORE_MAGIC, sizeof(header.magic)) != 0 ||
+        header.version != TTS_SCORE_VERSION || header.count > 0x7FFFFFFF || header.param_count > 0x7FFFFFFF) {
+        goto invalid;
+    }
+
+    //! Размер файла должен в точности совпадать с размером всех таблиц
+    uint64_t expected = sizeof(header) + (uint64_t)header.param_count * sizeof(ScoreFileParams) +
+        (uint64_t)header.count * sizeof(ScoreFileRecord) + header.names_size;
+    if (expected != size) goto invalid;
+    if (header.count > 0 && (header.names_size == 0 || data[size - 1] != '\0')) goto invalid;
+
+    map->params = (const ScoreFileParams*)(data + sizeof(header));
+    map->records = (const ScoreFileRecord*)(map->params + header.param_count);
+    map->names = (const char*)(map->records + header.count);
+    map->count = (int)header.count;
+    map->param_count = (int)header.param_count;
+
+    //! Ссылки проверяются один раз, дальше записи читаются без проверок
+    for (int i = 0; i < map->count; i++) {
+        if (map->records[i].name >= header.names_size || map->records[i].params >= header.param_count) {
+            goto invalid;
+        }
+    }
+    return 0;
+
+invalid:
+    map_file_close(&map->file);
+    memset(map, 0, sizeof(*map));
+    return -1;
+}
+
+const char* tts_score_map_name(const ScoreMap* map, int i) {
+    return map->names + map->records[i].name;
+}
+
+void tts_score_map_params(const ScoreMap* map, int i, EffectParams* p) {
+    const ScoreFileParams* f = &map->params[map->records[i].params];
+    p->semitones = f->semitones;
+    p->duration = f->duration;
+    p->freq_vibro = f->freq_vibro;
+    p->depth_vibro = f->depth_vibro;
+    p->start_fade_in = f->start_fade_in;
+    p->duration_fade_in = f->duration_fade_in;
+    p->start_fade_out = f->start_fade_out;
+    p->duration_fade_out = f->duration_fade_out;
+    p->Echo1 = f->Echo1;
+    p->Echo2 = f->Echo2;
+    p->Echo3 = f->Echo3;
+    p->Echo4 = f->Echo4;
+    p->chorus = f->chorus;
+    p->Equalizerf = f->Equalizerf;
+    p->Equalizert = f->Equalizert;
+    p->Equalizerw = f->Equalizerw;
+    p->Equalizerg = f->Equalizerg;
+    p->Flanger = f->Flanger;
+}
+
+void tts_score_map_close(ScoreMap* map) {
+    map_file_close(&map->file);
+    memset(map, 0, sizeof(*map));
+}
+
+int tts_score_load(const char* path, Score* score) {
+    tts_score_init(score);
+
+    FILE* file = fopen(path, "rb");
+    if (!file) return -1;
+    char magic[8];
+    int binary = fread(magic, 1, sizeof(magic), file) == sizeof(magic) &&
+        memcmp(magic, TTS_SCORE_MAGIC, sizeof(magic)) == 0;
+    fclose(file);
+
+    double t = TRACE_BEGIN();
+    if (!binary) {
+        //! Текст разбирается прямо в отображении файла
+        MappedFile text;
+        if (map_file_open(&text, path) != 0) return -1;
+        int rc = tts_score_parse_text(text.data, text.size, path, score);
+        TRACE_END(t, "io", "score load", NULL, 0, (long long)text.size);
+        map_file_close(&text);
+        return rc;
+    }
+
+    ScoreMap map;
+    if (tts_score_map_open(&map, path) != 0) return -1;
+    if (tts_score_reserve(score, map.count) != 0) {
+        tts_score_map_close(&map);
+        return -1;
+    }
+    for (int i = 0; i < map.count; i++) {
+        EffectParams p;
+        tts_score_map_params(&map, i, &p);
+        if (tts_score_append(score, tts_score_map_name(&map, i), &p) != 0) {
+            tts_score_free(score);
+            tts_score_map_close(&map);
+            return -1;
+        }
+    }
+    TRACE_END(t, "io", "score load", NULL, 0, (long long)map.file.size);
+    tts_score_map_close(&map);
+    return 0;
+}
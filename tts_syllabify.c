@@ -0,0 +1,202 @@
+/**
+ * @file tts_syllabify.c
+ * @brief Разбиение транскрипции на слоги (логика trnskrp) по набору слогов голосового банка.
+ *
+ * Имена единиц банка (ba, b-a, tcha, ch-o, …) компилируются в префиксное дерево
+ * с плотной таблицей переходов: алфавит сжат до символов, встречающихся в именах,
+ * поэтому шаг автомата — одно обращение к таблице. Транскрипция режется жадно:
+ * с текущей позиции берётся самый длинный слог из набора. Каждый найденный слог
+ * добавляется в партитуру с параметрами «без заметных эффектов».
+ */
+
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "tts_internal.h"
+
+/** @brief Набор слогов: префиксное дерево имён с переходами по сжатому алфавиту. */
+struct TtsInventory {
+    unsigned char symbols[256]; ///< Байт → номер символа алфавита + 1, 0 — нет ни в одном имени
+    int symbol_count;           ///< Размер алфавита
+    int* next;                  ///< Переходы: node * symbol_count + символ → узел, 0 — нет перехода
+    unsigned char* accept;      ///< Узел завершает имя слога
+    int node_count;             ///< Узлов в дереве, корень — узел 0
+};
+
+/**
+ * Проверяет, участвует ли символ транскрипции в слогах.
+ * Остальные символы (пробелы, знаки препинания) пропускаются, как и раньше.
+ *
+ * @param[in] c Символ для проверки
+ * @return 1, если символ может входить в слог, иначе 0
+ */
+static int isUnitChar(unsigned char c) {
+    return isalpha(c) || c == '-' || c == '_';
+}
+
+TtsInventory* tts_inventory_create(const char* const* names, size_t count) {
+    TtsInventory* inv = calloc(1, sizeof(TtsInventory));
+    if (!inv) return NULL;
+
+    //! Алфавит и верхняя граница числа узлов: по узлу на каждый символ имён
+    size_t max_nodes = 1;
+    for (size_t i = 0; i < count; i++) {
+        size_t len = strlen(names[i]);
+        if (len == 0 || len > TTS_UNIT_NAME_MAX) continue;
+        max_nodes += len;
+        for (size_t k = 0; k < len; k++) {
+            unsigned char c = (unsigned char)names[i][k];
+            if (inv->symbols[c] == 0) inv->symbols[c] = (unsigned char)++inv->symbol_count;
+        }
+    }
+
+    size_t width = inv->symbol_count > 0 ? (size_t)inv->symbol_count : 1;
+    inv->next = calloc(max_nodes * width, sizeof(int));
+    inv->accept = calloc(max_nodes, 1);
+    if (!inv->next || !inv->accept) {
+        tts_inventory_free(inv);
+        return NULL;
+    }
+
+    inv->node_count = 1;
+    for (size_t i = 0; i < count; i++) {
+        size_t len = strlen(names[i]);
+        if (len == 0 || len > TTS_UNIT_NAME_MAX) continue;
+        int node = 0;
+        for (size_t k = 0; k < len; k++) {
+            int* slot = &inv->next[(size_t)node * width + inv->symbols[(unsigned char)names[i][k]] - 1];
+            if (*slot == 0) *slot = inv->node_count++;
+            node = *slot;
+        }
+        inv->accept[node] = 1;
+    }
+    return inv;
+}
+
+/** @brief Имена единиц, собираемые при обходе каталога. */
+typedef struct {
+    char** names;
+    size_t count;
+    size_t allocated;
+    int failed;
+} NameList;
+
+/** @brief Добавляет имя файла единицы (без ".wav") в список. */
+static void add_name(const char* dir, const char* file, void* ctx) {
+    NameList* list = ctx;
+    (void)dir;
+    if (list->failed) return;
+    if (list->count == list->allocated) {
+        size_t allocated = list->allocated ? list->allocated * 2 : 256;
+        char** grown = realloc(list->names, allocated * sizeof(char*));
+        if (!grown) {
+            list->failed = 1;
+            return;
+        }
+        list->names = grown;
+        list->allocated = allocated;
+    }
+    size_t len = strlen(file) - 4; //!< voicebank_scan() отдаёт только файлы "*.wav"
+    char* name = malloc(len + 1);
+    if (!name) {
+        list->failed = 1;
+        return;
+    }
+    memcpy(name, file, len);
+    name[len] = '\0';
+    list->names[list->count++] = name;
+}
+
+TtsInventory* tts_inventory_load(const char* dir) {
+    NameList list = { NULL, 0, 0, 0 };
+    TtsInventory* inv = NULL;
+    if (voicebank_scan(dir, add_name, &list) == 0 && !list.failed) {
+        inv = tts_inventory_create((const char* const*)list.names, list.count);
+    }
+    for (size_t i = 0; i < list.count; i++) {
+        free(list.names[i]);
+    }
+    free(list.names);
+    return inv;
+}
+
+void tts_inventory_free(TtsInventory* inventory) {
+    if (!inventory) return;
+    free(inventory->next);
+    free(inventory->accept);
+    free(inventory);
+}
+
+/** @brief Переход автомата по байту или 0, если такого продолжения нет ни у одного слога. */
+static int step(const TtsInventory* inv, int node, unsigned char c) {
+    int symbol = inv->symbols[c];
+    return symbol ? inv->next[(size_t)node * inv->symbol_count + symbol - 1] : 0;
+}
+
+/**
+ * Добавляет найденный слог в партитуру с параметрами по умолчанию.
+ *
+ * @param[out] score Партитура
+ * @param[in] buffer Имя слога, завершённое нулём
+ * @return 0 при успехе, -1 при нехватке памяти
+ */
+static int printBuffer(Score *score, const char *buffer) {
+    EffectParams params;
+    tts_default_params(&params);
+    return tts_score_append(score, buffer, &params);
+}
+
+/**
+ * Один шаг жадного разбора с позиции i.
+ *
+ * Автомат идёт, пока есть переход, и запоминает последний узел, завершающий
+ * слог; путь не выходит за конец слова и не длиннее самого длинного имени,
+ * поэтому общее время линейно по длине текста. Если из позиции не завершается
+ * ни один слог, её символ пропускается.
+ *
+ * @param[in] inv Набор слогов
+ * @param[in] s Транскрипция
+ * @param[in] len Длина транскрипции
+ * @param[in] i Позиция шага, i < len
+ * @param[out] name Слог, завершённый нулём (не меньше TTS_UNIT_NAME_MAX + 1 байт)
+ * @param[out] name_len Длина слога, 0 — шаг только пропустил символ
+ * @return Позиция следующего шага
+ */
+size_t syllabify_step(const TtsInventory *inv, const unsigned char *s, size_t len, size_t i,
+    char *name, int *name_len) {
+    *name_len = 0;
+    if (!isUnitChar(s[i])) {                ///< Пробелы и прочие символы между слогами пропускаем
+        return i + 1;
+    }
+
+    int node = 0;
+    int buf_len = 0;
+    size_t best_end = i + 1;                ///< Без совпадения пропускается один символ
+    for (size_t j = i; j < len && !isspace(s[j]); j++) { ///< Слог не переходит через границу слова
+        if (!isUnitChar(s[j])) continue;    ///< Знаки препинания внутри слова пропускаются
+        node = step(inv, node, s[j]);
+        if (node == 0) break;
+        name[buf_len++] = (char)s[j];       ///< Глубина дерева не больше TTS_UNIT_NAME_MAX
+        if (inv->accept[node]) {
+            *name_len = buf_len;
+            best_end = j + 1;
+        }
+    }
+    name[*name_len] = '\0';
+    return best_end;
+}
+
+int tts_syllabify(const TtsInventory* inventory, const char* text, size_t len, Score* score) {
+    const unsigned char *s = (const unsigned char *)text;
+    char buffer[TTS_UNIT_NAME_MAX + 1];     ///< Буфер для текущего слога
+    int buf_len;
+
+    for (size_t i = 0; i < len; ) {
+        i = syllabify_step(inventory, s, len, i, buffer, &buf_len);
+        if (buf_len > 0 && printBuffer(score, buffer) != 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
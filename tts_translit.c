@@ -0,0 +1,371 @@
+/**
+ * @file tts_translit.c
+ * @brief Фонетическая транскрипция русских слов латиницей (логика poslogam).
+ *
+ * Текст декодируется из UTF-8 по мере поступления, класс и фонемы каждой буквы
+ * берутся из таблицы, индексируемой кодовой точкой, а результат копится в одном
+ * выходном буфере. Состояние между символами — только предыдущая кодовая точка
+ * и согласная, мягкость которой решит следующий символ, поэтому длина строк и
+ * размер кусков ввода не ограничены. Правила совпадают с прежним poslogam.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "tts_internal.h"
+
+#define CYRILLIC_FIRST 0x400  ///< Первая кодовая точка таблицы букв (Ѐ)
+#define CYRILLIC_COUNT 0x60   ///< Кодовых точек в таблице: U+0400..U+045F, включая Ё и ё
+
+/** @brief Классы символов в таблице букв. */
+enum {
+    CH_VOWEL = 1,         ///< Гласная
+    CH_CONSONANT = 2,     ///< Согласная
+    CH_SIGN = 4,          ///< Мягкий или твёрдый знак: пропускается
+    CH_ALWAYS_HARD = 8,   ///< Согласная всегда твёрдая (ж, ш, ц)
+    CH_ALWAYS_SOFT = 16,  ///< Согласная всегда мягкая (й, ч, щ)
+    CH_SOFTENS = 32       ///< Смягчает предыдущую согласную (ь, Ь и строчные я, е, ё, ю, и)
+};
+
+/** @brief Буква: класс и транскрипция в твёрдой и мягкой форме. */
+typedef struct {
+    unsigned char flags;     ///< Набор CH_*; 0 — символ выводится как есть
+    unsigned char hard_len;  ///< Длина твёрдой формы
+    unsigned char soft_len;  ///< Длина мягкой формы
+    char hard[4];            ///< Твёрдая форма
+    char soft[4];            ///< Мягкая форма (у гласных — йотированная)
+} Letter;
+
+#define LETTER(flags, hard, soft) { (flags), sizeof(hard) - 1, sizeof(soft) - 1, hard, soft }
+
+/** @brief Таблица букв русского алфавита; прописные транскрибируются как строчные. */
+static const Letter letters[CYRILLIC_COUNT] = {
+    [L'а' - CYRILLIC_FIRST] = LETTER(CH_VOWEL, "a", "a"),
+    [L'А' - CYRILLIC_FIRST] = LETTER(CH_VOWEL, "a", "a"),
+    [L'б' - CYRILLIC_FIRST] = LETTER(CH_CONSONANT, "b", "b-"),
+    [L'Б' - CYRILLIC_FIRST] = LETTER(CH_CONSONANT, "b", "b-"),
+    [L'в' - CYRILLIC_FIRST] = LETTER(CH_CONSONANT, "v", "v-"),
+    [L'В' - CYRILLIC_FIRST] = LETTER(CH_CONSONANT, "v", "v-"),
+    [L'г' - CYRILLIC_FIRST] = LETTER(CH_CONSONANT, "g", "g-"),
+    [L'Г' - CYRILLIC_FIRST] = LETTER(CH_CONSONANT, "g", "g-"),
+    [L'д' - CYRILLIC_FIRST] = LETTER(CH_CONSONANT, "d", "d-"),
+    [L'Д' - CYRILLIC_FIRST] = LETTER(CH_CONSONANT, "d", "d-"),
+    [L'е' - CYRILLIC_FIRST] = LETTER(CH_VOWEL|CH_SOFTENS, "e", "ie"),
+    [L'Е' - CYRILLIC_FIRST] = LETTER(CH_VOWEL, "e", "ie"),
+    [L'ё' - CYRILLIC_FIRST] = LETTER(CH_VOWEL|CH_SOFTENS, "o", "io"),
+    [L'Ё' - CYRILLIC_FIRST] = LETTER(CH_VOWEL, "o", "io"),
+    [L'ж' - CYRILLIC_FIRST] = LETTER(CH_CONSONANT|CH_ALWAYS_HARD, "tch", "tch"),
+    [L'Ж' - CYRILLIC_FIRST] = LETTER(CH_CONSONANT|CH_ALWAYS_HARD, "tch", "tch"),
+    [L'з' - CYRILLIC_FIRST] = LETTER(CH_CONSONANT, "z", "z-"),
+    [L'З' - CYRILLIC_FIRST] = LETTER(CH_CONSONANT, "z", "z-"),
+    [L'и' - CYRILLIC_FIRST] = LETTER(CH_VOWEL|CH_SOFTENS, "y", "y"),
+    [L'И' - CYRILLIC_FIRST] = LETTER(CH_VOWEL, "y", "y"),
+    [L'й' - CYRILLIC_FIRST] = LETTER(CH_CONSONANT|CH_ALWAYS_SOFT, "i", "i"),
+    [L'Й' - CYRILLIC_FIRST] = LETTER(CH_CONSONANT|CH_ALWAYS_SOFT, "i", "i"),
+    [L'к' - CYRILLIC_FIRST] = LETTER(CH_CONSONANT, "k", "k-"),
+    [L'К' - CYRILLIC_FIRST] = LETTER(CH_CONSONANT, "k", "k-"),
+    [L'л' - CYRILLIC_FIRST] = LETTER(CH_CONSONANT, "l", "l-"),
+    [L'Л' - CYRILLIC_FIRST] = LETTER(CH_CONSONANT, "l", "l-"),
+    [L'м' - CYRILLIC_FIRST] = LETTER(CH_CONSONANT, "m", "m-"),
+    [L'М' - CYRILLIC_FIRST] = LETTER(CH_CONSONANT, "m", "m-"),
+    [L'н' - CYRILLIC_FIRST] = LETTER(CH_CONSONANT, "n", "n-"),
+    [L'Н' - CYRILLIC_FIRST] = LETTER(CH_CONSONANT, "n", "n-"),
+    [L'о' - CYRILLIC_FIRST] = LETTER(CH_VOWEL, "o", "o"),
+    [L'О' - CYRILLIC_FIRST] = LETTER(CH_VOWEL, "o", "o"),
+    [L'п' - CYRILLIC_FIRST] = LETTER(CH_CONSONANT, "p", "p-"),
+    [L'П' - CYRILLIC_FIRST] = LETTER(CH_CONSONANT, "p", "p-"),
+    [L'р' - CYRILLIC_FIRST] = LETTER(CH_CONSONANT, "r", "r-"),
+    [L'Р' - CYRILLIC_FIRST] = LETTER(CH_CONSONANT, "r", "r-"),
+    [L'с' - CYRILLIC_FIRST] = LETTER(CH_CONSONANT, "s", "s-"),
+    [L'С' - CYRILLIC_FIRST] = LETTER(CH_CONSONANT, "s", "s-"),
+    [L'т' - CYRILLIC_FIRST] = LETTER(CH_CONSONANT, "t", "t-"),
+    [L'Т' - CYRILLIC_FIRST] = LETTER(CH_CONSONANT, "t", "t-"),
+    [L'у' - CYRILLIC_FIRST] = LETTER(CH_VOWEL, "u", "u"),
+    [L'У' - CYRILLIC_FIRST] = LETTER(CH_VOWEL, "u", "u"),
+    [L'ф' - CYRILLIC_FIRST] = LETTER(CH_CONSONANT, "f", "f-"),
+    [L'Ф' - CYRILLIC_FIRST] = LETTER(CH_CONSONANT, "f", "f-"),
+    [L'х' - CYRILLIC_FIRST] = LETTER(CH_CONSONANT, "h", "h-"),
+    [L'Х' - CYRILLIC_FIRST] = LETTER(CH_CONSONANT, "h", "h-"),
+    [L'ц' - CYRILLIC_FIRST] = LETTER(CH_CONSONANT|CH_ALWAYS_HARD, "c", "c"),
+    [L'Ц' - CYRILLIC_FIRST] = LETTER(CH_CONSONANT|CH_ALWAYS_HARD, "c", "c"),
+    [L'ч' - CYRILLIC_FIRST] = LETTER(CH_CONSONANT|CH_ALWAYS_SOFT, "ch", "ch"),
+    [L'Ч' - CYRILLIC_FIRST] = LETTER(CH_CONSONANT|CH_ALWAYS_SOFT, "ch", "ch"),
+    [L'ш' - CYRILLIC_FIRST] = LETTER(CH_CONSONANT|CH_ALWAYS_HARD, "sh", "sh"),
+    [L'Ш' - CYRILLIC_FIRST] = LETTER(CH_CONSONANT|CH_ALWAYS_HARD, "sh", "sh"),
+    [L'щ' - CYRILLIC_FIRST] = LETTER(CH_CONSONANT|CH_ALWAYS_SOFT, "ch-", "ch-"),
+    [L'Щ' - CYRILLIC_FIRST] = LETTER(CH_CONSONANT|CH_ALWAYS_SOFT, "ch-", "ch-"),
+    [L'ъ' - CYRILLIC_FIRST] = LETTER(CH_SIGN, "", ""),
+    [L'Ъ' - CYRILLIC_FIRST] = LETTER(CH_SIGN, "", ""),
+    [L'ы' - CYRILLIC_FIRST] = LETTER(CH_VOWEL, "j", "j"),
+    [L'Ы' - CYRILLIC_FIRST] = LETTER(CH_VOWEL, "j", "j"),
+    [L'ь' - CYRILLIC_FIRST] = LETTER(CH_SIGN|CH_SOFTENS, "", ""),
+    [L'Ь' - CYRILLIC_FIRST] = LETTER(CH_SIGN|CH_SOFTENS, "", ""),
+    [L'э' - CYRILLIC_FIRST] = LETTER(CH_VOWEL, "e", "e"),
+    [L'Э' - CYRILLIC_FIRST] = LETTER(CH_VOWEL, "e", "e"),
+    [L'ю' - CYRILLIC_FIRST] = LETTER(CH_VOWEL|CH_SOFTENS, "u", "iu"),
+    [L'Ю' - CYRILLIC_FIRST] = LETTER(CH_VOWEL, "u", "iu"),
+    [L'я' - CYRILLIC_FIRST] = LETTER(CH_VOWEL|CH_SOFTENS, "a", "ia"),
+    [L'Я' - CYRILLIC_FIRST] = LETTER(CH_VOWEL, "a", "ia"),
+};
+
+static const Letter not_letter = { 0, 0, 0, "", "" }; ///< Любой символ вне таблицы
+
+/** @brief Запись таблицы для кодовой точки. */
+static const Letter* letter(uint32_t c) {
+    return c - CYRILLIC_FIRST < CYRILLIC_COUNT ? &letters[c - CYRILLIC_FIRST] : &not_letter;
+}
+
+/** @brief Отдаёт заполненную часть буфера приёмнику. */
+static void flush(TtsTranslit* t) {
+    if (t->used > 0 && !t->failed && t->write(t->buffer, t->used, t->ctx) != 0) t->failed = 1;
+    t->used = 0;
+}
+
+/** @brief Гарантирует место под n байт в буфере (n не больше 4). */
+static char* reserve(TtsTranslit* t, size_t n) {
+    if (t->used + n > sizeof(t->buffer)) flush(t);
+    char* p = t->buffer + t->used;
+    t->used += n;
+    return p;
+}
+
+/** @brief Дописывает кодовую точку в UTF-8. */
+static void out_char(TtsTranslit* t, uint32_t c) {
+    if (c < 0x80) {
+        *reserve(t, 1) = (char)c;
+    } else if (c < 0x800) {
+        char* b = reserve(t, 2);
+        b[0] = (char)(0xC0 | (c >> 6));
+        b[1] = (char)(0x80 | (c & 0x3F));
+    } else if (c < 0x10000) {
+        char* b = reserve(t, 3);
+        b[0] = (char)(0xE0 | (c >> 12));
+        b[1] = (char)(0x80 | ((c >> 6) & 0x3F));
+        b[2] = (char)(0x80 | (c & 0x3F));
+    } else {
+        char* b = reserve(t, 4);
+        b[0] = (char)(0xF0 | (c >> 18));
+        b[1] = (char)(0x80 | ((c >> 12) & 0x3F));
+        b[2] = (char)(0x80 | ((c >> 6) & 0x3F));
+        b[3] = (char)(0x80 | (c & 0x3F));
+    }
+}
+
+/** @brief Дописывает фонему буквы в твёрдой или мягкой форме. */
+static void out_phoneme(TtsTranslit* t, const Letter* l, int soft) {
+    size_t n = soft ? l->soft_len : l->hard_len;
+    memcpy(reserve(t, n), soft ? l->soft : l->hard, n);
+}
+
+/**
+ * @brief Декодирует одну кодовую точку UTF-8.
+ *  Некорректный байт возвращается как U+FFFD, чтобы разбор не зацикливался.
+ * @param final Данных больше не будет: обрезанная последовательность тоже некорректна.
+ * @return Количество прочитанных байт или 0, если последовательность обрезана концом куска.
+ */
+static size_t decode_utf8(const unsigned char* s, size_t len, int final, uint32_t* c) {
+    if (s[0] < 0x80) {
+        *c = s[0];
+        return 1;
+    }
+    size_t n = (s[0] & 0xE0) == 0xC0 ? 2 : (s[0] & 0xF0) == 0xE0 ? 3 : (s[0] & 0xF8) == 0xF0 ? 4 : 0;
+    if (n == 0 || (n > len && final)) {
+        *c = 0xFFFD;
+        return 1;
+    }
+    uint32_t v = s[0] & (0x7F >> n);
+    for (size_t i = 1; i < n; i++) {
+        if (i >= len) return 0;
+        if ((s[i] & 0xC0) != 0x80) {
+            *c = 0xFFFD;
+            return 1;
+        }
+        v = (v << 6) | (s[i] & 0x3F);
+    }
+    *c = v;
+    return n;
+}
+
+/** @brief Транскрибирует кодовую точку внутри строки (не '\n'). */
+static void put_letter(TtsTranslit* t, uint32_t c) {
+    const Letter* l = letter(c);
+
+    //! Отложенная согласная мягкая, если за ней мягкий знак или смягчающая гласная
+    if (t->pending) {
+        out_phoneme(t, letter(t->pending), (l->flags & CH_SOFTENS) != 0);
+        t->pending = 0;
+    }
+    uint32_t prev = t->prev;
+    t->prev = c;
+
+    if (l->flags & CH_VOWEL) {
+        out_phoneme(t, l, prev == c); ///< Вторая подряд такая же гласная → йотированная версия
+    } else if (l->flags & CH_CONSONANT) {
+        if (l->flags & (CH_ALWAYS_HARD | CH_ALWAYS_SOFT)) {
+            out_phoneme(t, l, (l->flags & CH_ALWAYS_SOFT) != 0);
+        } else {
+            t->pending = c;           ///< Мягкость решит следующий символ
+        }
+    } else if (!(l->flags & CH_SIGN)) {
+        out_char(t, c);               ///< Непонятные символы оставляем как есть
+    }
+}
+
+/** @brief Завершает строку: согласная в конце строки твёрдая. */
+static void end_line(TtsTranslit* t) {
+    if (t->pending) out_phoneme(t, letter(t->pending), 0);
+    out_char(t, '\n');
+    t->pending = 0;
+    t->prev = 0;
+    t->line_open = 0;
+}
+
+/** @brief Обрабатывает декодированную кодовую точку: BOM, переводы строк, буквы. */
+static void put_codepoint(TtsTranslit* t, uint32_t c) {
+    if (!t->started) {
+        t->started = 1;
+        if (c == 0xFEFF) return;      ///< Пропускаем BOM, как это делал поток с ccs=UTF-8
+    }
+    //! '\r' отбрасывается, только если за ним конец строки или текста
+    if (t->pending_cr) {
+        t->pending_cr = 0;
+        if (c == '\n') {
+            end_line(t);
+            return;
+        }
+        put_letter(t, '\r');
+    }
+    if (c == '\n') {
+        end_line(t);
+        return;
+    }
+    t->line_open = 1;
+    if (c == '\r') {
+        t->pending_cr = 1;
+    } else {
+        put_letter(t, c);
+    }
+}
+
+void tts_translit_init(TtsTranslit* t, TtsWriteFn write, void* ctx) {
+    t->write = write;
+    t->ctx = ctx;
+    t->used = 0;
+    t->partial_len = 0;
+    t->prev = 0;
+    t->pending = 0;
+    t->pending_cr = 0;
+    t->line_open = 0;
+    t->started = 0;
+    t->failed = 0;
+}
+
+void translit_resume(TtsTranslit* t, TtsWriteFn write, void* ctx, int mid_line) {
+    tts_translit_init(t, write, ctx);
+    t->started = 1;                   ///< BOM пропускается только в начале всего текста
+    if (mid_line) {
+        t->line_open = 1;
+        t->prev = ' ';                ///< Состояние сразу после пробела: согласная уже выведена
+    }
+}
+
+int translit_flush(TtsTranslit* t) {
+    flush(t);
+    return t->failed ? -1 : 0;
+}
+
+int tts_translit_feed(TtsTranslit* t, const char* data, size_t len) {
+    const unsigned char* s = (const unsigned char*)data;
+    size_t pos = 0;
+    uint32_t c;
+
+    //! Досборка кодовой точки, разрезанной границей предыдущего куска
+    while (t->partial_len > 0) {
+        size_t n = decode_utf8(t->partial, t->partial_len, 0, &c);
+        if (n == 0) {
+            if (pos == len) return t->failed ? -1 : 0;
+            t->partial[t->partial_len++] = s[pos++];
+            continue;
+        }
+        put_codepoint(t, c);
+        t->partial_len -= n;
+        memmove(t->partial, t->partial + n, t->partial_len);
+    }
+
+    while (pos < len) {
+        if (s[pos] < 0x80 && s[pos] != '\n' && s[pos] != '\r' && t->started && !t->pending_cr) {
+            //! Быстрый путь для ASCII внутри строки
+            t->line_open = 1;
+            put_letter(t, s[pos++]);
+            continue;
+        }
+        size_t n = decode_utf8(s + pos, len - pos, 0, &c);
+        if (n == 0) {
+            t->partial_len = len - pos;
+            memcpy(t->partial, s + pos, t->partial_len);
+            break;
+        }
+        put_codepoint(t, c);
+        pos += n;
+    }
+    return t->failed ? -1 : 0;
+}
+
+int tts_translit_finish(TtsTranslit* t) {
+    uint32_t c;
+    while (t->partial_len > 0) {
+        size_t n = decode_utf8(t->partial, t->partial_len, 1, &c);
+        put_codepoint(t, c);
+        t->partial_len -= n;
+        memmove(t->partial, t->partial + n, t->partial_len);
+    }
+    t->pending_cr = 0;                ///< '\r' в конце текста отбрасывается
+    if (t->line_open) end_line(t);    ///< Последняя строка без '\n' тоже завершается
+    flush(t);
+    return t->failed ? -1 : 0;
+}
+
+/** @brief Растущий буфер результата для tts_transliterate(). */
+typedef struct {
+    char* data;   ///< Байты результата
+    size_t len;   ///< Заполнено байт
+    size_t cap;   ///< Выделено байт
+} OutBuf;
+
+/** @brief Приёмник, дописывающий результат в OutBuf. */
+static int out_write(const char* data, size_t len, void* ctx) {
+    OutBuf* out = ctx;
+    if (out->len + len + 1 > out->cap) {
+        size_t cap = out->cap ? out->cap * 2 : 256;
+        while (cap < out->len + len + 1) cap *= 2;
+        char* p = realloc(out->data, cap);
+        if (!p) return -1;
+        out->data = p;
+        out->cap = cap;
+    }
+    memcpy(out->data + out->len, data, len);
+    out->len += len;
+    out->data[out->len] = '\0';
+    return 0;
+}
+
+char* tts_transliterate(const char* text, size_t len, size_t* out_len) {
+    OutBuf out = { NULL, 0, 0 };
+    TtsTranslit* t = malloc(sizeof(TtsTranslit)); //!< Буфер в куче: функцию зовут и из рабочих потоков
+    if (!t || out_write("", 0, &out) != 0) {      ///< Пустой текст даёт пустую строку, а не NULL
+        free(t);
+        return NULL;
+    }
+
+    tts_translit_init(t, out_write, &out);
+    int rc = tts_translit_feed(t, text, len);
+    if (rc == 0) rc = tts_translit_finish(t);
+    free(t);
+    if (rc != 0) {
+        free(out.data);
+        return NULL;
+    }
+    if (out_len) *out_len = out.len;
+    return out.data;
+}
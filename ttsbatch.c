@@ -0,0 +1,238 @@
+/**
+ * @file ttsbatch.c
+ * @brief Пакетный синтез: много текстов или партитур за один запуск с общим голосовым банком.
+ *
+ * Манифест — текстовый файл, одна задача на строку:
+ *
+ *     text  <файл текста>     <выходной WAV>
+ *     score <файл партитуры>  <выходной WAV>
+ *
+ * Поля разделяются пробелами или табуляцией; пустые строки и строки, начинающиеся
+ * с '#', пропускаются. Текст (UTF-8) проходит транскрипцию и разбиение на слоги,
+ * партитура читается в текстовом или двоичном формате. Голосовой банк и кэш
+ * обработанных слогов загружаются один раз и общие для всех задач; задачи
+ * распределяются по потокам (каждая задача обрабатывается в одном потоке).
+ * В конце печатается пропускная способность: задач в секунду и секунд звука в секунду.
+ *
+ * Ключ --trace=FILE записывает трассировку всех задач (Chrome trace-event) и печатает сводку.
+ *
+ * Пример: ttsbatch prompts.lst --threads=8
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "tts.h"
+#include "workers.h"
+#include "trace.h"
+
+/** @brief Задача манифеста. */
+typedef struct {
+    int line;            ///< Номер строки манифеста
+    int is_score;        ///< Вход — партитура, а не текст
+    const char* input;   ///< Входной файл
+    const char* output;  ///< Выходной WAV
+    double seconds;      ///< Длительность результата
+    int failed;          ///< Задача не выполнена
+} BatchJob;
+
+/** @brief Общий контекст задач пакета. */
+typedef struct {
+    TtsEngine* engine;
+    BatchJob* jobs;
+    const char* manifest;
+} Batch;
+
+/** @brief Выделяет следующее поле строки и завершает его нулём. */
+static char* next_field(char** p) {
+    while (**p == ' ' || **p == '\t') (*p)++;
+    if (**p == '\0') return NULL;
+    char* field = *p;
+    while (**p != '\0' && **p != ' ' && **p != '\t') (*p)++;
+    if (**p != '\0') *(*p)++ = '\0';
+    return field;
+}
+
+/**
+ * @brief Разбирает манифест в массив задач; строки манифеста изменяются на месте.
+ * @return Количество задач или -1 при ошибке в манифесте.
+ */
+static int parse_manifest(char* text, const char* path, BatchJob** jobs) {
+    int count = 0, allocated = 64;
+    *jobs = malloc(allocated * sizeof(BatchJob));
+    if (!*jobs) return -1;
+
+    int line_no = 0;
+    for (char* line = text; line; ) {
+        char* end = strchr(line, '\n');
+        if (end) *end = '\0';
+        line_no++;
+        size_t len = strlen(line);
+        if (len > 0 && line[len - 1] == '\r') line[len - 1] = '\0';
+
+        char* p = line;
+        char* kind = next_field(&p);
+        if (kind && kind[0] != '#') {
+            char* input = next_field(&p);
+            char* output = next_field(&p);
+            if (!input || !output || next_field(&p) ||
+                (strcmp(kind, "text") != 0 && strcmp(kind, "score") != 0)) {
+                printf("%s:%d: expected 'text|score <input> <output>'\n", path, line_no);
+                free(*jobs);
+                return -1;
+            }
+            if (count == allocated) {
+                allocated *= 2;
+                BatchJob* grown = realloc(*jobs, allocated * sizeof(BatchJob));
+                if (!grown) {
+                    free(*jobs);
+                    return -1;
+                }
+                *jobs = grown;
+            }
+            BatchJob* job = &(*jobs)[count++];
+            memset(job, 0, sizeof(*job));
+            job->line = line_no;
+            job->is_score = kind[0] == 's';
+            job->input = input;
+            job->output = output;
+        }
+        line = end ? end + 1 : NULL;
+    }
+    return count;
+}
+
+/** @brief Задание пула потоков: синтезирует одну задачу манифеста и записывает WAV. */
+static void batch_job(int i, void* ctx) {
+    Batch* batch = ctx;
+    BatchJob* job = &batch->jobs[i];
+    AudioBuffer audio;
+    int rc;
+    double t = TRACE_BEGIN();
+
+    if (job->is_score) {
+        Score score;
+        rc = tts_score_load(job->input, &score);
+        if (rc == 0 && tts_check_score(batch->engine, &score) > 0) rc = -1;
+        if (rc == 0) rc = tts_render(batch->engine, &score, &audio);
+        tts_score_free(&score);
+    } else {
+        size_t len = 0;
+        char* text = tts_read_file(job->input, &len);
+        rc = text ? tts_synthesize(batch->engine, text, &audio) : -1;
+        free(text);
+    }
+
+    if (rc == 0) {
+        job->seconds = audio.sample_rate > 0 ? (double)audio.frames / audio.sample_rate : 0;
+        double w = TRACE_BEGIN();
+        if (wav_write_atomic(job->output, &audio) != 0) rc = -1; //!< Прерванное задание не оставляет обрезанный WAV
+        TRACE_END(w, "io", "output write", job->output, (long long)(audio.frames * audio.channels),
+            44 + (long long)(audio.frames * audio.channels * 2));
+        audio_free(&audio);
+    }
+    if (rc != 0) {
+        job->failed = 1;
+        printf("%s:%d: cannot render %s to %s\n", batch->manifest, job->line, job->input, job->output);
+    }
+    TRACE_END(t, "render", "job", job->input, 0, 0);
+}
+
+int main(int argc, char** argv) {
+    TtsOptions options;
+    tts_default_options(&options);
+    options.voicebank_dir = "voicebank";
+    options.verbose = 0;
+    const char* manifest = NULL;
+    const char* trace_path = NULL;
+    int threads = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--backend=ffmpeg") == 0) {
+            options.backend = TTS_BACKEND_FFMPEG;
+        } else if (strcmp(argv[i], "--backend=ffmpeg-graph") == 0) {
+            options.backend = TTS_BACKEND_FFMPEG_GRAPH;
+        } else if (strcmp(argv[i], "--backend=native") == 0) {
+            options.backend = TTS_BACKEND_NATIVE;
+        } else if (strncmp(argv[i], "--threads=", 10) == 0) {
+            threads = atoi(argv[i] + 10);
+        } else if (strncmp(argv[i], "--voicebank=", 12) == 0) {
+            options.voicebank_dir = argv[i] + 12;
+        } else if (strncmp(argv[i], "--cache-dir=", 12) == 0) {
+            options.cache_dir = argv[i] + 12;
+        } else if (strncmp(argv[i], "--cache-max-mb=", 15) == 0) {
+            options.cache_max_mb = strtoul(argv[i] + 15, NULL, 10);
+        } else if (strcmp(argv[i], "--no-cache") == 0) {
+            options.cache_enabled = 0;
+        } else if (strncmp(argv[i], "--trace=", 8) == 0) {
+            trace_path = argv[i] + 8;
+        } else if (argv[i][0] != '-' && !manifest) {
+            manifest = argv[i];
+        } else {
+            printf("Unknown option: %s\n", argv[i]);
+            return 1;
+        }
+    }
+    if (!manifest) {
+        printf("Usage: ttsbatch <manifest> [--threads=N] [--voicebank=DIR] [--backend=native|ffmpeg|ffmpeg-graph] [--no-cache] [--trace=FILE]\n");
+        return 1;
+    }
+    if (threads <= 0) threads = workers_cpu_count();
+    options.threads = 1; //!< Параллельны задачи, а не слоги внутри задачи
+
+    size_t len = 0;
+    char* text = tts_read_file(manifest, &len);
+    if (!text) {
+        printf("Cannot read manifest %s\n", manifest);
+        return 1;
+    }
+    BatchJob* jobs = NULL;
+    int count = parse_manifest(text, manifest, &jobs);
+    if (count < 0) {
+        free(text);
+        return 1;
+    }
+
+    if (trace_path && trace_start(trace_path) != 0) {
+        printf("Cannot create trace file %s\n", trace_path);
+        free(jobs);
+        free(text);
+        return 1;
+    }
+
+    double started = workers_time();
+    TtsEngine* engine = tts_engine_create(&options);
+    if (!engine) {
+        printf("Cannot read voicebank directory %s\n", options.voicebank_dir);
+        free(jobs);
+        free(text);
+        return 1;
+    }
+    double loaded = workers_time();
+    printf("Voicebank: %lu units loaded in %.1f ms\n", (unsigned long)tts_engine_unit_count(engine),
+        (loaded - started) * 1000);
+    printf("Rendering %d job(s) on %d thread(s)\n", count, threads);
+
+    Batch batch = { engine, jobs, manifest };
+    workers_run(count, threads, batch_job, &batch);
+    double elapsed = workers_time() - loaded;
+    trace_stop();
+
+    int failed = 0;
+    double seconds = 0;
+    for (int i = 0; i < count; i++) {
+        failed += jobs[i].failed;
+        seconds += jobs[i].seconds;
+    }
+    printf("Done: %d of %d job(s) in %.2f s, %d failed\n", count - failed, count, elapsed, failed);
+    if (elapsed > 0) {
+        printf("Throughput: %.1f prompts/s, %.1f audio-seconds/s\n", (count - failed) / elapsed, seconds / elapsed);
+    }
+    tts_engine_print_stats(engine);
+
+    tts_engine_destroy(engine);
+    free(jobs);
+    free(text);
+    return failed > 0 ? 1 : 0;
+}
@@ -0,0 +1,411 @@
+/**
+ * @file ttsd.c
+ * @brief Демон синтеза: голосовой банк загружается один раз, задания приходят через Unix-сокет.
+ *
+ * Демон держит в памяти движок libtts (голосовой банк и кэш обработанных слогов) и
+ * принимает задания через локальный сокет (AF_UNIX; на Windows 10 и новее — через
+ * afunix.h). Клиентов обслуживает пул потоков: каждый поток принимает соединение
+ * и выполняет его запросы по очереди, поэтому одновременно обслуживается столько
+ * клиентов, сколько потоков в пуле (--workers=).
+ *
+ * Протокол: в одном соединении может быть несколько запросов подряд. Запрос — строка
+ *
+ *     SYNTH|SCORE wav|pcm <срок, мс> <длина>\n
+ *
+ * и следом <длина> байт: русский текст в UTF-8 (SYNTH) или партитура в текстовом
+ * формате output.txt (SCORE). Срок 0 означает срок по умолчанию (--deadline-ms=).
+ * Ответ — строка "OK <длина>\n" и следом WAV или сырой PCM s16le, либо строка
+ * "ERR <причина>\n". Запрос, не уложившийся в срок, получает "ERR deadline exceeded".
+ *
+ * Пример: ttsd --socket=/tmp/tts.sock --workers=4
+ */
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <afunix.h>
+#else
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/time.h>
+#include <unistd.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+
+#include "tts.h"
+#include "dsp_simd.h"
+#include "workers.h"
+
+#ifdef _WIN32
+typedef SOCKET Socket;
+#define INVALID_SOCK INVALID_SOCKET
+#define close_socket closesocket
+#define SHUT_WR SD_SEND
+#else
+typedef int Socket;
+#define INVALID_SOCK (-1)
+#define close_socket close
+#endif
+
+#define REQUEST_LINE_MAX 128  ///< Наибольшая длина строки запроса
+#define IDLE_TIMEOUT 30.0     ///< Сколько секунд соединение может ждать следующего запроса
+#define DRAIN_TIMEOUT 1.0     ///< Сколько секунд дочитывать тело отклонённого запроса
+#define DRAIN_MAX (16ul << 20) ///< Сколько байт тела отклонённого запроса дочитывать, не больше
+
+/** @brief Общее состояние демона. */
+typedef struct {
+    TtsEngine* engine;
+    Socket listener;
+    int default_deadline_ms;      ///< Срок запроса, если клиент не задал свой
+    unsigned long max_request;    ///< Наибольший размер тела запроса, байт
+    volatile int stopping;        ///< Получен сигнал завершения
+    WorkerMutex lock;             ///< Защищает счётчики
+    unsigned long served;         ///< Выполнено запросов
+    unsigned long failed;         ///< Запросов с ошибкой
+    unsigned long expired;        ///< Запросов с истёкшим сроком
+} Daemon;
+
+static Daemon* g_daemon; //!< Для обработчика сигналов
+
+/** @brief Сигнал завершения: закрываем приём, потоки пула выходят после текущих запросов. */
+static void on_signal(int sig) {
+    (void)sig;
+    if (!g_daemon) return;
+    g_daemon->stopping = 1;
+#ifdef _WIN32
+    closesocket(g_daemon->listener);
+#else
+    shutdown(g_daemon->listener, SHUT_RDWR);
+#endif
+}
+
+/** @brief Ограничивает время ожидания приёма данных из сокета. */
+static void set_timeout(Socket s, double seconds) {
+    if (seconds < 0.001) seconds = 0.001;
+#ifdef _WIN32
+    DWORD ms = (DWORD)(seconds * 1000);
+    setsockopt(s, SOL_SOCKET, SO_RCVTIMEO, (const char*)&ms, sizeof(ms));
+#else
+    struct timeval tv;
+    tv.tv_sec = (long)seconds;
+    tv.tv_usec = (long)((seconds - tv.tv_sec) * 1e6);
+    setsockopt(s, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+#endif
+}
+
+/** @brief Читает ровно size байт. @return 0 при успехе, -1 при обрыве или тайм-ауте. */
+static int recv_all(Socket s, char* data, size_t size) {
+    while (size > 0) {
+        int n = recv(s, data, size > 65536 ? 65536 : (int)size, 0);
+        if (n <= 0) return -1;
+        data += n;
+        size -= n;
+    }
+    return 0;
+}
+
+/** @brief Отправляет ровно size байт. @return 0 при успехе, -1 при обрыве. */
+static int send_all(Socket s, const void* data, size_t size) {
+    const char* p = data;
+    while (size > 0) {
+        int n = send(s, p, size > 65536 ? 65536 : (int)size, 0);
+        if (n <= 0) return -1;
+        p += n;
+        size -= n;
+    }
+    return 0;
+}
+
+/**
+ * @brief Читает строку запроса до перевода строки.
+ * @return Длина строки, 0 — клиент закрыл соединение, -1 — ошибка или слишком длинная строка.
+ */
+static int recv_line(Socket s, char* line, size_t size) {
+    size_t len = 0;
+    for (;;) {
+        char c;
+        int n = recv(s, &c, 1, 0);
+        if (n <= 0) return len == 0 && n == 0 ? 0 : -1;
+        if (c == '\n') break;
+        if (len + 1 >= size) return -1;
+        line[len++] = c;
+    }
+    if (len > 0 && line[len - 1] == '\r') len--;
+    line[len] = '\0';
+    return len > 0 ? (int)len : -1;
+}
+
+static int send_error(Socket s, const char* reason) {
+    char line[REQUEST_LINE_MAX];
+    snprintf(line, sizeof(line), "ERR %s\n", reason);
+    return send_all(s, line, strlen(line));
+}
+
+/**
+ * @brief Отвечает ошибкой на запрос, после которого соединение закрывается.
+ *  Если закрыть сокет с непрочитанным телом запроса, ядро сбрасывает соединение (RST) и клиент
+ *  может не получить строку ERR. Поэтому после ответа отправка завершается (клиент видит конец
+ *  ответа), а остаток тела дочитывается и отбрасывается — не дольше DRAIN_TIMEOUT и не больше DRAIN_MAX.
+ * @return -1: соединение нужно закрыть.
+ */
+static int reject_request(Socket s, const char* reason) {
+    send_error(s, reason);
+    shutdown(s, SHUT_WR);
+    double until = workers_time() + DRAIN_TIMEOUT;
+    char scratch[16384];
+    unsigned long drained = 0;
+    while (drained < DRAIN_MAX && workers_time() < until) {
+        set_timeout(s, until - workers_time());
+        int n = recv(s, scratch, sizeof(scratch), 0);
+        if (n <= 0) break;
+        drained += (unsigned long)n;
+    }
+    return -1;
+}
+
+/** @brief Отправляет звук в ответ на запрос: WAV с заголовком или сырой PCM. */
+static int send_audio(Socket s, const AudioBuffer* audio, int wav) {
+    int channels = audio->channels > 0 ? audio->channels : 2;
+    int sample_rate = audio->sample_rate > 0 ? audio->sample_rate : DSP_SAMPLE_RATE;
+    size_t samples = audio->frames * channels;
+    size_t size = samples * 2 + (wav ? WAV_HEADER_SIZE : 0);
+
+    char line[REQUEST_LINE_MAX];
+    snprintf(line, sizeof(line), "OK %lu\n", (unsigned long)size);
+    if (send_all(s, line, strlen(line)) != 0) return -1;
+
+    if (wav) {
+        unsigned char hdr[WAV_HEADER_SIZE];
+        wav_header(hdr, channels, sample_rate, (uint32_t)(samples * 2));
+        if (send_all(s, hdr, sizeof(hdr)) != 0) return -1;
+    }
+    unsigned char block[16384];
+    for (size_t i = 0; i < samples; ) {
+        size_t n = samples - i < sizeof(block) / 2 ? samples - i : sizeof(block) / 2;
+        dsp_pcm16_encode(audio->samples + i, block, n);
+        if (send_all(s, block, n * 2) != 0) return -1;
+        i += n;
+    }
+    return 0;
+}
+
+/**
+ * @brief Строит партитуру по телу запроса.
+ * @return NULL при успехе или причина ошибки для ответа клиенту.
+ */
+static const char* build_score(Daemon* d, int synth, const char* body, size_t len, Score* score) {
+    tts_score_init(score);
+    if (!synth) {
+        if (tts_score_parse_text(body, len, "request", score) != 0) return "invalid score";
+    } else {
+        size_t translit_len = 0;
+        char* translit = tts_transliterate(body, len, &translit_len);
+        if (!translit) return "out of memory";
+        int rc = tts_syllabify(tts_engine_inventory(d->engine), translit, translit_len, score);
+        free(translit);
+        if (rc != 0) return "out of memory";
+    }
+    if (tts_check_score(d->engine, score) > 0) return "missing voicebank units";
+    return NULL;
+}
+
+/**
+ * @brief Выполняет один запрос, строка которого уже прочитана.
+ * @return 0, если соединение можно использовать дальше, -1 — закрыть.
+ */
+static int serve_request(Daemon* d, Socket s, const char* line, double received) {
+    char command[16], format[8];
+    int deadline_ms;
+    unsigned long len;
+    if (sscanf(line, "%15s %7s %d %lu", command, format, &deadline_ms, &len) != 4 ||
+        (strcmp(command, "SYNTH") != 0 && strcmp(command, "SCORE") != 0) ||
+        (strcmp(format, "wav") != 0 && strcmp(format, "pcm") != 0) || deadline_ms < 0) {
+        return reject_request(s, "bad request");
+    }
+    if (len > d->max_request) {
+        return reject_request(s, "request too large");
+    }
+    if (deadline_ms == 0) deadline_ms = d->default_deadline_ms;
+    double deadline = received + deadline_ms / 1000.0;
+
+    //! Тело запроса тоже должно прийти до крайнего срока
+    char* body = malloc(len + 1);
+    if (!body) {
+        return reject_request(s, "out of memory");
+    }
+    set_timeout(s, deadline - workers_time());
+    if (recv_all(s, body, len) != 0) {
+        free(body);
+        return reject_request(s, workers_time() > deadline ? "deadline exceeded" : "truncated request");
+    }
+    body[len] = '\0';
+
+    Score score;
+    const char* error = build_score(d, strcmp(command, "SYNTH") == 0, body, len, &score);
+    free(body);
+
+    AudioBuffer audio;
+    memset(&audio, 0, sizeof(audio));
+    int rc = 0;
+    if (!error && score.count > 0) {
+        rc = tts_render_until(d->engine, &score, deadline, &audio);
+        if (rc == TTS_DEADLINE_EXPIRED) error = "deadline exceeded";
+        else if (rc != 0) error = "render failed";
+    }
+    if (!error && workers_time() > deadline) error = "deadline exceeded";
+
+    int sent = error ? send_error(s, error) : send_audio(s, &audio, format[0] == 'w');
+    double elapsed = workers_time() - received;
+
+    worker_mutex_lock(&d->lock);
+    if (!error) d->served++;
+    else if (strcmp(error, "deadline exceeded") == 0) d->expired++;
+    else d->failed++;
+    worker_mutex_unlock(&d->lock);
+
+    if (error) {
+        printf("%s: %d syllables, %s after %.1f ms\n", command, score.count, error, elapsed * 1000);
+    } else {
+        printf("%s: %d syllables, %.2f s of audio in %.1f ms\n", command, score.count,
+            audio.sample_rate > 0 ? (double)audio.frames / audio.sample_rate : 0.0, elapsed * 1000);
+    }
+    fflush(stdout);
+
+    audio_free(&audio);
+    tts_score_free(&score);
+    return sent;
+}
+
+/** @brief Поток пула: принимает соединения и выполняет их запросы, пока демон не остановлен. */
+static void client_worker(int index, void* ctx) {
+    Daemon* d = ctx;
+    (void)index;
+
+    while (!d->stopping) {
+        Socket s = accept(d->listener, NULL, NULL);
+        if (s == INVALID_SOCK) {
+            if (d->stopping) break;
+            continue;
+        }
+
+        char line[REQUEST_LINE_MAX];
+        for (;;) {
+            set_timeout(s, IDLE_TIMEOUT);
+            if (recv_line(s, line, sizeof(line)) <= 0) break;
+            if (serve_request(d, s, line, workers_time()) != 0 || d->stopping) break;
+        }
+        close_socket(s);
+    }
+}
+
+int main(int argc, char** argv) {
+    TtsOptions options;
+    tts_default_options(&options);
+    options.voicebank_dir = "voicebank";
+    options.threads = 1;   //!< Параллельны сами клиенты; потоки на запрос — ключом --threads=
+    options.verbose = 0;
+    const char* socket_path = "ttsd.sock";
+    int workers = workers_cpu_count();
+
+    Daemon d;
+    memset(&d, 0, sizeof(d));
+    d.default_deadline_ms = 10000;
+    d.max_request = 1024 * 1024;
+
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--socket=", 9) == 0) {
+            socket_path = argv[i] + 9;
+        } else if (strncmp(argv[i], "--workers=", 10) == 0) {
+            workers = atoi(argv[i] + 10);
+        } else if (strncmp(argv[i], "--deadline-ms=", 14) == 0) {
+            d.default_deadline_ms = atoi(argv[i] + 14);
+        } else if (strncmp(argv[i], "--max-request-kb=", 17) == 0) {
+            d.max_request = strtoul(argv[i] + 17, NULL, 10) * 1024;
+        } else if (strcmp(argv[i], "--backend=ffmpeg") == 0) {
+            options.backend = TTS_BACKEND_FFMPEG;
+        } else if (strcmp(argv[i], "--backend=ffmpeg-graph") == 0) {
+            options.backend = TTS_BACKEND_FFMPEG_GRAPH;
+        } else if (strcmp(argv[i], "--backend=native") == 0) {
+            options.backend = TTS_BACKEND_NATIVE;
+        } else if (strncmp(argv[i], "--threads=", 10) == 0) {
+            options.threads = atoi(argv[i] + 10);
+        } else if (strncmp(argv[i], "--voicebank=", 12) == 0) {
+            options.voicebank_dir = argv[i] + 12;
+        } else if (strncmp(argv[i], "--cache-max-mb=", 15) == 0) {
+            options.cache_max_mb = strtoul(argv[i] + 15, NULL, 10);
+        } else if (strcmp(argv[i], "--no-cache") == 0) {
+            options.cache_enabled = 0;
+        } else {
+            printf("Unknown option: %s\n", argv[i]);
+            return 1;
+        }
+    }
+    if (workers < 1) workers = 1;
+    if (d.default_deadline_ms <= 0) d.default_deadline_ms = 10000;
+
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(socket_path) >= sizeof(addr.sun_path)) {
+        printf("Socket path too long: %s\n", socket_path);
+        return 1;
+    }
+    strcpy(addr.sun_path, socket_path);
+
+#ifdef _WIN32
+    WSADATA wsa;
+    if (WSAStartup(MAKEWORD(2, 2), &wsa) != 0) {
+        printf("Cannot initialize Winsock\n");
+        return 1;
+    }
+#else
+    signal(SIGPIPE, SIG_IGN); //!< Клиент, закрывший соединение, не должен останавливать демон
+#endif
+
+    //! Банк и кэш загружаются один раз на всё время работы демона
+    double started = workers_time();
+    d.engine = tts_engine_create(&options);
+    if (!d.engine) {
+        printf("Cannot read voicebank directory %s\n", options.voicebank_dir);
+        return 1;
+    }
+
+    remove(socket_path); //!< Сокет, оставшийся от прежнего запуска
+    d.listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (d.listener == INVALID_SOCK || bind(d.listener, (struct sockaddr*)&addr, sizeof(addr)) != 0 ||
+        listen(d.listener, 64) != 0) {
+        printf("Cannot listen on %s\n", socket_path);
+        tts_engine_destroy(d.engine);
+        return 1;
+    }
+
+    worker_mutex_init(&d.lock);
+    g_daemon = &d;
+    signal(SIGINT, on_signal);
+    signal(SIGTERM, on_signal);
+
+    printf("Voicebank: %lu units loaded in %.1f ms\n", (unsigned long)tts_engine_unit_count(d.engine),
+        (workers_time() - started) * 1000);
+    printf("Listening on %s with %d worker(s), default deadline %d ms\n", socket_path, workers, d.default_deadline_ms);
+    fflush(stdout);
+
+    //! Каждое задание пула — поток, обслуживающий клиентов до остановки демона
+    workers_run(workers, workers, client_worker, &d);
+
+    g_daemon = NULL;
+#ifndef _WIN32
+    close_socket(d.listener);
+#endif
+    remove(socket_path);
+    printf("Stopped: %lu served, %lu expired, %lu failed\n", d.served, d.expired, d.failed);
+    tts_engine_print_stats(d.engine);
+    tts_engine_destroy(d.engine);
+    worker_mutex_destroy(&d.lock);
+#ifdef _WIN32
+    WSACleanup();
+#endif
+    return 0;
+}
@@ -0,0 +1,252 @@
+/**
+ * @file ttsstream.c
+ * @brief Потоковый синтез: текст построчно со stdin, звук в stdout по мере готовности слогов.
+ *
+ * Каждая прочитанная строка сразу проходит транскрипцию (poslogam) и разбиение на слоги
+ * (trnskrp), после чего слоги обрабатываются окнами растущего размера: первый слог
+ * строки — отдельно, чтобы звук начался как можно раньше, дальше окна по 2, 4, ...
+ * слогов, чтобы загрузить все потоки. Каждое окно сразу записывается в stdout
+ * и сбрасывается, поэтому вывод можно передавать проигрывателю через канал.
+ * Склеенный поток совпадает с output.wav, полученным для того же текста через
+ * poslogam, trnskrp и mainffmpeg.
+ *
+ * Звук выводится как сырой PCM s16le (--format=raw, по умолчанию) или как WAV
+ * с потоковым заголовком (--format=wav): размеры в заголовке равны 0xFFFFFFFF,
+ * так как длина заранее неизвестна. Сообщения библиотеки и статистика — в stderr:
+ * время запуска движка, задержка до первого отсчёта и коэффициент реального
+ * времени (время обработки / длительность звука).
+ *
+ * Ключ --trace=FILE записывает трассировку (Chrome trace-event), сводка печатается в stderr.
+ *
+ * Пример: echo "Привет" | ttsstream --format=wav > out.wav
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <io.h>
+#include <fcntl.h>
+#define dup _dup
+#define dup2 _dup2
+#define fileno _fileno
+#define fdopen _fdopen
+#else
+#include <unistd.h>
+#endif
+
+#include "tts.h"
+#include "dsp_simd.h"
+#include "workers.h"
+#include "trace.h"
+
+#define STREAM_MAX_CHANNELS 16 ///< Наибольшее число каналов потока
+
+/** @brief Состояние выходного потока: формат фиксируется по первому непустому окну. */
+typedef struct {
+    FILE* out;               ///< Поток звука (исходный stdout)
+    int wav;                 ///< Выводить заголовок WAV
+    int channels;            ///< Каналы потока, 0 — ещё не выбраны
+    int sample_rate;         ///< Частота дискретизации потока
+    unsigned long long frames; ///< Выведено кадров
+    double first_sample;     ///< Момент сброса первого отсчёта, 0 — ещё не было
+} AudioStream;
+
+/** @brief Выбирает формат потока и, для WAV, пишет заголовок с неизвестной длиной. */
+static int stream_start(AudioStream* stream, int channels, int sample_rate) {
+    if (channels < 1 || channels > STREAM_MAX_CHANNELS) return -1;
+    stream->channels = channels;
+    stream->sample_rate = sample_rate;
+    if (!stream->wav) return 0;
+
+    unsigned char hdr[WAV_HEADER_SIZE];
+    wav_header(hdr, channels, sample_rate, WAV_UNKNOWN_SIZE);
+    return fwrite(hdr, 1, sizeof(hdr), stream->out) == sizeof(hdr) ? 0 : -1;
+}
+
+/**
+ * @brief Записывает окно в поток и сбрасывает его.
+ *  Окна с другим числом каналов приводятся к каналам потока так же, как в audio_concat().
+ */
+static int stream_write(AudioStream* stream, const AudioBuffer* buf) {
+    if (buf->frames == 0) return 0;
+    if (stream->channels == 0 && stream_start(stream, buf->channels, buf->sample_rate) != 0) return -1;
+
+    int ch = stream->channels;
+    float frame[STREAM_MAX_CHANNELS];
+    unsigned char block[4096];
+    size_t per_block = sizeof(block) / 2 / ch;
+    int ok = 1;
+
+    for (size_t n = 0; ok && n < buf->frames; ) {
+        size_t count = buf->frames - n < per_block ? buf->frames - n : per_block;
+        if (buf->channels == ch) {
+            dsp_pcm16_encode(buf->samples + n * ch, block, count * ch);
+        } else {
+            for (size_t k = 0; k < count; k++) {
+                for (int c = 0; c < ch; c++) {
+                    frame[c] = buf->samples[(n + k) * buf->channels + c % buf->channels];
+                }
+                dsp_pcm16_encode(frame, block + k * ch * 2, ch);
+            }
+        }
+        ok = fwrite(block, 2 * ch, count, stream->out) == count;
+        n += count;
+    }
+
+    if (fflush(stream->out) != 0) ok = 0;
+    if (!ok) return -1;
+    stream->frames += buf->frames;
+    if (stream->first_sample == 0) stream->first_sample = workers_time();
+    return 0;
+}
+
+/**
+ * @brief Читает строку произвольной длины вместе с переводом строки.
+ * @return Длина строки или 0 в конце ввода.
+ */
+static size_t read_line(char** line, size_t* allocated) {
+    size_t len = 0;
+    while (fgets(*line + len, (int)(*allocated - len), stdin)) {
+        len += strlen(*line + len);
+        if (len > 0 && (*line)[len - 1] == '\n') break;
+        if (len + 1 >= *allocated) {
+            char* grown = realloc(*line, *allocated * 2);
+            if (!grown) break;
+            *line = grown;
+            *allocated *= 2;
+        }
+    }
+    return len;
+}
+
+int main(int argc, char** argv) {
+    TtsOptions options;
+    tts_default_options(&options);
+    options.voicebank_dir = "voicebank";
+    options.verbose = 0; //!< stdout занят звуком, ход обработки не печатаем
+    int wav = 0;
+    const char* trace_path = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--format=raw") == 0) {
+            wav = 0;
+        } else if (strcmp(argv[i], "--format=wav") == 0) {
+            wav = 1;
+        } else if (strcmp(argv[i], "--backend=ffmpeg") == 0) {
+            options.backend = TTS_BACKEND_FFMPEG;
+        } else if (strcmp(argv[i], "--backend=ffmpeg-graph") == 0) {
+            options.backend = TTS_BACKEND_FFMPEG_GRAPH;
+        } else if (strcmp(argv[i], "--backend=native") == 0) {
+            options.backend = TTS_BACKEND_NATIVE;
+        } else if (strncmp(argv[i], "--threads=", 10) == 0) {
+            options.threads = atoi(argv[i] + 10);
+        } else if (strncmp(argv[i], "--voicebank=", 12) == 0) {
+            options.voicebank_dir = argv[i] + 12;
+        } else if (strcmp(argv[i], "--no-cache") == 0) {
+            options.cache_enabled = 0;
+        } else if (strncmp(argv[i], "--trace=", 8) == 0) {
+            trace_path = argv[i] + 8;
+        } else {
+            fprintf(stderr, "Unknown option: %s\n", argv[i]);
+            return 1;
+        }
+    }
+
+    //! Звук идёт в копию stdout, а сам stdout перенаправляется в stderr,
+    //! чтобы сообщения библиотеки не смешивались с отсчётами
+    fflush(stdout);
+    int audio_fd = dup(fileno(stdout));
+    FILE* audio = audio_fd >= 0 ? fdopen(audio_fd, "wb") : NULL;
+    if (!audio || dup2(fileno(stderr), fileno(stdout)) < 0) {
+        fprintf(stderr, "Cannot set up audio output\n");
+        return 1;
+    }
+#ifdef _WIN32
+    _setmode(audio_fd, _O_BINARY);
+#endif
+
+    if (trace_path && trace_start(trace_path) != 0) {
+        fprintf(stderr, "Cannot create trace file %s\n", trace_path);
+        return 1;
+    }
+
+    double started = workers_time();
+    TtsEngine* engine = tts_engine_create(&options);
+    if (!engine) {
+        fprintf(stderr, "Cannot read voicebank directory %s\n", options.voicebank_dir);
+        return 1;
+    }
+    double startup = workers_time() - started;
+    int threads = options.threads > 0 ? options.threads : workers_cpu_count();
+    int max_window = threads * 2;
+
+    AudioStream stream = { audio, wav, 0, DSP_SAMPLE_RATE, 0, 0 };
+    double first_line = 0;     //!< Момент получения первой строки
+    double worst_latency = 0;  //!< Наибольшая задержка от строки до её первого отсчёта
+    double busy = 0;           //!< Суммарное время обработки и вывода
+    int rc = 0;
+
+    size_t allocated = 256;
+    char* line = malloc(allocated);
+    size_t len;
+    while (rc == 0 && line && (len = read_line(&line, &allocated)) > 0) {
+        double received = workers_time();
+        if (first_line == 0) first_line = received;
+
+        //! Строка независима от соседних: транскрипция и слоги считаются сразу
+        size_t translit_len = 0;
+        char* translit = tts_transliterate(line, len, &translit_len);
+        Score score;
+        tts_score_init(&score);
+        if (!translit || tts_syllabify(tts_engine_inventory(engine), translit, translit_len, &score) != 0) {
+            fprintf(stderr, "Cannot process input line\n");
+            free(translit);
+            tts_score_free(&score);
+            rc = -1;
+            break;
+        }
+        free(translit);
+        tts_check_score(engine, &score); //!< Отсутствующие слоги перечисляются и пропускаются
+
+        //! Первый слог выводится отдельно, дальше окна удваиваются до max_window
+        int line_started = 0;
+        for (int first = 0, window = 1; rc == 0 && first < score.count; first += window, window *= 2) {
+            if (window > max_window) window = max_window;
+            if (window > score.count - first) window = score.count - first;
+
+            AudioBuffer chunk;
+            if (tts_render_range(engine, &score, first, window, &chunk) != 0 || stream_write(&stream, &chunk) != 0) {
+                fprintf(stderr, "Cannot render or write syllables %d-%d\n", first + 1, first + window);
+                rc = -1;
+            }
+            if (!line_started && chunk.frames > 0) {
+                double latency = workers_time() - received;
+                if (latency > worst_latency) worst_latency = latency;
+                line_started = 1;
+            }
+            audio_free(&chunk);
+        }
+        busy += workers_time() - received;
+        tts_score_free(&score);
+    }
+    free(line);
+
+    //! Для пустого ввода WAV всё равно получает заголовок
+    if (rc == 0 && stream.channels == 0 && stream_start(&stream, 2, DSP_SAMPLE_RATE) != 0) rc = -1;
+    if (fclose(audio) != 0) rc = -1;
+
+    trace_stop(); //!< stdout уже перенаправлен в stderr, туда же идёт сводка
+    double seconds = (double)stream.frames / stream.sample_rate;
+    fprintf(stderr, "Engine startup: %.1f ms\n", startup * 1000);
+    if (stream.first_sample > 0) {
+        fprintf(stderr, "Time to first sample: %.1f ms (worst per line %.1f ms)\n",
+            (stream.first_sample - first_line) * 1000, worst_latency * 1000);
+    }
+    fprintf(stderr, "Audio: %.2f s in %.2f s of processing, real-time factor %.3f\n",
+        seconds, busy, seconds > 0 ? busy / seconds : 0.0);
+
+    tts_engine_destroy(engine);
+    return rc == 0 ? 0 : 1;
+}
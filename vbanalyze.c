@@ -0,0 +1,95 @@
+/**
+ * @file vbanalyze.c
+ * @brief Анализ голосового банка: метки основного тона всех слогов в voicebank/pitchmarks.idx.
+ *
+ * Запускается после добавления или перезаписи слогов. Слоги анализируются параллельно;
+ * по меткам встроенный движок сдвигает тон TD-PSOLA, а ноты вида "do5" в партитуре
+ * пересчитываются от частоты основного тона каждого слога.
+ *
+ * Пример: vbanalyze --voicebank=voicebank --threads=4
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pitchmarks.h"
+#include "workers.h"
+
+/** @brief Общий контекст заданий анализа. */
+typedef struct {
+    Voicebank* vb;
+    int failed;
+} Analysis;
+
+/** @brief Задание пула потоков: анализирует один слог. */
+static void analyze_job(int i, void* ctx) {
+    Analysis* a = ctx;
+    VoiceUnit* u = &a->vb->units[i];
+    PitchMarks marks;
+    if (pitchmarks_analyze(&u->audio, &marks) != 0) {
+        a->failed = 1;
+        return;
+    }
+    pitchmarks_free(&u->marks);
+    u->marks = marks;
+}
+
+int main(int argc, char** argv) {
+    const char* dir = "voicebank";
+    int threads = 0, verbose = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--voicebank=", 12) == 0) {
+            dir = argv[i] + 12;
+        } else if (strncmp(argv[i], "--threads=", 10) == 0) {
+            threads = atoi(argv[i] + 10);
+        } else if (strcmp(argv[i], "--verbose") == 0) {
+            verbose = 1;
+        } else {
+            printf("Usage: vbanalyze [--voicebank=DIR] [--threads=N] [--verbose]\n");
+            return 1;
+        }
+    }
+    if (threads <= 0) threads = workers_cpu_count();
+    if (voicebank_is_pack(dir)) {
+        printf("Analyse the voicebank directory and pack it again: %s is read-only\n", dir);
+        return 1;
+    }
+
+    Voicebank vb;
+    double started = workers_time();
+    if (voicebank_load(&vb, dir) != 0) {
+        printf("Cannot read voicebank directory %s\n", dir);
+        return 1;
+    }
+
+    Analysis a = { &vb, 0 };
+    workers_run((int)vb.count, threads, analyze_job, &a);
+    if (a.failed) {
+        printf("Out of memory while analysing %s\n", dir);
+        voicebank_free(&vb);
+        return 1;
+    }
+
+    size_t voiced = 0, marks = 0;
+    for (size_t i = 0; i < vb.count; i++) {
+        const VoiceUnit* u = &vb.units[i];
+        marks += u->marks.count;
+        if (u->marks.f0 > 0) voiced++;
+        if (verbose) {
+            printf("%-12s %7.1f Hz %6lu mark(s)\n", u->name, u->marks.f0, (unsigned long)u->marks.count);
+        }
+    }
+
+    int rc = pitchmarks_save(&vb, dir);
+    if (rc != 0) {
+        printf("Cannot write %s/%s\n", dir, PITCHMARKS_FILE);
+    } else {
+        printf("%lu unit(s), %lu voiced, %lu pitch mark(s) written to %s/%s in %.1f ms\n",
+            (unsigned long)vb.count, (unsigned long)voiced, (unsigned long)marks, dir, PITCHMARKS_FILE,
+            (workers_time() - started) * 1000);
+    }
+    voicebank_free(&vb);
+    return rc != 0;
+}
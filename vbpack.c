@@ -0,0 +1,72 @@
+/**
+ * @file vbpack.c
+ * @brief Упаковка каталога голосового банка в один архив, отображаемый в память.
+ *
+ * Архив содержит индекс и отсчёты всех единиц в формате float (выровненными блоками),
+ * а также метки основного тона из pitchmarks.idx, если анализ был выполнен. Движок
+ * открывает его ключом --voicebank=voicebank.pack: загрузка не читает WAV-файлы,
+ * а процессы и потоки делят одну копию архива в кэше страниц. После изменения
+ * слогов архив нужно пересобрать.
+ *
+ * Пример: vbpack --voicebank=voicebank --mono voicebank.pack
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "voicebank.h"
+#include "workers.h"
+
+int main(int argc, char** argv) {
+    const char* dir = "voicebank";
+    const char* output = NULL;
+    int mono = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--voicebank=", 12) == 0) {
+            dir = argv[i] + 12;
+        } else if (strcmp(argv[i], "--mono") == 0) {
+            mono = 1;
+        } else if (argv[i][0] != '-' && !output) {
+            output = argv[i];
+        } else {
+            printf("Usage: vbpack [--voicebank=DIR] [--mono] [output.pack]\n");
+            return 1;
+        }
+    }
+
+    //! По умолчанию архив кладётся рядом с каталогом: voicebank -> voicebank.pack
+    char path[1024];
+    if (!output) {
+        size_t len = strlen(dir);
+        while (len > 1 && (dir[len - 1] == '/' || dir[len - 1] == '\\')) len--;
+        snprintf(path, sizeof(path), "%.*s.pack", (int)len, dir);
+        output = path;
+    }
+    if (!voicebank_is_pack(output)) {
+        printf("Archive name must end with .pack: %s\n", output);
+        return 1;
+    }
+
+    Voicebank vb;
+    double started = workers_time();
+    if (voicebank_load(&vb, dir) != 0) {
+        printf("Cannot read voicebank directory %s\n", dir);
+        return 1;
+    }
+    size_t marked = 0;
+    for (size_t i = 0; i < vb.count; i++) {
+        if (vb.units[i].marks.count > 0) marked++;
+    }
+
+    int rc = voicebank_write_pack(&vb, output, mono);
+    if (rc != 0) {
+        printf("Cannot write %s\n", output);
+    } else {
+        printf("%lu unit(s) (%lu with pitch marks) packed %s into %s in %.1f ms\n", (unsigned long)vb.count,
+            (unsigned long)marked, mono ? "as mono" : "as stereo", output, (workers_time() - started) * 1000);
+    }
+    voicebank_free(&vb);
+    return rc != 0;
+}
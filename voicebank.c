@@ -0,0 +1,473 @@
+/**
+ * @file voicebank.c
+ * @brief Резидентный индекс голосового банка: сканирование каталога, архив и хеш-поиск.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <dirent.h>
+#endif
+
+#include "voicebank.h"
+#include "pitchmarks.h"
+#include "trace.h"
+
+/** @brief Длина имени слога без расширения ".wav". */
+static size_t unit_name_len(const char* name) {
+    size_t len = strlen(name);
+    if (len >= 4 && strcmp(name + len - 4, ".wav") == 0) {
+        len -= 4;
+    }
+    return len;
+}
+
+/** @brief Хеш FNV-1a по первым len байтам имени. */
+static uint32_t hash_name(const char* name, size_t len) {
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < len; i++) {
+        h ^= (unsigned char)name[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+/** @brief Хеш содержимого единицы: FNV-1a по 64-битным словам отсчётов и формату. */
+static uint64_t hash_audio(const AudioBuffer* a) {
+    uint64_t h = 14695981039346656037ull;
+    const unsigned char* p = (const unsigned char*)a->samples;
+    size_t bytes = a->frames * a->channels * sizeof(float);
+    size_t i = 0;
+    for (; i + 8 <= bytes; i += 8) {
+        uint64_t w;
+        memcpy(&w, p + i, 8);
+        h = (h ^ w) * 1099511628211ull;
+    }
+    for (; i < bytes; i++) {
+        h = (h ^ p[i]) * 1099511628211ull;
+    }
+    h = (h ^ (uint64_t)a->channels) * 1099511628211ull;
+    h = (h ^ (uint64_t)a->sample_rate) * 1099511628211ull;
+    return h;
+}
+
+/** @brief Заголовок архива голосового банка (little-endian). */
+typedef struct {
+    char magic[8];          ///< "TTSVBPK\0"
+    uint32_t version;       ///< VOICEBANK_PACK_VERSION
+    uint32_t unit_count;    ///< Количество единиц
+    uint64_t index_offset;  ///< Смещение индекса PackUnit[unit_count]
+    uint64_t names_offset;  ///< Смещение имён, завершённых нулём
+    uint64_t size;          ///< Полный размер архива: защита от обрезанного файла
+} PackHeader;
+
+/** @brief Запись индекса архива: где лежат отсчёты и метки одной единицы. */
+typedef struct {
+    uint64_t data_offset;   ///< Отсчёты float, чередующиеся по каналам, выровнены на VOICEBANK_PACK_ALIGN
+    uint64_t frames;        ///< Кадров
+    uint64_t hash;          ///< Хеш содержимого, как у загруженного WAV
+    uint64_t marks_offset;  ///< Метки PitchMark[mark_count], выровнены так же
+    uint64_t marks_hash;    ///< Хеш меток для ключа кэша
+    uint32_t name_offset;   ///< Смещение имени от names_offset
+    uint32_t channels;      ///< Каналов
+    uint32_t sample_rate;   ///< Частота дискретизации
+    uint32_t mark_count;    ///< Количество меток, 0 — анализа нет
+    float f0;               ///< Частота основного тона, Гц
+    uint32_t reserved;
+} PackUnit;
+
+static const char pack_magic[8] = { 'T', 'T', 'S', 'V', 'B', 'P', 'K', 0 };
+
+/** @brief Формат хранится в little-endian; на машинах с другим порядком байт он не поддерживается. */
+static int host_is_little_endian(void) {
+    const uint16_t probe = 1;
+    return *(const unsigned char*)&probe == 1;
+}
+
+/** @brief Нужно ли загружать файл как единицу банка. */
+static int is_unit_file(const char* file) {
+    size_t len = strlen(file);
+    if (len <= 4 || strcmp(file + len - 4, ".wav") != 0) return 0;
+    if (strcmp(file, "output.wav") == 0) return 0;          //!< Результат рендера, а не слог
+    if (strncmp(file, "temp_modifier_", 14) == 0) return 0; //!< Остатки прерванного рендера
+    return 1;
+}
+
+/** @brief Загружаемый банк и выделенное место в его списке единиц. */
+typedef struct {
+    Voicebank* vb;
+    size_t allocated;
+    int failed; ///< Не хватило памяти: банк загружен не полностью
+} LoadState;
+
+/** @brief Загружает один файл и добавляет его в список единиц. */
+static void add_unit(const char* dir, const char* file, void* ctx) {
+    LoadState* state = ctx;
+    Voicebank* vb = state->vb;
+    char path[1024];
+    snprintf(path, sizeof(path), "%s/%s", dir, file);
+
+    VoiceUnit unit;
+    memset(&unit.marks, 0, sizeof(unit.marks));
+    double t = TRACE_BEGIN();
+    if (wav_read(path, &unit.audio) != 0) {
+        printf("Skipping unreadable voicebank unit %s\n", path);
+        return;
+    }
+    if (unit.audio.sample_rate != DSP_SAMPLE_RATE) {
+        printf("Warning: %s is %d Hz, expected %d Hz\n", path, unit.audio.sample_rate, DSP_SAMPLE_RATE);
+    }
+
+    unit.hash = hash_audio(&unit.audio);
+    TRACE_END(t, "io", "voicebank unit", file, (long long)(unit.audio.frames * unit.audio.channels),
+        44 + (long long)(unit.audio.frames * unit.audio.channels * 2));
+
+    size_t len = unit_name_len(file);
+    unit.name = malloc(len + 1);
+    if (!unit.name) {
+        audio_free(&unit.audio);
+        state->failed = 1;
+        return;
+    }
+    memcpy(unit.name, file, len);
+    unit.name[len] = '\0';
+
+    if (vb->count == state->allocated) {
+        size_t allocated = state->allocated ? state->allocated * 2 : 256;
+        VoiceUnit* grown = realloc(vb->units, allocated * sizeof(VoiceUnit));
+        if (!grown) {
+            free(unit.name);
+            audio_free(&unit.audio);
+            state->failed = 1;
+            return;
+        }
+        vb->units = grown;
+        state->allocated = allocated;
+    }
+    vb->units[vb->count++] = unit;
+}
+
+/**
+ * @brief Строит таблицу открытой адресации по загруженным единицам.
+ * @return 0 при успехе, -1 при нехватке памяти.
+ */
+static int build_index(Voicebank* vb) {
+    vb->capacity = 16;
+    while (vb->capacity < vb->count * 2) {
+        vb->capacity *= 2;
+    }
+    vb->slots = malloc(vb->capacity * sizeof(int));
+    if (!vb->slots) {
+        vb->capacity = 0;
+        return -1;
+    }
+    for (size_t i = 0; i < vb->capacity; i++) {
+        vb->slots[i] = -1;
+    }
+
+    for (size_t i = 0; i < vb->count; i++) {
+        size_t mask = vb->capacity - 1;
+        size_t s = hash_name(vb->units[i].name, strlen(vb->units[i].name)) & mask;
+        while (vb->slots[s] != -1) {
+            s = (s + 1) & mask;
+        }
+        vb->slots[s] = (int)i;
+    }
+    return 0;
+}
+
+/** @brief Проверяет, оканчивается ли имя файла на suffix (и не совпадает ли с ним целиком). */
+static int has_suffix(const char* file, const char* suffix) {
+    size_t len = strlen(file), suffix_len = strlen(suffix);
+    return len > suffix_len && strcmp(file + len - suffix_len, suffix) == 0;
+}
+
+/** @brief Обходит файлы каталога с окончанием suffix; units — только файлы единиц (is_unit_file()). */
+static int scan_dir(const char* dir, const char* suffix, int units, VoicebankFileFn fn, void* ctx) {
+#ifdef _WIN32
+    char pattern[1024];
+    snprintf(pattern, sizeof(pattern), "%s\\*%s", dir, suffix);
+
+    WIN32_FIND_DATAA fd;
+    HANDLE h = FindFirstFileA(pattern, &fd);
+    if (h == INVALID_HANDLE_VALUE) {
+        return -1;
+    }
+    do {
+        if (!(fd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) && has_suffix(fd.cFileName, suffix) &&
+            (!units || is_unit_file(fd.cFileName))) {
+            fn(dir, fd.cFileName, ctx);
+        }
+    } while (FindNextFileA(h, &fd));
+    FindClose(h);
+#else
+    DIR* d = opendir(dir);
+    if (!d) {
+        return -1;
+    }
+    struct dirent* e;
+    while ((e = readdir(d)) != NULL) {
+        if (has_suffix(e->d_name, suffix) && (!units || is_unit_file(e->d_name))) {
+            fn(dir, e->d_name, ctx);
+        }
+    }
+    closedir(d);
+#endif
+    return 0;
+}
+
+int voicebank_scan(const char* dir, VoicebankFileFn fn, void* ctx) {
+    return scan_dir(dir, ".wav", 1, fn, ctx);
+}
+
+int voicebank_scan_suffix(const char* dir, const char* suffix, VoicebankFileFn fn, void* ctx) {
+    return scan_dir(dir, suffix, 0, fn, ctx);
+}
+
+int voicebank_is_pack(const char* path) {
+    size_t len = strlen(path);
+    return len > 5 && strcmp(path + len - 5, ".pack") == 0;
+}
+
+/** @brief Округляет смещение вверх до VOICEBANK_PACK_ALIGN. */
+static uint64_t pack_align(uint64_t offset) {
+    return (offset + VOICEBANK_PACK_ALIGN - 1) & ~(uint64_t)(VOICEBANK_PACK_ALIGN - 1);
+}
+
+/** @brief Дописывает нули до смещения offset. */
+static int pack_pad(FILE* f, uint64_t* pos, uint64_t offset) {
+    static const char zeros[VOICEBANK_PACK_ALIGN] = { 0 };
+    size_t n = (size_t)(offset - *pos);
+    *pos = offset;
+    return fwrite(zeros, 1, n, f) == n ? 0 : -1;
+}
+
+int voicebank_write_pack(const Voicebank* vb, const char* path, int mono) {
+    if (!host_is_little_endian()) return -1;
+    PackUnit* index = calloc(vb->count + 1, sizeof(PackUnit));
+    if (!index) return -1;
+
+    //! Раскладка: заголовок, индекс, имена, затем выровненные блоки отсчётов и меток
+    PackHeader header;
+    memcpy(header.magic, pack_magic, sizeof(header.magic));
+    header.version = VOICEBANK_PACK_VERSION;
+    header.unit_count = (uint32_t)vb->count;
+    header.index_offset = sizeof(PackHeader);
+    header.names_offset = header.index_offset + vb->count * sizeof(PackUnit);
+    uint64_t offset = header.names_offset;
+    for (size_t i = 0; i < vb->count; i++) {
+        index[i].name_offset = (uint32_t)(offset - header.names_offset);
+        offset += strlen(vb->units[i].name) + 1;
+    }
+    for (size_t i = 0; i < vb->count; i++) {
+        const VoiceUnit* u = &vb->units[i];
+        PackUnit* e = &index[i];
+        e->channels = mono ? 1 : (uint32_t)u->audio.channels;
+        e->frames = u->audio.frames;
+        e->sample_rate = (uint32_t)u->audio.sample_rate;
+        e->data_offset = pack_align(offset);
+        offset = e->data_offset + e->frames * e->channels * sizeof(float);
+        e->hash = u->hash;
+        e->mark_count = (uint32_t)u->marks.count;
+        e->f0 = u->marks.f0;
+        e->marks_hash = u->marks.hash;
+        if (e->mark_count > 0) {
+            e->marks_offset = pack_align(offset);
+            offset = e->marks_offset + e->mark_count * sizeof(PitchMark);
+        }
+    }
+    header.size = offset;
+
+    FILE* f = fopen(path, "wb");
+    if (!f) {
+        free(index);
+        return -1;
+    }
+    uint64_t pos = header.names_offset;
+    int ok = fwrite(&header, sizeof(header), 1, f) == 1 &&
+        fwrite(index, sizeof(PackUnit), vb->count, f) == vb->count;
+    for (size_t i = 0; i < vb->count && ok; i++) {
+        size_t len = strlen(vb->units[i].name) + 1;
+        ok = fwrite(vb->units[i].name, 1, len, f) == len;
+        pos += len;
+    }
+
+    for (size_t i = 0; i < vb->count && ok; i++) {
+        const VoiceUnit* u = &vb->units[i];
+        PackUnit* e = &index[i];
+        const float* samples = u->audio.samples;
+        float* downmix = NULL;
+        if (mono && u->audio.channels > 1) {
+            //! Моно — среднее каналов; хеш считается по тому, что записано
+            int ch = u->audio.channels;
+            downmix = malloc(u->audio.frames * sizeof(float) + 1);
+            if (!downmix) {
+                ok = 0;
+                break;
+            }
+            for (size_t k = 0; k < u->audio.frames; k++) {
+                float s = 0;
+                for (int c = 0; c < ch; c++) s += u->audio.samples[k * ch + c];
+                downmix[k] = s / ch;
+            }
+            AudioBuffer mixed = { downmix, u->audio.frames, 1, u->audio.sample_rate };
+            e->hash = hash_audio(&mixed);
+            samples = downmix;
+        }
+        size_t n = (size_t)(e->frames * e->channels);
+        ok = pack_pad(f, &pos, e->data_offset) == 0 && fwrite(samples, sizeof(float), n, f) == n;
+        pos += n * sizeof(float);
+        free(downmix);
+        if (ok && e->mark_count > 0) {
+            ok = pack_pad(f, &pos, e->marks_offset) == 0 &&
+                fwrite(u->marks.marks, sizeof(PitchMark), e->mark_count, f) == e->mark_count;
+            pos += e->mark_count * sizeof(PitchMark);
+        }
+    }
+
+    //! Хеши моно-единиц известны только после записи отсчётов: индекс переписывается
+    if (ok && mono) {
+        ok = fseek(f, (long)header.index_offset, SEEK_SET) == 0 &&
+            fwrite(index, sizeof(PackUnit), vb->count, f) == vb->count;
+    }
+    if (fclose(f) != 0) ok = 0;
+    free(index);
+    if (!ok) {
+        remove(path);
+        return -1;
+    }
+    return 0;
+}
+
+/** @brief Проверяет, что блок [offset, offset + size) целиком лежит в архиве и выровнен. */
+static int pack_block_ok(const Voicebank* vb, uint64_t offset, uint64_t size) {
+    return offset % VOICEBANK_PACK_ALIGN == 0 && offset <= vb->pack.size && size <= vb->pack.size - offset;
+}
+
+/** @brief Отображает архив и строит единицы, указывающие прямо в отображение. */
+static int load_pack(Voicebank* vb, const char* path) {
+    if (!host_is_little_endian() || map_file_open(&vb->pack, path) != 0) return -1;
+    vb->packed = 1;
+    double t = TRACE_BEGIN();
+
+    const unsigned char* base = vb->pack.data;
+    const PackHeader* header = (const PackHeader*)base;
+    if (vb->pack.size < sizeof(PackHeader) || memcmp(header->magic, pack_magic, sizeof(pack_magic)) != 0 ||
+        header->version != VOICEBANK_PACK_VERSION || header->size != vb->pack.size ||
+        header->index_offset > vb->pack.size ||
+        header->unit_count > (vb->pack.size - header->index_offset) / sizeof(PackUnit) ||
+        header->names_offset > vb->pack.size) {
+        printf("%s is not a voicebank archive of version %d\n", path, VOICEBANK_PACK_VERSION);
+        return -1;
+    }
+
+    const PackUnit* index = (const PackUnit*)(base + header->index_offset);
+    vb->units = calloc(header->unit_count + 1, sizeof(VoiceUnit));
+    if (!vb->units) return -1;
+    for (uint32_t i = 0; i < header->unit_count; i++) {
+        const PackUnit* e = &index[i];
+        uint64_t name = header->names_offset + e->name_offset;
+        if (name >= vb->pack.size || !memchr(base + name, '\0', vb->pack.size - name) || e->channels == 0 ||
+            e->frames > vb->pack.size / sizeof(float) / e->channels ||
+            !pack_block_ok(vb, e->data_offset, e->frames * e->channels * sizeof(float)) ||
+            (e->mark_count > 0 && !pack_block_ok(vb, e->marks_offset, (uint64_t)e->mark_count * sizeof(PitchMark)))) {
+            printf("%s: entry %u is damaged\n", path, (unsigned)i);
+            return -1;
+        }
+
+        //! Отсчёты и метки не копируются: архив доступен только для чтения, а движок их не меняет
+        VoiceUnit* u = &vb->units[vb->count++];
+        u->name = (char*)(base + name);
+        u->audio.samples = (float*)(base + e->data_offset);
+        u->audio.frames = (size_t)e->frames;
+        u->audio.channels = (int)e->channels;
+        u->audio.sample_rate = (int)e->sample_rate;
+        u->hash = e->hash;
+        if (e->mark_count > 0) {
+            u->marks.marks = (PitchMark*)(base + e->marks_offset);
+            u->marks.count = e->mark_count;
+            u->marks.f0 = e->f0;
+            u->marks.hash = e->marks_hash;
+        }
+    }
+    TRACE_END(t, "io", "voicebank pack", path, 0, (long long)vb->pack.size);
+    return 0;
+}
+
+int voicebank_load(Voicebank* vb, const char* dir) {
+    memset(vb, 0, sizeof(*vb));
+    if (voicebank_is_pack(dir)) {
+        if (load_pack(vb, dir) != 0) {
+            voicebank_free(vb);
+            return -1;
+        }
+        if (build_index(vb) != 0) {
+            voicebank_free(vb);
+            return -1;
+        }
+        return 0;
+    }
+
+    LoadState state = { vb, 0, 0 };
+    if (voicebank_scan(dir, add_unit, &state) != 0) {
+        voicebank_free(vb);
+        return -1;
+    }
+    if (state.failed || build_index(vb) != 0) {
+        printf("Out of memory loading voicebank %s\n", dir);
+        voicebank_free(vb);
+        return -1;
+    }
+    pitchmarks_attach(vb, dir); //!< Без файла меток тон сдвигается как в FFmpeg
+    return 0;
+}
+
+const VoiceUnit* voicebank_find_unit(const Voicebank* vb, const char* name) {
+    if (vb->capacity == 0) return NULL;
+
+    size_t len = unit_name_len(name);
+    size_t mask = vb->capacity - 1;
+    size_t s = hash_name(name, len) & mask;
+
+    while (vb->slots[s] != -1) {
+        const VoiceUnit* u = &vb->units[vb->slots[s]];
+        if (strncmp(u->name, name, len) == 0 && u->name[len] == '\0') {
+            return u;
+        }
+        s = (s + 1) & mask;
+    }
+    return NULL;
+}
+
+const AudioBuffer* voicebank_find(const Voicebank* vb, const char* name) {
+    const VoiceUnit* u = voicebank_find_unit(vb, name);
+    return u ? &u->audio : NULL;
+}
+
+int voicebank_check(const Voicebank* vb, const char** names, int count) {
+    int missing = 0;
+    for (int i = 0; i < count; i++) {
+        if (!voicebank_find(vb, names[i])) {
+            printf("Missing voicebank unit: %s (syllable %d)\n", names[i], i + 1);
+            missing++;
+        }
+    }
+    return missing;
+}
+
+void voicebank_free(Voicebank* vb) {
+    for (size_t i = 0; i < vb->count && !vb->packed; i++) {
+        free(vb->units[i].name);
+        audio_free(&vb->units[i].audio);
+        pitchmarks_free(&vb->units[i].marks);
+    }
+    free(vb->units);
+    free(vb->slots);
+    if (vb->packed) map_file_close(&vb->pack);
+    memset(vb, 0, sizeof(*vb));
+}
@@ -0,0 +1,114 @@
+/**
+ * @file voicebank.h
+ * @brief Резидентный индекс голосового банка.
+ *
+ * Каталог voicebank/ сканируется один раз при запуске: заголовки WAV разбираются,
+ * отсчёты декодируются в память, а единицы (слоги) раскладываются в хеш-таблицу
+ * по имени. Поиск во время рендера выполняется за O(1) и не обращается к диску.
+ * Если в каталоге есть файл меток основного тона (pitchmarks.h), метки
+ * прикрепляются к единицам при загрузке.
+ *
+ * Вместо каталога можно загрузить архив *.pack (программа vbpack): единицы лежат
+ * в нём готовыми отсчётами float в выровненных блоках вместе с метками, и архив
+ * отображается в память только для чтения. Загрузка сводится к разбору индекса,
+ * а все процессы, открывшие один архив, делят одну копию в кэше страниц.
+ */
+
+#ifndef VOICEBANK_H
+#define VOICEBANK_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "dsp.h"
+#include "mapfile.h"
+
+#define VOICEBANK_PACK_VERSION 1 ///< Версия формата архива
+#define VOICEBANK_PACK_ALIGN 64  ///< Выравнивание блоков отсчётов и меток в архиве, байт
+
+/** @brief Одна единица голосового банка: имя слога и его декодированный звук. */
+typedef struct {
+    char* name;         ///< Имя слога без расширения (".wav")
+    AudioBuffer audio;  ///< Декодированные отсчёты
+    uint64_t hash;      ///< Хеш содержимого: меняется, если файл слога перезаписан
+    PitchMarks marks;   ///< Метки основного тона; count == 0 — анализа нет или он устарел
+} VoiceUnit;
+
+/** @brief Загруженный голосовой банк с хеш-таблицей для поиска по имени. */
+typedef struct {
+    VoiceUnit* units;   ///< Все загруженные единицы
+    size_t count;       ///< Количество единиц
+    int* slots;         ///< Открытая адресация: индекс в units или -1
+    size_t capacity;    ///< Размер таблицы slots (степень двойки)
+    MappedFile pack;    ///< Отображённый архив: имена, отсчёты и метки единиц указывают в него
+    int packed;         ///< Банк загружен из архива и доступен только для чтения
+} Voicebank;
+
+/** @brief Обработчик файла единицы при обходе каталога: file — имя файла с ".wav". */
+typedef void (*VoicebankFileFn)(const char* dir, const char* file, void* ctx);
+
+/**
+ * @brief Обходит файлы единиц каталога, не читая их (те же файлы, что загружает voicebank_load()).
+ * @return 0 при успехе, -1 если каталог не удалось прочитать.
+ */
+int voicebank_scan(const char* dir, VoicebankFileFn fn, void* ctx);
+
+/**
+ * @brief Обходит все файлы каталога, имена которых оканчиваются на suffix (например, ".part").
+ * @return 0 при успехе, -1 если каталог не удалось прочитать.
+ */
+int voicebank_scan_suffix(const char* dir, const char* suffix, VoicebankFileFn fn, void* ctx);
+
+/**
+ * @brief Сканирует каталог и загружает все WAV-файлы голосового банка.
+ *  Файл результата output.wav и промежуточные temp_modifier_* пропускаются.
+ *  Метки основного тона из файла-спутника прикрепляются к единицам с тем же хешем.
+ *  Путь к архиву (voicebank_is_pack()) отображается в память без копирования.
+ * @param[out] vb Заполняемый банк (освобождается voicebank_free()).
+ * @param[in] dir Каталог голосового банка или архив *.pack.
+ * @return 0 при успехе, -1 если каталог или архив не удалось прочитать или не хватило памяти.
+ */
+int voicebank_load(Voicebank* vb, const char* dir);
+
+/** @brief Указывает ли путь на архив голосового банка (оканчивается на ".pack"). */
+int voicebank_is_pack(const char* path);
+
+/**
+ * @brief Записывает загруженный банк в архив.
+ *  Хеши единиц стереоархива совпадают с хешами WAV-файлов, поэтому кэш и метки остаются действительными.
+ * @param[in] vb Голосовой банк.
+ * @param[in] path Файл архива.
+ * @param[in] mono Свести каждую единицу в моно (вдвое меньше архив; результат рендера тоже моно).
+ * @return 0 при успехе, -1 при ошибке записи или нехватке памяти.
+ */
+int voicebank_write_pack(const Voicebank* vb, const char* path, int mono);
+
+/**
+ * @brief Ищет единицу по имени слога вместе с её метаданными (хешем содержимого).
+ * @param[in] vb Голосовой банк.
+ * @param[in] name Имя слога; расширение ".wav" допускается и игнорируется.
+ * @return Единица или NULL, если такой нет.
+ */
+const VoiceUnit* voicebank_find_unit(const Voicebank* vb, const char* name);
+
+/**
+ * @brief Ищет звук единицы по имени слога.
+ * @param[in] vb Голосовой банк.
+ * @param[in] name Имя слога; расширение ".wav" допускается и игнорируется.
+ * @return Звук единицы или NULL, если такой нет.
+ */
+const AudioBuffer* voicebank_find(const Voicebank* vb, const char* name);
+
+/**
+ * @brief Проверяет, что все слоги партитуры есть в банке, и печатает отсутствующие.
+ * @param[in] vb Голосовой банк.
+ * @param[in] names Имена слогов.
+ * @param[in] count Количество имён.
+ * @return Количество отсутствующих слогов (0 — всё на месте).
+ */
+int voicebank_check(const Voicebank* vb, const char** names, int count);
+
+/** @brief Освобождает все единицы и таблицу поиска. */
+void voicebank_free(Voicebank* vb);
+
+#endif /* VOICEBANK_H */
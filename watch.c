@@ -0,0 +1,170 @@
+/**
+ * @file watch.c
+ * @brief Наблюдение за каталогами: ReadDirectoryChangesW в Windows, inotify в Linux.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+#endif
+
+#include "watch.h"
+
+#define WATCH_BUFFER 16384 ///< Буфер событий одного чтения, байт
+
+#ifdef _WIN32
+
+struct Watch {
+    HANDLE dirs[WATCH_MAX_DIRS];      ///< Каталоги, открытые для чтения изменений
+    HANDLE events[WATCH_MAX_DIRS];    ///< События завершения асинхронного чтения
+    OVERLAPPED overlapped[WATCH_MAX_DIRS];
+    DWORD* buffers[WATCH_MAX_DIRS];   ///< Буферы FILE_NOTIFY_INFORMATION (выровнены на DWORD)
+    int count;
+};
+
+/** @brief Запускает асинхронное чтение изменений каталога k. */
+static int watch_arm(Watch* w, int k) {
+    ResetEvent(w->events[k]);
+    memset(&w->overlapped[k], 0, sizeof(OVERLAPPED));
+    w->overlapped[k].hEvent = w->events[k];
+    return ReadDirectoryChangesW(w->dirs[k], w->buffers[k], WATCH_BUFFER, FALSE,
+        FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_LAST_WRITE | FILE_NOTIFY_CHANGE_SIZE,
+        NULL, &w->overlapped[k], NULL) ? 0 : -1;
+}
+
+Watch* watch_create(void) {
+    return calloc(1, sizeof(Watch));
+}
+
+int watch_add(Watch* w, const char* dir) {
+    if (w->count == WATCH_MAX_DIRS) return -1;
+    int k = w->count;
+    w->dirs[k] = CreateFileA(dir, FILE_LIST_DIRECTORY, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+        NULL, OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED, NULL);
+    if (w->dirs[k] == INVALID_HANDLE_VALUE) return -1;
+    w->events[k] = CreateEventA(NULL, TRUE, FALSE, NULL);
+    w->buffers[k] = malloc(WATCH_BUFFER);
+    if (!w->events[k] || !w->buffers[k] || watch_arm(w, k) != 0) {
+        if (w->events[k]) CloseHandle(w->events[k]);
+        free(w->buffers[k]);
+        CloseHandle(w->dirs[k]);
+        return -1;
+    }
+    return w->count++;
+}
+
+int watch_wait(Watch* w, int timeout_ms, WatchFn fn, void* ctx) {
+    if (w->count == 0) return -1;
+    DWORD r = WaitForMultipleObjects((DWORD)w->count, w->events, FALSE,
+        timeout_ms < 0 ? INFINITE : (DWORD)timeout_ms);
+    if (r == WAIT_TIMEOUT) return 0;
+    if (r >= WAIT_OBJECT_0 + (DWORD)w->count) return -1;
+
+    int k = (int)(r - WAIT_OBJECT_0);
+    DWORD size = 0;
+    if (!GetOverlappedResult(w->dirs[k], &w->overlapped[k], &size, FALSE)) return -1;
+
+    //! size == 0 — буфер переполнен и события потеряны: сообщаем об изменении без имени
+    int events = 0;
+    if (size == 0) {
+        fn(k, "", ctx);
+        events++;
+    }
+    const unsigned char* p = (const unsigned char*)w->buffers[k];
+    while (size > 0) {
+        const FILE_NOTIFY_INFORMATION* info = (const FILE_NOTIFY_INFORMATION*)p;
+        char name[MAX_PATH * 3];
+        int len = WideCharToMultiByte(CP_UTF8, 0, info->FileName, (int)(info->FileNameLength / sizeof(WCHAR)),
+            name, sizeof(name) - 1, NULL, NULL);
+        name[len > 0 ? len : 0] = '\0';
+        fn(k, name, ctx);
+        events++;
+        if (info->NextEntryOffset == 0) break;
+        p += info->NextEntryOffset;
+    }
+    return watch_arm(w, k) == 0 ? events : -1;
+}
+
+void watch_destroy(Watch* w) {
+    if (!w) return;
+    for (int k = 0; k < w->count; k++) {
+        CancelIo(w->dirs[k]);
+        CloseHandle(w->dirs[k]);
+        CloseHandle(w->events[k]);
+        free(w->buffers[k]);
+    }
+    free(w);
+}
+
+#else
+
+struct Watch {
+    int fd;                     ///< Дескриптор inotify
+    int wd[WATCH_MAX_DIRS];     ///< Дескрипторы наблюдения каталогов
+    int count;
+};
+
+Watch* watch_create(void) {
+    Watch* w = calloc(1, sizeof(Watch));
+    if (!w) return NULL;
+    w->fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (w->fd < 0) {
+        free(w);
+        return NULL;
+    }
+    return w;
+}
+
+int watch_add(Watch* w, const char* dir) {
+    if (w->count == WATCH_MAX_DIRS) return -1;
+    //! Запись завершена (IN_CLOSE_WRITE) или файл подменён переименованием, создан либо удалён
+    int wd = inotify_add_watch(w->fd, dir, IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_CREATE | IN_DELETE);
+    if (wd < 0) return -1;
+    w->wd[w->count] = wd;
+    return w->count++;
+}
+
+int watch_wait(Watch* w, int timeout_ms, WatchFn fn, void* ctx) {
+    struct pollfd pfd = { w->fd, POLLIN, 0 };
+    int r = poll(&pfd, 1, timeout_ms);
+    if (r == 0 || (r < 0 && errno == EINTR)) return 0;
+    if (r < 0) return -1;
+
+    //! Буфер выровнен под struct inotify_event
+    char buffer[WATCH_BUFFER] __attribute__((aligned(__alignof__(struct inotify_event))));
+    int events = 0;
+    ssize_t n;
+    while ((n = read(w->fd, buffer, sizeof(buffer))) > 0) {
+        for (char* p = buffer; p < buffer + n; ) {
+            const struct inotify_event* e = (const struct inotify_event*)p;
+            if (e->mask & IN_Q_OVERFLOW) {
+                for (int k = 0; k < w->count; k++) fn(k, "", ctx);
+                events++;
+            }
+            for (int k = 0; k < w->count; k++) {
+                if (w->wd[k] == e->wd && e->len > 0) {
+                    fn(k, e->name, ctx);
+                    events++;
+                }
+            }
+            p += sizeof(struct inotify_event) + e->len;
+        }
+    }
+    return events;
+}
+
+void watch_destroy(Watch* w) {
+    if (!w) return;
+    close(w->fd);
+    free(w);
+}
+
+#endif
@@ -0,0 +1,45 @@
+/**
+ * @file watch.h
+ * @brief Наблюдение за изменением файлов в каталогах: inotify в Linux, ReadDirectoryChangesW в Windows.
+ *
+ * Наблюдаются каталоги, а не отдельные файлы: редакторы часто сохраняют файл через
+ * запись во временный и переименование, и наблюдение за самим файлом теряется.
+ * События сообщают имя файла внутри каталога; склейкой серий событий (debounce)
+ * занимается вызывающий.
+ */
+
+#ifndef WATCH_H
+#define WATCH_H
+
+#define WATCH_MAX_DIRS 4 ///< Наибольшее число наблюдаемых каталогов
+
+/** @brief Наблюдатель за каталогами. */
+typedef struct Watch Watch;
+
+/**
+ * @brief Обработчик события.
+ * @param[in] dir Номер каталога в порядке watch_add().
+ * @param[in] name Имя изменённого, созданного, удалённого или переименованного файла.
+ * @param[in] ctx Контекст вызывающего.
+ */
+typedef void (*WatchFn)(int dir, const char* name, void* ctx);
+
+/** @brief Создаёт наблюдателя; NULL, если система его не поддерживает. */
+Watch* watch_create(void);
+
+/**
+ * @brief Добавляет каталог к наблюдению.
+ * @return Номер каталога или -1, если каталог не удалось открыть.
+ */
+int watch_add(Watch* w, const char* dir);
+
+/**
+ * @brief Ждёт событий не дольше timeout_ms (-1 — без срока) и передаёт их обработчику.
+ * @return Количество событий, 0 при истечении срока, -1 при ошибке.
+ */
+int watch_wait(Watch* w, int timeout_ms, WatchFn fn, void* ctx);
+
+/** @brief Прекращает наблюдение и освобождает наблюдателя. */
+void watch_destroy(Watch* w);
+
+#endif /* WATCH_H */
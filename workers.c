@@ -0,0 +1,125 @@
+/**
+ * @file workers.c
+ * @brief Пул рабочих потоков: WinAPI на Windows, pthreads на остальных системах.
+ */
+
+#include <stdlib.h>
+
+#ifndef _WIN32
+#include <unistd.h>
+#include <time.h>
+#endif
+
+#include "workers.h"
+
+/** @brief Общее состояние пула на время одного вызова workers_run(). */
+typedef struct {
+    int count;           ///< Всего заданий
+    WorkerJob job;       ///< Функция задания
+    void* ctx;           ///< Контекст заданий
+#ifdef _WIN32
+    volatile LONG next;  ///< Индекс следующего невыданного задания
+#else
+    int next;            ///< Индекс следующего невыданного задания
+#endif
+} WorkerPool;
+
+/** @brief Атомарно выдаёт индекс следующего задания. */
+static int take_job(WorkerPool* pool) {
+#ifdef _WIN32
+    return (int)InterlockedIncrement(&pool->next) - 1;
+#else
+    return __atomic_fetch_add(&pool->next, 1, __ATOMIC_RELAXED);
+#endif
+}
+
+/** @brief Цикл рабочего потока: берёт задания, пока они не закончатся. */
+#ifdef _WIN32
+static DWORD WINAPI worker_main(LPVOID arg) {
+#else
+static void* worker_main(void* arg) {
+#endif
+    WorkerPool* pool = arg;
+    for (int i = take_job(pool); i < pool->count; i = take_job(pool)) {
+        pool->job(i, pool->ctx);
+    }
+    return 0;
+}
+
+void workers_run(int count, int threads, WorkerJob job, void* ctx) {
+    if (threads > count) threads = count;
+    if (threads <= 1) {
+        for (int i = 0; i < count; i++) {
+            job(i, ctx);
+        }
+        return;
+    }
+
+    WorkerPool pool = { count, job, ctx, 0 };
+
+    //! Вызывающий поток — один из threads рабочих, дополнительно запускаются threads-1.
+    //! Если память под дескрипторы не выделилась, он же выполняет все задания по очереди
+
+#ifdef _WIN32
+    HANDLE* handles = malloc(threads * sizeof(HANDLE));
+    int started = 0;
+    for (int t = 1; handles && t < threads; t++) {
+        handles[started] = CreateThread(NULL, 0, worker_main, &pool, 0, NULL);
+        if (handles[started]) started++;
+    }
+    worker_main(&pool);
+    for (int t = 0; t < started; t++) {
+        WaitForSingleObject(handles[t], INFINITE); //!< WaitForMultipleObjects ограничен 64 дескрипторами
+        CloseHandle(handles[t]);
+    }
+#else
+    pthread_t* handles = malloc(threads * sizeof(pthread_t));
+    int started = 0;
+    for (int t = 1; handles && t < threads; t++) {
+        if (pthread_create(&handles[started], NULL, worker_main, &pool) == 0) started++;
+    }
+    worker_main(&pool);
+    for (int t = 0; t < started; t++) {
+        pthread_join(handles[t], NULL);
+    }
+#endif
+
+    free(handles);
+}
+
+int workers_cpu_count(void) {
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwNumberOfProcessors > 0 ? (int)info.dwNumberOfProcessors : 1;
+#else
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? (int)n : 1;
+#endif
+}
+
+double workers_time(void) {
+#ifdef _WIN32
+    static LARGE_INTEGER frequency;
+    LARGE_INTEGER counter;
+    if (frequency.QuadPart == 0) QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&counter);
+    return (double)counter.QuadPart / frequency.QuadPart;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+#endif
+}
+
+#ifdef _WIN32
+void worker_mutex_init(WorkerMutex* m) { InitializeCriticalSection(m); }
+void worker_mutex_lock(WorkerMutex* m) { EnterCriticalSection(m); }
+void worker_mutex_unlock(WorkerMutex* m) { LeaveCriticalSection(m); }
+void worker_mutex_destroy(WorkerMutex* m) { DeleteCriticalSection(m); }
+#else
+void worker_mutex_init(WorkerMutex* m) { pthread_mutex_init(m, NULL); }
+void worker_mutex_lock(WorkerMutex* m) { pthread_mutex_lock(m); }
+void worker_mutex_unlock(WorkerMutex* m) { pthread_mutex_unlock(m); }
+void worker_mutex_destroy(WorkerMutex* m) { pthread_mutex_destroy(m); }
+#endif
@@ -0,0 +1,45 @@
+/**
+ * @file workers.h
+ * @brief Простой пул рабочих потоков для независимых заданий.
+ *
+ * Задания нумеруются от 0 до count-1 и раздаются потокам через атомарный счётчик,
+ * поэтому порядок результатов определяется индексом задания, а не порядком завершения.
+ */
+
+#ifndef WORKERS_H
+#define WORKERS_H
+
+#ifdef _WIN32
+#include <windows.h>
+typedef CRITICAL_SECTION WorkerMutex; ///< Мьютекс для данных, общих для заданий
+#else
+#include <pthread.h>
+typedef pthread_mutex_t WorkerMutex;  ///< Мьютекс для данных, общих для заданий
+#endif
+
+/** @brief Функция одного задания: получает его индекс и общий контекст. */
+typedef void (*WorkerJob)(int index, void* ctx);
+
+/**
+ * @brief Выполняет задания 0..count-1 на threads потоках и дожидается их завершения.
+ *  При threads <= 1 задания выполняются последовательно в вызывающем потоке.
+ * @param[in] count Количество заданий.
+ * @param[in] threads Количество потоков.
+ * @param[in] job Функция задания.
+ * @param[in] ctx Контекст, передаваемый каждому заданию.
+ */
+void workers_run(int count, int threads, WorkerJob job, void* ctx);
+
+/** @brief Количество доступных процессорных ядер (не меньше 1). */
+int workers_cpu_count(void);
+
+/** @brief Монотонное время в секундах от произвольной точки отсчёта, для замеров задержки. */
+double workers_time(void);
+
+/** @brief Операции над мьютексом: создание, захват, освобождение и удаление. */
+void worker_mutex_init(WorkerMutex* m);
+void worker_mutex_lock(WorkerMutex* m);
+void worker_mutex_unlock(WorkerMutex* m);
+void worker_mutex_destroy(WorkerMutex* m);
+
+#endif /* WORKERS_H */